@@ -365,6 +365,24 @@ mixer_api_t *alsa_api_parse ( gchar *cmd, gchar **verb )
     return NULL;
 }
 
+enum alsa_query_t {
+  ALSA_COUNT,
+  ALSA_VOLUME,
+  ALSA_MUTE,
+  ALSA_IS_DEFAULT,
+  ALSA_IS_DEFAULT_DEVICE,
+  ALSA_DESCRIPTION,
+  ALSA_QUERY_LAST
+};
+
+static const gchar *alsa_keys[] = {
+  "sink-count", "sink-volume", "sink-mute", "sink-is-default",
+  "sink-is-default-device", "sink-description",
+  "source-count", "source-volume", "source-mute", "source-is-default",
+  "source-is-default-device", "source-description",
+  NULL
+};
+
 static value_t alsa_func_volume ( vm_t *vm, value_t p[], gint np )
 {
   snd_mixer_elem_t *element;
@@ -372,32 +390,36 @@ static value_t alsa_func_volume ( vm_t *vm, value_t p[], gint np )
   mixer_api_t *api;
   alsa_source_t *src;
   gchar *verb;
+  gint sel;
 
   vm_param_check_np_range(vm, np, 1, 2, "Volume");
-  vm_param_check_string(vm, p, 0, "Volume");
   if(np==2)
     vm_param_check_string(vm, p, 1, "Volume");
 
-  if( !(api = alsa_api_parse(value_get_string(p[0]), &verb)) )
+  if( (sel = vm_param_selector(p[0], alsa_keys))<0 ||
+      !(api = alsa_api_parse((gchar *)alsa_keys[sel], &verb)) )
     return value_na;
 
-  if(!g_ascii_strcasecmp(verb, "count"))
+  if(sel % ALSA_QUERY_LAST == ALSA_COUNT)
     return value_new_numeric(g_hash_table_size(alsa_sources));
 
   if(!alsa_addr_parse(api, (np==2)? value_get_string(p[1]) : NULL, &src,
         &element, &channel) || !element)
     return value_na;
 
-  if(!g_ascii_strcasecmp(verb, "volume"))
-    return value_new_numeric(alsa_volume_get(element, channel, api));
-  if(!g_ascii_strcasecmp(verb, "mute"))
-    return value_new_numeric(alsa_mute_get(element, api));
-  if(!g_ascii_strcasecmp(verb, "is-default") ||
-      !g_ascii_strcasecmp(verb, "is-default-device"))
-    return value_new_numeric(!g_strcmp0(
-          api->default_name? api->default_name : "default", src->name));
-  if(!g_ascii_strcasecmp(verb, "description"))
-    return value_new_string(g_strdup(src->desc));
+  switch(sel % ALSA_QUERY_LAST)
+  {
+    case ALSA_VOLUME:
+      return value_new_numeric(alsa_volume_get(element, channel, api));
+    case ALSA_MUTE:
+      return value_new_numeric(alsa_mute_get(element, api));
+    case ALSA_IS_DEFAULT:
+    case ALSA_IS_DEFAULT_DEVICE:
+      return value_new_numeric(!g_strcmp0(
+            api->default_name? api->default_name : "default", src->name));
+    case ALSA_DESCRIPTION:
+      return value_new_string(g_strdup(src->desc));
+  }
 
   return value_na;
 }
@@ -558,6 +580,8 @@ gboolean sfwbar_module_init ( void )
 
   alsa_sources = g_hash_table_new_full( g_str_hash, g_str_equal, NULL,
       (GDestroyNotify)alsa_source_remove );
+  vm_func_selectors_add("volume", 0, alsa_keys);
+  vm_func_selectors_add("volumeinfo", 0, alsa_keys);
 
   if(snd_card_next(&card) >=0 && card >= 0)
     module_interface_activate(&sfwbar_interface);
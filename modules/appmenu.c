@@ -22,6 +22,8 @@ extern ModuleInterfaceV1 sfwbar_interface;
 
 static GHashTable *app_menu_items;
 static GHashTable *app_menu_filter;
+static GHashTable *app_menu_pending;
+static guint app_menu_pending_handle;
 static GtkWidget *app_menu_main;
 static gchar *app_menu_name = "app_menu_system";
 static gboolean app_menu_flat;
@@ -252,64 +254,31 @@ static void app_menu_item_insert ( GtkWidget *menu, GtkWidget *item )
   gtk_menu_shell_insert(GTK_MENU_SHELL(menu), item, count);
 }
 
-static gboolean app_menu_check_boolean ( GDesktopAppInfo *app, gchar *key )
+static void app_menu_add ( const gchar *id )
 {
-  gchar *value;
-  gboolean result;
-
-  if( !(value = g_desktop_app_info_get_string(app, key)) )
-    return FALSE;
-
-  result = !g_ascii_strncasecmp(value, "true", 4) && !g_ascii_isalpha(value[4]);
-  g_free(value);
-  return result;
-}
-
-static gboolean app_menu_check_present ( GDesktopAppInfo *app, gchar *key )
-{
-  gchar *value;
-  gboolean result;
-
-  if( !(value = g_desktop_app_info_get_string(app, key)) )
-    return FALSE;
-
-  result = !!value;
-  g_free(value);
-  return result;
-}
-
-static gboolean app_menu_add ( gchar *id )
-{
-  GDesktopAppInfo *app;
+  const app_info_entry_t *entry;
   GtkWidget *submenu;
   app_menu_dir_t *cat;
   app_menu_item_t *item;
 
-  g_return_val_if_fail(g_main_context_is_owner(g_main_context_default()), FALSE);
+  g_return_if_fail(g_main_context_is_owner(g_main_context_default()));
   if(g_hash_table_lookup(app_menu_filter, id))
   {
     g_debug("appmenu item: filter out '%s'", id);
-    g_free(id);
-    return FALSE;
+    return;
   }
   if(g_hash_table_lookup(app_menu_items, id) ||
-      !(app = g_desktop_app_info_new(id)) )
-  {
-    g_free(id);
-    return FALSE;
-  }
+      !(entry = app_info_entry_lookup(id)) )
+    return;
 
-  if( !app_menu_check_boolean(app, "Hidden") &&
-      !app_menu_check_boolean(app, "NoDisplay") &&
-      !app_menu_check_present(app, "NotShowIn") &&
-      g_desktop_app_info_get_show_in(app, NULL) &&
-      (cat = app_menu_cat_lookup(g_desktop_app_info_get_categories(app))) )
+  if( app_info_entry_visible(entry) &&
+      (cat = app_menu_cat_lookup(entry->categories)) )
   {
     item = g_malloc0(sizeof(app_menu_item_t));
     item->cat = cat;
     item->id = g_strdup(id);
     item->widget = menu_item_get(NULL, TRUE);
-    menu_item_update_from_app(item->widget, app);
+    menu_item_update_from_entry(item->widget, entry);
     menu_item_set_sort_index(item->widget, 500);
 
     g_hash_table_insert(app_menu_items, item->id, item);
@@ -332,19 +301,29 @@ static gboolean app_menu_add ( gchar *id )
 
     app_menu_item_insert(app_menu_flat? app_menu_main :
         gtk_menu_item_get_submenu(GTK_MENU_ITEM(cat->widget)), item->widget);
-
-//    g_debug("appmenu item: '%s', title: '%s', icon: '%s', cat: %s'", item->id,
-//        item->name, item->icon, item->cat?item->cat->title:"null");
   }
-  g_object_unref(app);
-  g_free(id);
+}
+
+static gboolean app_menu_pending_cb ( gpointer data )
+{
+  GHashTableIter hiter;
+  gpointer id;
+
+  app_menu_pending_handle = 0;
+  g_hash_table_iter_init(&hiter, app_menu_pending);
+  while(g_hash_table_iter_next(&hiter, &id, NULL))
+    app_menu_add(id);
+  g_hash_table_remove_all(app_menu_pending);
 
   return FALSE;
 }
 
+/* additions are batched into a single deferred pass */
 static void app_menu_handle_add ( const gchar *id )
 {
-  g_timeout_add(1000, (GSourceFunc)app_menu_add, g_strdup(id));
+  g_hash_table_add(app_menu_pending, g_strdup(id));
+  if(!app_menu_pending_handle)
+    app_menu_pending_handle = g_timeout_add(1000, app_menu_pending_cb, NULL);
 }
 
 static void app_menu_handle_delete ( const gchar *id )
@@ -354,6 +333,7 @@ static void app_menu_handle_delete ( const gchar *id )
   GList *list;
 
   g_return_if_fail(g_main_context_is_owner(g_main_context_default()));
+  g_hash_table_remove(app_menu_pending, id);
   if( !(item = g_hash_table_lookup(app_menu_items, id)) )
     return;
 
@@ -430,8 +410,9 @@ static void app_info_categories_update ( void )
 
 static void app_info_locale_handle ( gpointer data, vm_store_t *store )
 {
-  app_info_categories_update();
   app_info_remove_handlers(app_menu_handle_add, app_menu_handle_delete);
+  app_info_categories_update();
+  app_info_index_update();
   app_info_add_handlers(app_menu_handle_add, app_menu_handle_delete);
 }
 
@@ -503,6 +484,8 @@ gboolean sfwbar_module_init ( void )
   app_menu_items = g_hash_table_new(g_str_hash, g_str_equal);
   app_menu_filter = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
       NULL);
+  app_menu_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+      NULL);
   app_menu_main = menu_new(app_menu_name);
   g_object_set_data(G_OBJECT(app_menu_main), "sort", GINT_TO_POINTER(TRUE));
   app_info_add_handlers(app_menu_handle_add, app_menu_handle_delete);
@@ -60,6 +60,18 @@ typedef struct _bz_minor_class {
   gchar *name;
 } bz_minor_class_t;
 
+typedef struct _bz_snapshot {
+  GHashTable *devices;
+  gint adapters;
+  BzAdapter adapter;
+} bz_snapshot_t;
+
+static void bz_snapshot_clear ( bz_snapshot_t *snap );
+
+static module_snapshot_t bz_state = {
+  .clear = (GDestroyNotify)bz_snapshot_clear
+};
+
 static bz_minor_class_t bz_minor_class[] = {
   { 0b01111111111100, 0b00000100000100, "Desktop" },
   { 0b01111111111100, 0b00000100001000, "Server" },
@@ -151,6 +163,74 @@ static gchar *bz_get_minor_class ( guint32 class )
   return "Unknown";
 }
 
+static BzAdapter *bz_adapter_get ( void )
+{
+  if(!adapters)
+    return NULL;
+  return adapters->data;
+}
+
+static void bz_device_snapshot_free ( BzDevice *device )
+{
+  g_free(device->path);
+  g_free(device->addr);
+  g_free(device->name);
+  g_free(device->icon);
+  g_free(device);
+}
+
+static void bz_snapshot_clear ( bz_snapshot_t *snap )
+{
+  g_hash_table_unref(snap->devices);
+}
+
+/* publish device and adapter state for the expression functions */
+static void bz_publish ( void )
+{
+  bz_snapshot_t *snap;
+  BzDevice *device, *copy;
+  BzAdapter *adapter;
+  GHashTableIter iter;
+
+  snap = module_snapshot_alloc(sizeof(bz_snapshot_t));
+  snap->devices = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify)bz_device_snapshot_free);
+  if(devices)
+  {
+    g_hash_table_iter_init(&iter, devices);
+    while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&device))
+    {
+      copy = g_memdup2(device, sizeof(BzDevice));
+      copy->path = g_strdup(device->path);
+      copy->addr = g_strdup(device->addr);
+      copy->name = g_strdup(device->name);
+      copy->icon = g_strdup(device->icon);
+      copy->cancel = NULL;
+      g_hash_table_insert(snap->devices, copy->path, copy);
+    }
+  }
+  snap->adapters = g_list_length(adapters);
+  if( (adapter = bz_adapter_get()) )
+  {
+    snap->adapter.discovering = adapter->discovering;
+    snap->adapter.discoverable = adapter->discoverable;
+    snap->adapter.powered = adapter->powered;
+  }
+  module_snapshot_publish(&bz_state, snap);
+}
+
+static void bz_device_emit ( BzDevice *device )
+{
+  bz_publish();
+  trigger_emit_with_string("bluez-conf", "path", g_strdup(device->path));
+}
+
+static void bz_adapter_emit ( void )
+{
+  bz_publish();
+  trigger_emit("bluez-adapter");
+}
+
 static void bz_adapter_free ( gchar *object )
 {
   GList *iter;
@@ -171,7 +251,7 @@ static void bz_adapter_free ( gchar *object )
   g_free(adapter->path);
   g_free(adapter->iface);
   g_free(adapter);
-  trigger_emit("bluez-adapter");
+  bz_adapter_emit();
 }
 
 static void bz_device_free ( BzDevice *device )
@@ -188,13 +268,6 @@ static void bz_device_free ( BzDevice *device )
   g_free(device);
 }
 
-static BzAdapter *bz_adapter_get ( void )
-{
-  if(!adapters)
-    return NULL;
-  return adapters->data;
-}
-
 static gboolean bz_scan_stop ( BzAdapter *adapter )
 {
   g_debug("bluez: scan off");
@@ -255,7 +328,7 @@ static void bz_connect_cb ( GDBusConnection *con, GAsyncResult *res,
   GVariant *result;
 
   device->connecting =  FALSE;
-  trigger_emit_with_string("bluez-conf", "path", g_strdup(device->path));
+  bz_device_emit(device);
   if( (result = g_dbus_connection_call_finish(con, res, NULL)) )
   {
     g_debug("bluez: connected %s (%s)", device->addr, device->name);
@@ -268,7 +341,7 @@ static void bz_connect ( BzDevice *device )
   if(!device->connecting)
   {
     device->connecting = TRUE;
-    trigger_emit_with_string("bluez-conf", "path", g_strdup(device->path));
+    bz_device_emit(device);
   }
   g_debug("bluez: attempting to connect %s (%s)", device->addr, device->name);
   g_dbus_connection_call(bz_con, bz_serv, device->path,
@@ -308,7 +381,7 @@ static void bz_trust_cb ( GDBusConnection *con, GAsyncResult *res,
   if( !(result = g_dbus_connection_call_finish(con, res, NULL)) )
   {
     device->connecting =  FALSE;
-    trigger_emit_with_string("bluez-conf", "path", g_strdup(device->path));
+    bz_device_emit(device);
   }
   else
   {
@@ -342,7 +415,7 @@ static void bz_pair_cb ( GDBusConnection *con, GAsyncResult *res,
   if( !(result = g_dbus_connection_call_finish(con, res, NULL)) )
   {
     device->connecting =  FALSE;
-    trigger_emit_with_string("bluez-conf", "path", g_strdup(device->path));
+    bz_device_emit(device);
   }
   else
   {
@@ -355,7 +428,7 @@ static void bz_pair_cb ( GDBusConnection *con, GAsyncResult *res,
 static void bz_pair ( BzDevice *device )
 {
   device->connecting =  TRUE;
-  trigger_emit_with_string("bluez-conf", "path", g_strdup(device->path));
+  bz_device_emit(device);
 
   if(device->paired)
   {
@@ -477,7 +550,7 @@ static void bz_device_handle ( gchar *path, gchar *iface, GVariantIter *piter )
   }
 
   bz_device_properties (device, piter);
-  trigger_emit_with_string("bluez-conf", "path", g_strdup(device->path));
+  bz_device_emit(device);
 
   g_debug("bluez: device added: %d %d %s %s on %s",device->paired,
       device->connected, device->addr, device->name, device->path);
@@ -493,6 +566,7 @@ static void bz_device_removed ( GDBusConnection *con, const gchar *sender,
   bz_adapter_free(object);
   if(devices)
     g_hash_table_remove(devices, object);
+  bz_publish();
 }
 
 static void bz_device_changed ( GDBusConnection *con, const gchar *sender,
@@ -510,7 +584,7 @@ static void bz_device_changed ( GDBusConnection *con, const gchar *sender,
   {
     g_debug("bluez: device changed: %d %d %s %s on %s",device->paired,
         device->connected, device->addr, device->name, device->path);
-    trigger_emit_with_string("bluez-conf", "path", g_strdup(device->path));
+    bz_device_emit(device);
   }
   g_variant_iter_free(piter);
 }
@@ -530,7 +604,7 @@ static void bz_adapter_update ( const gchar *path, GVariant *dict )
   if(g_variant_lookup(dict, "Powered", "b", &state))
     adapter->powered = state;
 
-  trigger_emit("bluez-adapter");
+  bz_adapter_emit();
 }
 
 static void bz_adapter_prop_cb ( GDBusConnection *con, GAsyncResult *res,
@@ -564,7 +638,7 @@ static void bz_adapter_handle ( gchar *object, gchar *iface )
       (GAsyncReadyCallback)bz_adapter_prop_cb, adapter);
 
   adapters = g_list_append(adapters, adapter);
-  trigger_emit("bluez-adapter");
+  bz_adapter_emit();
 }
 
 static void bz_adapter_changed ( GDBusConnection *con, const gchar *sender,
@@ -659,6 +733,7 @@ static void bz_name_disappeared_cb (GDBusConnection *con, const gchar *name,
     g_hash_table_remove_all(devices);
   g_list_free_full(adapters,(GDestroyNotify)bz_adapter_free);
   adapters = NULL;
+  bz_publish();
 }
 
 static value_t bz_action_scan ( vm_t *vm, value_t p[], gint np )
@@ -741,64 +816,127 @@ static value_t bz_action_remove ( vm_t *vm, value_t p[], gint np )
   return value_na;
 }
 
-static value_t bz_expr_adapter ( vm_t *vm, value_t p[], gint np )
+enum bz_device_query_t {
+  BZ_DEV_NAME,
+  BZ_DEV_ADDRESS,
+  BZ_DEV_ICON,
+  BZ_DEV_PATH,
+  BZ_DEV_MAJOR_CLASS,
+  BZ_DEV_MINOR_CLASS,
+  BZ_DEV_PAIRED,
+  BZ_DEV_CONNECTED,
+  BZ_DEV_CONNECTING,
+  BZ_DEV_TRUSTED,
+  BZ_DEV_VISIBLE,
+};
+
+static const gchar *bz_device_keys[] = { "Name", "Address", "Icon", "Path",
+  "MajorClass", "MinorClass", "Paired", "Connected", "Connecting", "Trusted",
+  "Visible", NULL };
+
+enum bz_adapter_query_t {
+  BZ_ADAPTER_COUNT,
+  BZ_ADAPTER_DISCOVERING,
+  BZ_ADAPTER_DISCOVERABLE,
+  BZ_ADAPTER_POWERED,
+};
+
+static const gchar *bz_adapter_keys[] = { "count", "discovering",
+  "discoverable", "powered", NULL };
+
+static value_t bz_device_query ( BzDevice *device, gint prop )
 {
-  BzAdapter *adapter;
+  if(!device)
+    return value_na;
 
-  vm_param_check_np(vm, np, 1, "BluezAdapter");
-  vm_param_check_string(vm, p, 0, "BluezAdapter");
+  switch(prop)
+  {
+    case BZ_DEV_NAME:
+      return value_new_string(g_strdup(device->name));
+    case BZ_DEV_ADDRESS:
+      return value_new_string(g_strdup(device->addr));
+    case BZ_DEV_ICON:
+      return value_new_string(g_strdup(device->icon));
+    case BZ_DEV_PATH:
+      return value_new_string(g_strdup(device->path));
+    case BZ_DEV_MAJOR_CLASS:
+      return value_new_string(g_strdup(bz_get_major_class(device->class)));
+    case BZ_DEV_MINOR_CLASS:
+      return value_new_string(g_strdup(bz_get_minor_class(device->class)));
+    case BZ_DEV_PAIRED:
+      return value_new_numeric(device->paired);
+    case BZ_DEV_CONNECTED:
+      return value_new_numeric(device->connected);
+    case BZ_DEV_CONNECTING:
+      return value_new_numeric(device->connecting);
+    case BZ_DEV_TRUSTED:
+      return value_new_numeric(device->trusted);
+    case BZ_DEV_VISIBLE:
+      return value_new_numeric(device->name ||
+          ((device->class & 0x1F40)==0x0540));
+  }
 
-  if( !(adapter = bz_adapter_get()) )
+  return value_na;
+}
+
+static value_t bz_adapter_query ( bz_snapshot_t *snap, gint prop )
+{
+  if(!snap->adapters)
     return value_na;
 
-  if(!g_ascii_strcasecmp(value_get_string(p[0]), "count"))
-    return value_new_numeric(g_list_length(adapters));
-  if(!g_ascii_strcasecmp(value_get_string(p[0]), "discovering"))
-    return value_new_numeric(adapter->discovering);
-  if(!g_ascii_strcasecmp(value_get_string(p[0]), "discoverable"))
-    return value_new_numeric(adapter->discoverable);
-  if(!g_ascii_strcasecmp(value_get_string(p[0]), "powered"))
-    return value_new_numeric(adapter->powered);
+  switch(prop)
+  {
+    case BZ_ADAPTER_COUNT:
+      return value_new_numeric(snap->adapters);
+    case BZ_ADAPTER_DISCOVERING:
+      return value_new_numeric(snap->adapter.discovering);
+    case BZ_ADAPTER_DISCOVERABLE:
+      return value_new_numeric(snap->adapter.discoverable);
+    case BZ_ADAPTER_POWERED:
+      return value_new_numeric(snap->adapter.powered);
+  }
 
   return value_na;
 }
 
+/* BluezAdapter and BluezDevice read published state only, so they can run
+ * on any thread */
+static value_t bz_expr_adapter ( vm_t *vm, value_t p[], gint np )
+{
+  bz_snapshot_t *snap;
+  value_t result;
+  gint sel;
+
+  vm_param_check_np(vm, np, 1, "BluezAdapter");
+
+  if( (sel = vm_param_selector(p[0], bz_adapter_keys))<0 )
+    return value_na;
+  if( !(snap = module_snapshot_acquire(&bz_state)) )
+    return value_na;
+  result = bz_adapter_query(snap, sel);
+  module_snapshot_release(&bz_state, snap);
+
+  return result;
+}
+
 static value_t bz_expr_device ( vm_t *vm, value_t p[], gint np )
 {
-  BzDevice *device;
+  bz_snapshot_t *snap;
+  value_t result;
+  gint sel;
 
   vm_param_check_np(vm, np, 2, "BluezDevice");
   vm_param_check_string(vm, p, 0, "BluezDevice");
-  vm_param_check_string(vm, p, 1, "BluezDevice");
 
-  if(!devices ||
-      !(device = g_hash_table_lookup(devices, value_get_string(p[0]))))
+  if( (sel = vm_param_selector(p[1], bz_device_keys))<0 )
     return value_na;
+  if( !(snap = module_snapshot_acquire(&bz_state)) )
+    return value_na;
+  result = bz_device_query(g_hash_table_lookup(snap->devices,
+        value_get_string(p[0])), sel);
+  module_snapshot_release(&bz_state, snap);
 
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "Name"))
-    return value_new_string(g_strdup(device->name));
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "Address"))
-    return value_new_string(g_strdup(device->addr));
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "Icon"))
-    return value_new_string(g_strdup(device->icon));
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "Path"))
-    return value_new_string(g_strdup(device->path));
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "MajorClass"))
-    return value_new_string(g_strdup(bz_get_major_class(device->class)));
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "MinorClass"))
-    return value_new_string(g_strdup(bz_get_minor_class(device->class)));
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "Paired"))
-    return value_new_numeric(device->paired);
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "Connected"))
-    return value_new_numeric(device->connected);
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "Connecting"))
-    return value_new_numeric(device->connecting);
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "Trusted"))
-    return value_new_numeric(device->trusted);
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "Visible"))
-  return value_new_numeric(device->name || ((device->class & 0x1F40)==0x0540));
-
-  return value_na;
+  return result;
 }
 
 gboolean sfwbar_module_init ( void )
@@ -813,8 +951,10 @@ gboolean sfwbar_module_init ( void )
   vm_func_add("bluezpair", bz_action_pair, TRUE, FALSE);
   vm_func_add("bluezdisconnect", bz_action_disconnect, TRUE, FALSE);
   vm_func_add("bluezremove", bz_action_remove, TRUE, FALSE);
-  vm_func_add("bluezadapter", bz_expr_adapter, FALSE, FALSE);
-  vm_func_add("bluezdevice", bz_expr_device, FALSE, FALSE);
+  vm_func_add("bluezadapter", bz_expr_adapter, FALSE, TRUE);
+  vm_func_add("bluezdevice", bz_expr_device, FALSE, TRUE);
+  vm_func_selectors_add("bluezadapter", 0, bz_adapter_keys);
+  vm_func_selectors_add("bluezdevice", 1, bz_device_keys);
 
   g_bus_watch_name(G_BUS_TYPE_SYSTEM, bz_serv, G_BUS_NAME_WATCHER_FLAGS_NONE,
       bz_name_appeared_cb, bz_name_disappeared_cb, NULL, NULL);
@@ -3,7 +3,10 @@
  * Copyright 2025- Sfwbar maintainers
  */
 
-
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "module.h"
 #include "trigger.h"
 #include "util/string.h"
@@ -20,16 +23,97 @@ static GList *mpd_db_list, *mpd_search_list, *mpd_playlist_list, *mpd_playlist;
 static GSocketConnection *mpd_connection;
 static GIOChannel *chan;
 static GHashTable *mpd_state, *mpd_song_current;
-static gchar *mpd_error, *mpd_cover;
+static gchar *mpd_error, *mpd_cover, *mpd_cover_key, *mpd_cover_dir;
 static const gchar *mpd_cmd_readpicture, *mpd_cmd_currentsong, *mpd_cmd_idle,
              *mpd_cmd_albumart, *mpd_cmd_playlistinfo, *mpd_cmd_status,
              *mpd_cmd_init, *mpd_cmd_list, *mpd_cmd_search, *mpd_cmd_find,
              *mpd_cmd_listplaylistinfo, *mpd_cmd_listplaylists;
 static const gchar *mpd_cmd_current, *mpd_art_cmd;
-static gint64 mpd_time, mpd_pb_counter;
-static gsize mpd_cover_total, mpd_cover_received, mpd_cover_bufsize;
+static gint64 mpd_time;
+static gsize mpd_cover_total, mpd_cover_received, mpd_cover_chunk;
+static gboolean mpd_cover_stale, mpd_cover_trimmed;
 static GdkPixbufLoader *mpd_cover_loader;
-static gpointer mpd_cover_buf;
+
+/* album art is decoded and cached no larger than this */
+#define MPD_COVER_SIZE 512
+/* images on disk are dropped when unused for a month or least recently
+ * used beyond this size */
+#define MPD_COVER_CACHE_SIZE (32*1024*1024)
+#define MPD_COVER_CACHE_AGE (30*24*3600)
+#define MPD_COVER_CACHE_KEYS 4096
+
+typedef struct _mpd_cover_file {
+  gchar *path;
+  gint64 mtime;
+  gsize size;
+} mpd_cover_file_t;
+
+typedef struct _mpd_snapshot {
+  GHashTable *state, *song;
+  GPtrArray *queue, *playlist, *search;
+  gchar *cover;
+  gint64 time;
+} mpd_snapshot_t;
+
+static void mpd_snapshot_clear ( mpd_snapshot_t *snap )
+{
+  g_hash_table_unref(snap->state);
+  g_hash_table_unref(snap->song);
+  g_ptr_array_unref(snap->queue);
+  g_ptr_array_unref(snap->playlist);
+  g_ptr_array_unref(snap->search);
+  g_free(snap->cover);
+}
+
+static module_snapshot_t mpd_snapshot = {
+  .clear = (GDestroyNotify)mpd_snapshot_clear
+};
+
+static GHashTable *mpd_snapshot_hash ( GHashTable *hash )
+{
+  GHashTable *copy;
+  GHashTableIter iter;
+  gpointer key, val;
+
+  copy = g_hash_table_new_full((GHashFunc)str_nhash, (GEqualFunc)str_nequal,
+      g_free, g_free);
+  g_hash_table_iter_init(&iter, hash);
+  while(g_hash_table_iter_next(&iter, &key, &val))
+    g_hash_table_insert(copy, g_strdup(key), g_strdup(val));
+
+  return copy;
+}
+
+/* song tables are never modified once their list is complete, so the
+ * snapshot can share them */
+static GPtrArray *mpd_snapshot_list ( GList *list )
+{
+  GPtrArray *array;
+  GList *iter;
+
+  array = g_ptr_array_new_full(g_list_length(list),
+      (GDestroyNotify)g_hash_table_unref);
+  for(iter=list; iter; iter=g_list_next(iter))
+    g_ptr_array_add(array, g_hash_table_ref(iter->data));
+
+  return array;
+}
+
+/* publish player state for MpdInfo and MpdList */
+static void mpd_publish ( void )
+{
+  mpd_snapshot_t *snap;
+
+  snap = module_snapshot_alloc(sizeof(mpd_snapshot_t));
+  snap->state = mpd_snapshot_hash(mpd_state);
+  snap->song = mpd_snapshot_hash(mpd_song_current);
+  snap->queue = mpd_snapshot_list(mpd_queue);
+  snap->playlist = mpd_snapshot_list(mpd_playlist);
+  snap->search = mpd_snapshot_list(mpd_search_list);
+  snap->cover = g_strdup(mpd_cover);
+  snap->time = mpd_time;
+  module_snapshot_publish(&mpd_snapshot, snap);
+}
 
 static gint mpd_cmd_cmp ( const void *data, const void *cmd )
 {
@@ -68,6 +152,28 @@ static void mpd_cmd_append ( gchar *cmd, ... )
   }
 }
 
+static void mpd_cover_loader_drop ( void )
+{
+  if(!mpd_cover_loader)
+    return;
+  gdk_pixbuf_loader_close(mpd_cover_loader, NULL);
+  g_clear_pointer(&mpd_cover_loader, g_object_unref);
+}
+
+static void mpd_cover_size_cb ( GdkPixbufLoader *loader, gint w, gint h,
+    gpointer d )
+{
+  if(w <= MPD_COVER_SIZE && h <= MPD_COVER_SIZE)
+    return;
+
+  if(w > h)
+    gdk_pixbuf_loader_set_size(loader, MPD_COVER_SIZE,
+        MAX(1, h * MPD_COVER_SIZE / w));
+  else
+    gdk_pixbuf_loader_set_size(loader, MAX(1, w * MPD_COVER_SIZE / h),
+        MPD_COVER_SIZE);
+}
+
 static void mpd_cmd_cover ( gsize offset, const gchar *cmd )
 {
   gchar *file;
@@ -77,15 +183,281 @@ static void mpd_cmd_cover ( gsize offset, const gchar *cmd )
   {
     mpd_cover_total = 0;
     mpd_cover_received = 0;
-    if(mpd_cover_loader)
-    {
-      gdk_pixbuf_loader_close(mpd_cover_loader, NULL);
-      g_clear_pointer(&mpd_cover_loader, g_object_unref);
-    }
+    mpd_cover_loader_drop();
     mpd_cover_loader = gdk_pixbuf_loader_new();
+    g_signal_connect(G_OBJECT(mpd_cover_loader), "size-prepared",
+        G_CALLBACK(mpd_cover_size_cb), NULL);
   }
   if( (file = g_hash_table_lookup(mpd_song_current, "file")) && *file)
-    mpd_cmd_append("%s \"%s\" %d", cmd, file, offset);
+    mpd_cmd_append("%s \"%s\" %lu", cmd, file, (gulong)offset);
+}
+
+static gchar *mpd_cover_cache_file ( const gchar *sub, const gchar *sum )
+{
+  gchar *name, *path;
+
+  name = g_strconcat(sum, ".png", NULL);
+  path = g_build_filename(g_get_user_cache_dir(), "sfwbar", "mpd", sub, name,
+      NULL);
+  g_free(name);
+
+  return path;
+}
+
+/* keys/<sha1 of key>.png links to img/<sha1 of the pixels>.png, so art shared
+ * by many files (or found by both file and directory) is stored once */
+static gchar *mpd_cover_cache_path ( const gchar *key )
+{
+  gchar *sum, *path;
+
+  sum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+  path = mpd_cover_cache_file("keys", sum);
+  g_free(sum);
+
+  return path;
+}
+
+static gint mpd_cover_cache_age_cmp ( gconstpointer a, gconstpointer b )
+{
+  gint64 ma = (*(mpd_cover_file_t **)a)->mtime;
+  gint64 mb = (*(mpd_cover_file_t **)b)->mtime;
+
+  return ma < mb? -1 : ma > mb;
+}
+
+static void mpd_cover_cache_file_free ( mpd_cover_file_t *file )
+{
+  g_free(file->path);
+  g_free(file);
+}
+
+/* list cache entries of a subdirectory, oldest first. Links are listed with
+ * their own modification time, which is refreshed when they are used */
+static GPtrArray *mpd_cover_cache_scan ( const gchar *sub, gsize *total )
+{
+  mpd_cover_file_t *file;
+  GPtrArray *files;
+  GStatBuf stattr;
+  const gchar *name;
+  gchar *path, *dir;
+  GDir *gdir;
+
+  dir = g_build_filename(g_get_user_cache_dir(), "sfwbar", "mpd", sub, NULL);
+  files = g_ptr_array_new_with_free_func(
+      (GDestroyNotify)mpd_cover_cache_file_free);
+  *total = 0;
+  if( (gdir = g_dir_open(dir, 0, NULL)) )
+  {
+    while( (name = g_dir_read_name(gdir)) )
+    {
+      path = g_build_filename(dir, name, NULL);
+      if(g_lstat(path, &stattr))
+      {
+        g_free(path);
+        continue;
+      }
+      file = g_malloc(sizeof(mpd_cover_file_t));
+      file->path = path;
+      file->mtime = stattr.st_mtime;
+      file->size = stattr.st_size;
+      *total += file->size;
+      g_ptr_array_add(files, file);
+    }
+    g_dir_close(gdir);
+  }
+  g_free(dir);
+  g_ptr_array_sort(files, mpd_cover_cache_age_cmp);
+
+  return files;
+}
+
+/* drop images unused for MPD_COVER_CACHE_AGE, then the least recently used
+ * ones until the cache fits into MPD_COVER_CACHE_SIZE. Links to removed
+ * images, links unused for MPD_COVER_CACHE_AGE and the least recently used
+ * links beyond MPD_COVER_CACHE_KEYS are dropped as well */
+static void mpd_cover_cache_trim ( void )
+{
+  mpd_cover_file_t *file;
+  GPtrArray *files;
+  gint64 now;
+  gsize total;
+  guint i;
+
+  now = g_get_real_time() / G_USEC_PER_SEC;
+  files = mpd_cover_cache_scan("img", &total);
+  for(i=0; i<files->len; i++)
+  {
+    file = g_ptr_array_index(files, i);
+    if(now - file->mtime < MPD_COVER_CACHE_AGE &&
+        total <= MPD_COVER_CACHE_SIZE)
+      break;
+    g_debug("mpd: cover cache drop: %s", file->path);
+    g_unlink(file->path);
+    total -= file->size;
+  }
+  g_ptr_array_unref(files);
+
+  files = mpd_cover_cache_scan("keys", &total);
+  for(i=0; i<files->len; i++)
+  {
+    file = g_ptr_array_index(files, i);
+    if(now - file->mtime >= MPD_COVER_CACHE_AGE ||
+        files->len - i > MPD_COVER_CACHE_KEYS ||
+        !g_file_test(file->path, G_FILE_TEST_EXISTS))
+      g_unlink(file->path);
+  }
+  g_ptr_array_unref(files);
+}
+
+static void mpd_cover_set ( GdkPixbuf *pixbuf )
+{
+  scale_image_cache_unref(mpd_cover);
+  g_clear_pointer(&mpd_cover, g_free);
+  if(pixbuf)
+    mpd_cover = scale_image_cache_insert(pixbuf);
+  mpd_publish();
+  trigger_emit("mpd-cover");
+}
+
+static gboolean mpd_cover_cache_load ( const gchar *key )
+{
+  GdkPixbuf *pixbuf;
+  gchar *path;
+
+  if(!key)
+    return FALSE;
+
+  path = mpd_cover_cache_path(key);
+  if( (pixbuf = gdk_pixbuf_new_from_file(path, NULL)) )
+  {
+    g_utime(path, NULL);
+    utimensat(AT_FDCWD, path, NULL, AT_SYMLINK_NOFOLLOW);
+  }
+  g_free(path);
+  if(!pixbuf)
+    return FALSE;
+
+  g_debug("mpd: cover cache hit: %s", key);
+  mpd_cover_set(pixbuf);
+  return TRUE;
+}
+
+static void mpd_cover_cache_save ( const gchar *key, GdkPixbuf *pixbuf )
+{
+  GChecksum *sum;
+  const guchar *pixels;
+  gint meta[3], i, stride;
+  gchar *img, *link, *target, *dir;
+  gboolean new;
+
+  if(!key)
+    return;
+
+  /* row padding may be uninitialized, hash the pixels only */
+  meta[0] = gdk_pixbuf_get_width(pixbuf);
+  meta[1] = gdk_pixbuf_get_height(pixbuf);
+  meta[2] = gdk_pixbuf_get_n_channels(pixbuf);
+  pixels = gdk_pixbuf_read_pixels(pixbuf);
+  stride = gdk_pixbuf_get_rowstride(pixbuf);
+  sum = g_checksum_new(G_CHECKSUM_SHA1);
+  g_checksum_update(sum, (guchar *)meta, sizeof(meta));
+  for(i=0; i<meta[1]; i++)
+    g_checksum_update(sum, pixels + (gsize)i*stride,
+        (gsize)meta[0] * meta[2]);
+  img = mpd_cover_cache_file("img", g_checksum_get_string(sum));
+  target = g_strconcat("../img/", g_checksum_get_string(sum), ".png", NULL);
+  g_checksum_free(sum);
+  link = mpd_cover_cache_path(key);
+
+  dir = g_path_get_dirname(img);
+  new = !g_file_test(img, G_FILE_TEST_EXISTS);
+  if(!new)
+    g_utime(img, NULL);
+  else if(g_mkdir_with_parents(dir, 0700) ||
+      !gdk_pixbuf_save(pixbuf, img, "png", NULL, NULL))
+    new = FALSE;
+  g_free(dir);
+
+  dir = g_path_get_dirname(link);
+  if(g_file_test(img, G_FILE_TEST_EXISTS) && !g_mkdir_with_parents(dir, 0700))
+  {
+    g_unlink(link);
+    if(symlink(target, link))
+      g_debug("mpd: unable to link %s", link);
+  }
+  g_free(dir);
+  g_free(target);
+  g_free(link);
+  g_free(img);
+
+  if(new)
+    mpd_cover_cache_trim();
+}
+
+/* art is looked up on disk per file (and file modification time), then per
+ * directory, so the tracks of an album don't fetch the same art again */
+static void mpd_cover_lookup ( void )
+{
+  const gchar *file, *mod;
+  gchar *dir;
+
+  g_clear_pointer(&mpd_cover_key, g_free);
+  g_clear_pointer(&mpd_cover_dir, g_free);
+  if( !(file = g_hash_table_lookup(mpd_song_current, "file")) || !*file)
+  {
+    mpd_cover_set(NULL);
+    return;
+  }
+
+  mod = g_hash_table_lookup(mpd_song_current, "Last-Modified");
+  mpd_cover_key = g_strconcat("file:", file, "\n", mod? mod : "", NULL);
+  dir = g_path_get_dirname(file);
+  mpd_cover_dir = g_strconcat("dir:", dir, NULL);
+  g_free(dir);
+
+  if(!mpd_cover_trimmed)
+  {
+    mpd_cover_trimmed = TRUE;
+    mpd_cover_cache_trim();
+  }
+
+  if(!mpd_cover_cache_load(mpd_cover_key) &&
+      !mpd_cover_cache_load(mpd_cover_dir))
+    mpd_cmd_cover(0, mpd_cmd_readpicture);
+}
+
+static void mpd_cover_finish ( void )
+{
+  GdkPixbuf *pixbuf = NULL;
+
+  if(gdk_pixbuf_loader_close(mpd_cover_loader, NULL) &&
+      (pixbuf = gdk_pixbuf_loader_get_pixbuf(mpd_cover_loader)) )
+  {
+    g_object_ref(pixbuf);
+    mpd_cover_cache_save(mpd_cover_key, pixbuf);
+    mpd_cover_cache_save(mpd_cover_dir, pixbuf);
+  }
+  g_clear_pointer(&mpd_cover_loader, g_object_unref);
+  mpd_cover_total = 0;
+  mpd_cover_set(pixbuf);
+}
+
+/* called when a readpicture/albumart response completes */
+static void mpd_cover_next ( void )
+{
+  if(mpd_cover_total && !mpd_cover_loader)
+    mpd_cmd_cover(0, mpd_art_cmd);
+  else if(mpd_cover_total && mpd_cover_received < mpd_cover_total)
+    mpd_cmd_cover(mpd_cover_received, mpd_art_cmd);
+  else if(mpd_cover_total)
+    mpd_cover_finish();
+  else if(mpd_art_cmd == mpd_cmd_readpicture)
+    mpd_cmd_cover(0, mpd_cmd_albumart);
+  else
+  {
+    mpd_cover_loader_drop();
+    mpd_cover_set(NULL);
+  }
 }
 
 static gboolean mpd_idle_handle ( gchar *str )
@@ -140,6 +512,18 @@ static void mpd_emit_with_array ( gchar *trigger, GList **list )
 
 }
 
+static gboolean mpd_version_check ( gchar *str, gint major, gint minor,
+    gint patch )
+{
+  gint v[3];
+
+  if(sscanf(str, "OK MPD %d.%d.%d", &v[0], &v[1], &v[2]) != 3)
+    return FALSE;
+
+  return v[0]>major || (v[0]==major && (v[1]>minor ||
+        (v[1]==minor && v[2]>=patch)));
+}
+
 static gboolean mpd_ok_handle ( gchar *str )
 {
   gchar *ptr;
@@ -147,6 +531,22 @@ static gboolean mpd_ok_handle ( gchar *str )
   if(g_ascii_strncasecmp(str, "OK", 2))
     return FALSE;
 
+  /* cover art publishes once the image is complete */
+  if(mpd_cmd_current == mpd_cmd_status ||
+      mpd_cmd_current == mpd_cmd_currentsong ||
+      mpd_cmd_current == mpd_cmd_playlistinfo ||
+      mpd_cmd_current == mpd_cmd_listplaylistinfo ||
+      mpd_cmd_current == mpd_cmd_search || mpd_cmd_current == mpd_cmd_find)
+    mpd_publish();
+  if(mpd_cmd_current == mpd_cmd_init && mpd_version_check(str, 0, 22, 4))
+    mpd_cmd_queue = g_list_prepend(mpd_cmd_queue,
+        g_strdup("binarylimit 1048576"));
+  if(mpd_cmd_current == mpd_cmd_currentsong && mpd_cover_stale)
+  {
+    mpd_cover_stale = FALSE;
+    mpd_cover_lookup();
+  }
+
   if(mpd_cmd_current == mpd_cmd_playlistinfo)
     trigger_emit("mpd-playlistinfo");
   else if(mpd_cmd_current == mpd_cmd_search || mpd_cmd_current == mpd_cmd_find)
@@ -157,8 +557,9 @@ static gboolean mpd_ok_handle ( gchar *str )
     mpd_emit_with_array("mpd-list", &mpd_db_list);
   else if(mpd_cmd_current == mpd_cmd_listplaylists)
     mpd_emit_with_array("mpd-list", &mpd_playlist_list);
-  else if(mpd_cmd_current == mpd_cmd_readpicture && !mpd_cover_received)
-    mpd_cmd_cover(0, mpd_cmd_albumart);
+  else if(mpd_cmd_current == mpd_cmd_readpicture ||
+      mpd_cmd_current == mpd_cmd_albumart)
+    mpd_cover_next();
   else
     trigger_emit("mpd");
   mpd_cmd_current = NULL;
@@ -185,13 +586,13 @@ static gboolean mpd_ok_handle ( gchar *str )
     g_list_free_full(g_steal_pointer(&mpd_playlist_list), g_free);
   if(mpd_cmd_current == mpd_cmd_playlistinfo)
     g_list_free_full(g_steal_pointer(&mpd_queue),
-        (GDestroyNotify)g_hash_table_destroy);
+        (GDestroyNotify)g_hash_table_unref);
   if(mpd_cmd_current == mpd_cmd_listplaylistinfo)
     g_list_free_full(g_steal_pointer(&mpd_playlist),
-        (GDestroyNotify)g_hash_table_destroy);
+        (GDestroyNotify)g_hash_table_unref);
   if(mpd_cmd_current == mpd_cmd_search || mpd_cmd_current == mpd_cmd_find)
     g_list_free_full(g_steal_pointer(&mpd_search_list),
-        (GDestroyNotify)g_hash_table_destroy);
+        (GDestroyNotify)g_hash_table_unref);
 
   return TRUE;
 }
@@ -216,53 +617,46 @@ static gboolean mpd_tag_handle ( gchar *str, GHashTable *hash )
 
   g_hash_table_insert(hash, g_strdup(str), g_strdup(g_strstrip(ptr+1)));
   if(hash == mpd_song_current && !g_ascii_strcasecmp(str, "file"))
-    mpd_cmd_cover(0, mpd_cmd_readpicture);
+    mpd_cover_stale = TRUE;
 
   return TRUE;
 }
 
 static gboolean mpd_cover_handle ( gchar *str )
 {
-  GdkPixbuf *pixbuf;
-  GIOStatus status;
-  gsize newtotal, chunk;
+  gsize newtotal;
 
   if(!g_ascii_strncasecmp(str, "size:", 5))
   {
     newtotal = g_ascii_strtoull(g_strstrip(str+5), NULL, 10);
     if(mpd_cover_total && mpd_cover_total!=newtotal)
-      mpd_cmd_cover(0, mpd_art_cmd);
-    else
-      mpd_cover_total = newtotal;
+      mpd_cover_loader_drop();
+    mpd_cover_total = newtotal;
   }
   else if(!g_ascii_strncasecmp(str, "binary:", 7))
+    mpd_cover_chunk = g_ascii_strtoull(g_strstrip(str+7), NULL, 10);
+
+  return TRUE;
+}
+
+/* read the binary part of a response as it arrives, returns FALSE if more
+ * data is needed */
+static gboolean mpd_cover_read ( GIOChannel *chan )
+{
+  gchar buf[16384];
+  GIOStatus status;
+  gsize len;
+
+  while(mpd_cover_chunk)
   {
-    chunk = g_ascii_strtoull(g_strstrip(str+7), NULL, 10);
-    if(mpd_cover_bufsize < chunk)
-      mpd_cover_buf = g_realloc(mpd_cover_buf, (mpd_cover_bufsize = chunk) );
-    status = g_io_channel_read_chars(chan, mpd_cover_buf, chunk, NULL, NULL);
-    if(status==G_IO_STATUS_NORMAL)
-    {
-      mpd_cover_received += chunk;
-      gdk_pixbuf_loader_write(mpd_cover_loader, mpd_cover_buf, chunk, NULL);
-      if(mpd_cover_received>=mpd_cover_total)
-      {
-        scale_image_cache_remove(mpd_cover);
-        g_clear_pointer(&mpd_cover, g_free);
-        if(gdk_pixbuf_loader_close(mpd_cover_loader, NULL) &&
-            (pixbuf = gdk_pixbuf_loader_get_pixbuf(mpd_cover_loader)) )
-        {
-          str_assign(&mpd_cover, g_strdup_printf("<pixbufcache/>mpdart-%ld",
-                mpd_pb_counter++));
-          scale_image_cache_insert(mpd_cover, gdk_pixbuf_copy(pixbuf));
-        }
-        if(mpd_cover_loader)
-          g_clear_pointer(&mpd_cover_loader, g_object_unref);
-        trigger_emit("mpd-cover");
-      }
-      else
-        mpd_cmd_cover(mpd_cover_received, mpd_art_cmd);
-    }
+    status = g_io_channel_read_chars(chan, buf, MIN(sizeof(buf),
+          mpd_cover_chunk), &len, NULL);
+    if(len && mpd_cover_loader)
+      gdk_pixbuf_loader_write(mpd_cover_loader, (guchar *)buf, len, NULL);
+    mpd_cover_chunk -= len;
+    mpd_cover_received += len;
+    if(status != G_IO_STATUS_NORMAL)
+      return FALSE;
   }
 
   return TRUE;
@@ -287,7 +681,8 @@ static gboolean mpd_event ( GIOChannel *chan, GIOCondition cond, void *d )
   }
   if( !(cond & G_IO_IN) && !(cond & G_IO_PRI) )
     return G_SOURCE_CONTINUE;
-  while(g_io_channel_read_line(chan, &str, NULL, NULL, NULL)==
+  while(mpd_cover_read(chan) &&
+      g_io_channel_read_line(chan, &str, NULL, NULL, NULL)==
       G_IO_STATUS_NORMAL && str)
   {
     if(mpd_cmd_current == mpd_cmd_idle)
@@ -349,6 +744,7 @@ static void mpd_connect_cb ( GSocketClient *client, GAsyncResult *res,
     g_io_channel_set_flags(chan, G_IO_FLAG_NONBLOCK, NULL);
     g_io_channel_set_close_on_unref(chan, TRUE);
     g_io_channel_set_encoding(chan, NULL, NULL);
+    mpd_cover_chunk = 0;
     mpd_cmd_append("status");
     mpd_cmd_append("currentsong");
     mpd_cmd_current = mpd_cmd_init;
@@ -411,55 +807,77 @@ static void mpd_address_new ( const gchar *host, guint16 port )
   address_list = g_list_prepend(address_list, conn);
 }
 
+/* MpdList and MpdInfo read published state only, so they can run on any
+ * thread */
 static value_t mpd_func_list ( vm_t *vm, value_t p[], gint np )
 {
+  mpd_snapshot_t *snap;
   value_t result, row;
-  GList *list, *iter;
+  GPtrArray *list;
+  guint j;
   gint i;
 
   if(np<2)
     return value_na;
 
   vm_param_check_string(vm, p, 0, "MpdList");
+  if( !(snap = module_snapshot_acquire(&mpd_snapshot)) )
+    return value_na;
+
   if(!g_ascii_strcasecmp(value_get_string(p[0]), "queue"))
-    list = mpd_queue;
+    list = snap->queue;
   else if(!g_ascii_strcasecmp(value_get_string(p[0]), "listplaylistinfo"))
-    list = mpd_playlist;
+    list = snap->playlist;
   else if(!g_ascii_strcasecmp(value_get_string(p[0]), "search"))
-    list = mpd_search_list;
+    list = snap->search;
   else
+    list = NULL;
+
+  if(!list)
+  {
+    module_snapshot_release(&mpd_snapshot, snap);
     return value_na;
+  }
 
-  result = value_array_create(g_list_length(list));
-  for(iter=list; iter; iter=g_list_next(iter))
+  result = value_array_create(list->len);
+  for(j=0; j<list->len; j++)
   {
     row = value_array_create(np-1);
     for(i=1; i<np; i++)
-      value_array_append(row, value_new_string(g_strdup(
-              g_hash_table_lookup(iter->data, value_get_string(p[i])))));
+      value_array_append(row, value_new_string(g_strdup(g_hash_table_lookup(
+                g_ptr_array_index(list, j), value_get_string(p[i])))));
     value_array_append(result, row);
   }
+  module_snapshot_release(&mpd_snapshot, snap);
 
   return result;
 }
 
 static value_t mpd_func_info ( vm_t *vm, value_t p[], gint np )
 {
+  mpd_snapshot_t *snap;
+  value_t result;
   gchar *val;
 
   vm_param_check_np(vm, np, 1, "MpdInfo");
   vm_param_check_string(vm, p, 0, "MpdInfo");
 
-  if(!g_ascii_strcasecmp(value_get_string(p[0]), "age"))
-    return value_new_string(g_strdup_printf("%ld", g_get_monotonic_time() - mpd_time));
-  if(!g_ascii_strcasecmp(value_get_string(p[0]), "cover"))
-    return value_new_string(g_strdup(mpd_cover));
+  if( !(snap = module_snapshot_acquire(&mpd_snapshot)) )
+    return value_na;
 
-  if((val = g_hash_table_lookup(mpd_state, value_get_string(p[0]))) ||
-      (val = g_hash_table_lookup(mpd_song_current, value_get_string(p[0]))))
-      return value_new_string(g_strdup(val));
+  if(!g_ascii_strcasecmp(value_get_string(p[0]), "age"))
+    result = value_new_string(g_strdup_printf("%ld",
+          g_get_monotonic_time() - snap->time));
+  else if(!g_ascii_strcasecmp(value_get_string(p[0]), "cover"))
+    result = value_new_string(g_strdup(snap->cover));
+  else if((val = g_hash_table_lookup(snap->state, value_get_string(p[0]))) ||
+      (val = g_hash_table_lookup(snap->song, value_get_string(p[0]))))
+    result = value_new_string(g_strdup(val));
+  else
+    result = value_na;
+  module_snapshot_release(&mpd_snapshot, snap);
 
-  return value_na;
+  return result;
 }
 
 static value_t mpd_func_server ( vm_t *vm, value_t p[], gint np )
@@ -507,8 +925,8 @@ gboolean sfwbar_module_init ( void )
   mpd_song_current = g_hash_table_new_full((GHashFunc)str_nhash,
       (GEqualFunc)str_nequal, g_free, g_free);
 
-  vm_func_add("mpdlist", mpd_func_list, FALSE, FALSE);
-  vm_func_add("mpdinfo", mpd_func_info, FALSE, FALSE);
+  vm_func_add("mpdlist", mpd_func_list, FALSE, TRUE);
+  vm_func_add("mpdinfo", mpd_func_info, FALSE, TRUE);
   vm_func_add("mpdserver", mpd_func_server, TRUE, FALSE);
   vm_func_add("mpdcmd", mpd_func_cmd, TRUE, FALSE);
 
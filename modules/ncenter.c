@@ -23,21 +23,33 @@ typedef struct _dn_notification {
   gchar *category, *desktop, *image, *sound_file, *sound_name;
   gint32 x, y;
   gchar urgency;
-  /* need image data */
+  gsize image_size;
   guint timeout_handle;
 } dn_notification;
 
+typedef struct _dn_image {
+  gsize size;
+  gint count;
+} dn_image;
+
 #define DN_NOTIFICATION(x) ((dn_notification *)(x))
 
+/* image-data is stored scaled to at most DN_IMAGE_SIZE pixels and the
+ * distinct images held by the notification history are capped at
+ * DN_IMAGE_BUDGET bytes */
+#define DN_IMAGE_SIZE 128
+#define DN_IMAGE_BUDGET (8*1024*1024)
+
 gint64 sfwbar_module_signature = 0x73f4d956a1;
 guint16 sfwbar_module_version = MODULE_API_VERSION;
 module_thread_t sfwbar_module_thread = MODULE_THREAD_MODULE;
 
 static GDBusConnection *dn_con;
 static guint32 dn_id_counter = 1;
-static guint dn_pixbuf_counter;
 
 static GList *notif_list;
+static GHashTable *dn_images;
+static gsize dn_image_bytes;
 static gchar *expanded_group;
 static gint32 default_timeout = 0;
 
@@ -88,6 +100,56 @@ static const gchar dn_iface_xml[] =
   " </interface>"
   "</node>";
 
+static void dn_image_hold ( const gchar *name, gsize size )
+{
+  dn_image *image;
+
+  if(!dn_images)
+    dn_images = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+        g_free);
+
+  if( !(image = g_hash_table_lookup(dn_images, name)) )
+  {
+    image = g_malloc0(sizeof(dn_image));
+    image->size = size;
+    dn_image_bytes += size;
+    g_hash_table_insert(dn_images, g_strdup(name), image);
+  }
+  image->count++;
+}
+
+static void dn_image_release ( dn_notification *notif )
+{
+  dn_image *image;
+
+  if(notif->image_size && dn_images &&
+      (image = g_hash_table_lookup(dn_images, notif->image)) &&
+      !--image->count)
+  {
+    dn_image_bytes -= image->size;
+    g_hash_table_remove(dn_images, notif->image);
+  }
+  scale_image_cache_unref(notif->image);
+  g_clear_pointer(&notif->image, g_free);
+  notif->image_size = 0;
+}
+
+/* drop images from the oldest notifications until the history fits the
+ * budget, these fall back to the app icon */
+static void dn_image_trim ( dn_notification *keep )
+{
+  GList *iter;
+
+  for(iter=notif_list; iter && dn_image_bytes > DN_IMAGE_BUDGET;
+      iter=g_list_next(iter))
+    if(iter->data != keep && DN_NOTIFICATION(iter->data)->image_size)
+    {
+      g_debug("ncenter: image budget exceeded, dropping image of %u",
+          DN_NOTIFICATION(iter->data)->id);
+      dn_image_release(iter->data);
+    }
+}
+
 static void dn_notification_free ( dn_notification *notif )
 {
   if(notif->timeout_handle)
@@ -100,8 +162,7 @@ static void dn_notification_free ( dn_notification *notif )
   g_free(notif->body);
   g_free(notif->category);
   g_free(notif->desktop);
-  scale_image_cache_remove(notif->image);
-  g_free(notif->image);
+  dn_image_release(notif);
   g_free(notif->sound_file);
   g_free(notif->sound_name);
   g_free(notif);
@@ -167,36 +228,43 @@ static void dn_notification_collapse ( void )
   trigger_emit("notification-group");
 }
 
-static gchar *dn_parse_image_data ( GVariant *dict )
+static gchar *dn_parse_image_data ( GVariant *dict, gsize *size )
 {
-  GdkPixbuf *pixbuf;
+  GdkPixbuf *src, *pixbuf;
   GVariant *vdata;
   gint32 w, h, row_stride, bps, channels;
   gboolean alpha;
   gsize len;
-  gchar *name;
   const void *data;
-  void *copy;
 
   if(!g_variant_lookup(dict, "image-data", "(iiibii@ay)", &w, &h, &row_stride,
         &alpha, &bps, &channels, &vdata))
     return NULL;
 
   data = g_variant_get_fixed_array(vdata, &len, sizeof(guchar));
-  if(len != h*row_stride)
-    return NULL;
-  copy = g_memdup2(data, len);
-
-  if( !(pixbuf = gdk_pixbuf_new_from_data(copy, GDK_COLORSPACE_RGB, alpha,
-          bps, w, h, row_stride, (GdkPixbufDestroyNotify)g_free, NULL)) )
+  if(w<1 || h<1 || len != h*row_stride || !(src = gdk_pixbuf_new_from_data(
+          data, GDK_COLORSPACE_RGB, alpha, bps, w, h, row_stride, NULL, NULL)))
   {
-    g_free(copy);
+    g_variant_unref(vdata);
     return NULL;
   }
 
-  name = g_strdup_printf("<pixbufcache/>ncenter-%d", dn_pixbuf_counter++);
-  scale_image_cache_insert(name, pixbuf);
-  return name;
+  /* the pixbuf wraps the variant payload, scale or copy it out before
+   * releasing the variant */
+  if(w > DN_IMAGE_SIZE || h > DN_IMAGE_SIZE)
+    pixbuf = gdk_pixbuf_scale_simple(src,
+        w>h? DN_IMAGE_SIZE : MAX(1, w*DN_IMAGE_SIZE/h),
+        w>h? MAX(1, h*DN_IMAGE_SIZE/w) : DN_IMAGE_SIZE, GDK_INTERP_BILINEAR);
+  else
+    pixbuf = gdk_pixbuf_copy(src);
+  g_object_unref(src);
+  g_variant_unref(vdata);
+
+  if(!pixbuf)
+    return NULL;
+  *size = gdk_pixbuf_get_byte_length(pixbuf);
+
+  return scale_image_cache_insert(pixbuf);
 }
 
 static void dn_notification_action ( guint32 id, gchar *action )
@@ -256,8 +324,13 @@ guint32 dn_notification_parse ( GVariant *params )
   (void)g_variant_lookup(hints, "category", "s", &notif->category);
   g_clear_pointer(&notif->desktop, g_free);
   (void)g_variant_lookup(hints, "desktop-entry", "s", &notif->desktop);
-  g_clear_pointer(&notif->image, g_free);
-  if( !(notif->image = dn_parse_image_data(hints)) )
+  dn_image_release(notif);
+  if( (notif->image = dn_parse_image_data(hints, &notif->image_size)) )
+  {
+    dn_image_hold(notif->image, notif->image_size);
+    dn_image_trim(notif);
+  }
+  else
     (void)g_variant_lookup(hints, "image-path", "s", &notif->image);
   g_clear_pointer(&notif->sound_file, g_free);
   (void)g_variant_lookup(hints, "sound-file", "s", &notif->sound_file);
@@ -20,15 +20,28 @@
 
 typedef struct _iface_info {
   gchar *name;
+  gint32 index;
   gboolean invalid;
   struct in_addr ip, mask, bcast, gateway;
   struct in6_addr ip6, mask6, bcast6, gateway6;
-  guint32 rx_packets, tx_packets, rx_bytes, tx_bytes;
-  guint32 prx_packets, ptx_packets, prx_bytes, ptx_bytes;
+  guint64 rx_packets, tx_packets, rx_bytes, tx_bytes;
+  guint64 prx_packets, ptx_packets, prx_bytes, ptx_bytes;
   gint64 last_time, time_diff;
   gchar *essid;
 } iface_info;
 
+typedef struct _net_snapshot_iface {
+  gchar *name, *essid;
+  struct in_addr ip, mask, gateway;
+  struct in6_addr ip6, mask6, gateway6;
+} net_snapshot_iface_t;
+
+typedef struct _net_snapshot {
+  gint count;
+  gint route;
+  net_snapshot_iface_t ifaces[];
+} net_snapshot_t;
+
 iface_info *route;
 
 gint64 sfwbar_module_signature = 0x73f4d956a1;
@@ -41,6 +54,53 @@ gint qual, level, noise;
 guint net_timeout;
 
 static void net_update_essid ( gchar * );
+static void net_snapshot_clear ( net_snapshot_t *snap );
+
+static module_snapshot_t net_state = {
+  .clear = (GDestroyNotify)net_snapshot_clear
+};
+
+static void net_snapshot_clear ( net_snapshot_t *snap )
+{
+  gint i;
+
+  for(i=0; i<snap->count; i++)
+  {
+    g_free(snap->ifaces[i].name);
+    g_free(snap->ifaces[i].essid);
+  }
+}
+
+/* publish interface state for netinfo and notify */
+static void net_emit ( void )
+{
+  net_snapshot_t *snap;
+  iface_info *iface;
+  GList *iter;
+  gint i;
+
+  snap = module_snapshot_alloc(sizeof(net_snapshot_t) +
+      g_list_length(iface_list) * sizeof(net_snapshot_iface_t));
+  snap->route = -1;
+  for(iter=iface_list, i=0; iter; iter=g_list_next(iter), i++)
+  {
+    iface = iter->data;
+    snap->ifaces[i].name = g_strdup(iface->name);
+    snap->ifaces[i].essid = g_strdup(iface->essid);
+    snap->ifaces[i].ip = iface->ip;
+    snap->ifaces[i].mask = iface->mask;
+    snap->ifaces[i].gateway = iface->gateway;
+    snap->ifaces[i].ip6 = iface->ip6;
+    snap->ifaces[i].mask6 = iface->mask6;
+    snap->ifaces[i].gateway6 = iface->gateway6;
+    if(iface == route)
+      snap->route = i;
+  }
+  snap->count = i;
+  module_snapshot_publish(&net_state, snap);
+
+  trigger_emit("network");
+}
 
 static iface_info *net_iface_get ( gchar *name, gboolean create )
 {
@@ -60,6 +120,17 @@ static iface_info *net_iface_get ( gchar *name, gboolean create )
   return iface;
 }
 
+static iface_info *net_iface_get_by_index ( gint32 iidx )
+{
+  GList *iter;
+
+  for(iter=iface_list; iter; iter=g_list_next(iter))
+    if(IFACE_INFO(iter->data)->index == iidx)
+      return iter->data;
+
+  return NULL;
+}
+
 static void iface_free ( iface_info *iface )
 {
   iface_list = g_list_remove(iface_list, iface);
@@ -108,7 +179,7 @@ static void net_iface_unref ( gint32 iidx )
   iface_free(iface);
   if(route == iface)
     route = iface_list?iface_list->data:NULL;
-  trigger_emit("network");
+  net_emit();
 }
 
 static void net_iface_update ( gint32 iidx, struct in_addr gate,
@@ -121,12 +192,31 @@ static void net_iface_update ( gint32 iidx, struct in_addr gate,
     return;
 
   iface = net_iface_get(if_indextoname(iidx, ifname), TRUE);
+  iface->index = iidx;
   iface->gateway = gate;
   iface->gateway6 = gate6;
   net_update_essid(ifname);
   net_update_ifaddrs();
   route = iface;
-  trigger_emit("network");
+  net_emit();
+}
+
+static void net_traffic_set ( iface_info *iface, guint64 rx_packets,
+    guint64 tx_packets, guint64 rx_bytes, guint64 tx_bytes, gint64 ctime )
+{
+  iface->prx_packets = iface->rx_packets;
+  iface->ptx_packets = iface->tx_packets;
+  iface->prx_bytes = iface->rx_bytes;
+  iface->ptx_bytes = iface->tx_bytes;
+
+  iface->rx_packets = rx_packets;
+  iface->tx_packets = tx_packets;
+  iface->rx_bytes = rx_bytes;
+  iface->tx_bytes = tx_bytes;
+
+  iface->time_diff = ctime - iface->last_time;
+  iface->last_time = ctime;
+  iface->invalid = FALSE;
 }
 
 #if defined(__linux__)
@@ -134,41 +224,114 @@ static void net_iface_update ( gint32 iidx, struct in_addr gate,
 #include <linux/rtnetlink.h>
 #include <linux/wireless.h>
 
-static void net_update_traffic ( gchar *interface )
+static gint stats_sock = -1;
+static guint32 stats_seq;
+static gint64 stats_sent;
+static gboolean stats_pending;
+
+static gboolean net_stats_parse ( struct nlmsghdr *hdr, gint64 ctime )
 {
+  struct if_stats_msg *ifsm;
+  struct rtnl_link_stats64 stats;
+  struct rtattr *rta;
+  iface_info *iface;
+  gint rtl;
+
+  if(hdr->nlmsg_type == NLMSG_DONE || hdr->nlmsg_type == NLMSG_ERROR)
+    return FALSE;
+  if(hdr->nlmsg_type != RTM_NEWSTATS)
+    return TRUE;
+
+  ifsm = NLMSG_DATA(hdr);
+  if( !(iface = net_iface_get_by_index(ifsm->ifindex)) || !iface->invalid )
+    return TRUE;
+
+  rta = (struct rtattr *)((gchar *)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+  rtl = hdr->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm));
+  for(;RTA_OK(rta, rtl); rta=RTA_NEXT(rta, rtl))
+    if(rta->rta_type==IFLA_STATS_LINK_64 && RTA_PAYLOAD(rta)>=sizeof(stats))
+    {
+      memcpy(&stats, RTA_DATA(rta), sizeof(stats));
+      net_traffic_set(iface, stats.rx_packets, stats.tx_packets,
+          stats.rx_bytes, stats.tx_bytes, ctime);
+    }
+
+  return TRUE;
+}
+
+static void net_stats_drain ( void )
+{
+  struct nlmsghdr *hdr;
+  gchar buf[8192];
+  gssize len;
   gint64 ctime;
-  struct ifaddrs *addrs, *iter;
-  struct rtnl_link_stats *stats;
+
+  ctime = g_get_monotonic_time();
+  while(stats_pending &&
+      (len = recv(stats_sock, buf, sizeof(buf), MSG_DONTWAIT))>0)
+    for(hdr=(struct nlmsghdr *)buf; stats_pending && NLMSG_OK(hdr, len);
+        hdr=NLMSG_NEXT(hdr, len))
+      if(hdr->nlmsg_seq == stats_seq)
+        stats_pending = net_stats_parse(hdr, ctime);
+}
+
+static gboolean net_stats_event ( GIOChannel *chan, GIOCondition cond,
+    gpointer d )
+{
+  net_stats_drain();
+  return TRUE;
+}
+
+/* fetch 64 bit counters of all interfaces in a single dump and update all
+ * interfaces invalidated since the last refresh. The socket never blocks,
+ * the kernel normally queues the whole dump as it is read and any remainder
+ * is picked up from the channel watch, in which case the caller sees the
+ * previous counters */
+static void net_update_traffic ( gchar *interface )
+{
+  struct {
+    struct nlmsghdr hdr;
+    struct if_stats_msg ifsm;
+  } nlreq;
+  GIOChannel *chan;
   iface_info *iface;
 
   iface = net_iface_get(interface, FALSE);
   if(!iface || !iface->invalid)
     return;
 
-  getifaddrs(&addrs);
-  for(iter=addrs; iter; iter=iter->ifa_next)
+  if(stats_sock<0)
+  {
+    if( (stats_sock = socket(AF_NETLINK,
+            SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE))<0 )
+      return;
+    chan = g_io_channel_unix_new(stats_sock);
+    module_channel_watch_add(chan, G_PRIORITY_DEFAULT, G_IO_IN,
+        net_stats_event, NULL, NULL);
+    g_io_channel_unref(chan);
+  }
+
+  /* a dump that never completed is given up on after a second */
+  if(!stats_pending || g_get_monotonic_time() - stats_sent > G_USEC_PER_SEC)
   {
-    if(!g_strcmp0(interface, iter->ifa_name) &&
-        iter->ifa_addr->sa_family == AF_PACKET)
+    memset(&nlreq, 0, sizeof(nlreq));
+    nlreq.hdr.nlmsg_type = RTM_GETSTATS;
+    nlreq.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    nlreq.hdr.nlmsg_len = sizeof(nlreq);
+    nlreq.hdr.nlmsg_seq = seq++;
+    nlreq.ifsm.family = AF_UNSPEC;
+    nlreq.ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+    if(send(stats_sock, &nlreq, sizeof(nlreq), 0)==-1)
     {
-      iface->prx_packets = iface->rx_packets;
-      iface->ptx_packets = iface->tx_packets;
-      iface->prx_bytes = iface->rx_bytes;
-      iface->ptx_bytes = iface->tx_bytes;
-
-      stats = ((struct rtnl_link_stats *)(iter->ifa_data));
-      iface->rx_packets = stats->rx_packets;
-      iface->tx_packets = stats->tx_packets;
-      iface->rx_bytes = stats->rx_bytes;
-      iface->tx_bytes = stats->tx_bytes;
-
-      ctime = g_get_monotonic_time();
-      iface->time_diff = ctime - iface->last_time;
-      iface->last_time = ctime;
-      iface->invalid = FALSE;
+      g_debug("network: failed to send a netlink stats request");
+      return;
     }
+    stats_seq = nlreq.hdr.nlmsg_seq;
+    stats_sent = g_get_monotonic_time();
+    stats_pending = TRUE;
   }
-  freeifaddrs(addrs);
+
+  net_stats_drain();
 }
 
 static void net_update_essid ( gchar *interface )
@@ -198,7 +361,7 @@ static void net_update_essid ( gchar *interface )
     g_free(iface->essid);
     iface->essid = g_strdup(lessid);
     if(diff)
-      trigger_emit("network");
+      net_emit();
   }
   if(sock >= 0)
     close(sock);
@@ -365,7 +528,7 @@ static gboolean net_rt_parse (GIOChannel *chan, GIOCondition cond, gpointer d)
   {
     g_debug("network: set interface: <none>");
     route = NULL;
-    trigger_emit("network");
+    net_emit();
   }
   return TRUE;
 }
@@ -375,10 +538,12 @@ static gboolean net_rt_parse (GIOChannel *chan, GIOCondition cond, gpointer d)
 #include <net/if_dl.h>
 #include <net/route.h>
 
+/* update all interfaces invalidated since the last refresh in one pass */
 static void net_update_traffic ( gchar *interface )
 {
   gint64 ctime;
   struct ifaddrs *addrs, *iter;
+  struct if_data *data;
   iface_info *iface;
 
   iface = net_iface_get(interface, FALSE);
@@ -386,27 +551,15 @@ static void net_update_traffic ( gchar *interface )
     return;
 
   getifaddrs(&addrs);
+  ctime = g_get_monotonic_time();
   for(iter=addrs; iter; iter=iter->ifa_next)
-  {
-    if(!g_strcmp0(interface, iter->ifa_name) && iter->ifa_addr &&
-        iter->ifa_addr->sa_family==AF_LINK)
+    if(iter->ifa_addr && iter->ifa_addr->sa_family==AF_LINK &&
+        (iface = net_iface_get(iter->ifa_name, FALSE)) && iface->invalid)
     {
-      iface->prx_packets = iface->rx_packets;
-      iface->ptx_packets = iface->tx_packets;
-      iface->prx_bytes = iface->rx_bytes;
-      iface->ptx_bytes = iface->tx_bytes;
-
-      iface->rx_packets = ((struct if_data *)(iter->ifa_data))->ifi_ipackets;
-      iface->tx_packets = ((struct if_data *)(iter->ifa_data))->ifi_opackets;
-      iface->rx_bytes = ((struct if_data *)(iter->ifa_data))->ifi_ibytes;
-      iface->tx_bytes = ((struct if_data *)(iter->ifa_data))->ifi_obytes;
-
-      ctime = g_get_monotonic_time();
-      iface->time_diff = ctime - iface->last_time;
-      iface->last_time = ctime;
-      iface->invalid = FALSE;
+      data = iter->ifa_data;
+      net_traffic_set(iface, data->ifi_ipackets, data->ifi_opackets,
+          data->ifi_ibytes, data->ifi_obytes, ctime);
     }
-  }
   freeifaddrs(addrs);
 }
 
@@ -566,7 +719,7 @@ static void net_rt_request ( gint sock )
   if(send(sock, &rtmsg, rtmsg.hdr.rtm_msglen, 0) >= 0)
   {
     route = NULL;
-    trigger_emit("network");
+    net_emit();
   }
 }
 
@@ -617,7 +770,7 @@ static gboolean net_rt_parse (GIOChannel *chan, GIOCondition cond, gpointer d)
 
 #else /* unknown platform, provide shims */
 
-static void net_update_traffic ( void )
+static void net_update_traffic ( gchar *interface )
 {
 }
 
@@ -647,13 +800,23 @@ static gboolean net_rt_request ( gint sock )
 
 #endif /* Linux || FreeBSD || OpenBSD */
 
+enum net_stat_query_t {
+  NET_STAT_SIGNAL,
+  NET_STAT_RXRATE,
+  NET_STAT_TXRATE,
+};
+
+static const gchar *netstat_keys[] = { "signal", "rxrate", "txrate", NULL };
+
 static value_t network_func_netstat ( vm_t *vm, value_t p[], gint np )
 {
   iface_info *iface;
   gdouble result = 0;
+  gint sel;
 
-  if(np>2 || !value_is_string(p[0]))
+  if(np<1 || np>2 || (!value_is_string(p[0]) && !value_is_selector(p[0])))
     return value_na;
+  sel = vm_param_selector(p[0], netstat_keys);
 
   if(np==2 && value_is_string(p[1]))
     iface = net_iface_get(p[1].value.string, FALSE);
@@ -662,15 +825,15 @@ static value_t network_func_netstat ( vm_t *vm, value_t p[], gint np )
   if(!iface)
     return value_na;
 
-  if(!g_ascii_strcasecmp(p[0].value.string, "signal"))
+  if(sel == NET_STAT_SIGNAL)
     result = net_get_signal(route?route->name:NULL);
-  else if(!g_ascii_strcasecmp(p[0].value.string, "rxrate"))
+  else if(sel == NET_STAT_RXRATE)
   {
     net_update_traffic(iface->name);
     result = (gdouble)(iface->rx_bytes-iface->prx_bytes)*
         1000000/iface->time_diff;
   }
-  else if(!g_ascii_strcasecmp(p[0].value.string, "txrate"))
+  else if(sel == NET_STAT_TXRATE)
   {
     net_update_traffic(iface->name);
     result = (gdouble)(iface->tx_bytes-iface->ptx_bytes)*
@@ -698,41 +861,83 @@ static gchar *net_getaddr ( void *ina, gint type  )
   return g_strdup(inet_ntop(type, ina, addr, INET_ADDRSTRLEN));
 }
 
+enum net_info_query_t {
+  NET_INFO_IP,
+  NET_INFO_MASK,
+  NET_INFO_CIDR,
+  NET_INFO_IP6,
+  NET_INFO_MASK6,
+  NET_INFO_GATEWAY,
+  NET_INFO_GATEWAY6,
+  NET_INFO_ESSID,
+  NET_INFO_INTERFACE,
+};
+
+static const gchar *netinfo_keys[] = { "ip", "mask", "cidr", "ip6", "mask6",
+  "gateway", "gateway6", "essid", "interface", NULL };
+
+/* reads published state only, so it can run on any thread */
 static value_t network_func_netinfo ( vm_t *vm, value_t p[], gint np )
 {
+  net_snapshot_t *snap;
+  net_snapshot_iface_t *iface = NULL;
   gchar *result;
-  iface_info *iface;
+  gint i, sel;
 
-  if(np<1 || np>2 || !value_is_string(p[0]))
+  if(np<1 || np>2)
+    return value_na;
+  if( (sel = vm_param_selector(p[0], netinfo_keys))<0 )
+    return value_is_string(p[0])?
+      value_new_string(g_strdup("invalid query")) : value_na;
+
+  if( !(snap = module_snapshot_acquire(&net_state)) )
     return value_na;
 
   if(np==2 && value_is_string(p[1]))
-    iface = net_iface_get(p[1].value.string, FALSE);
-  else
-    iface = route;
+  {
+    for(i=0; i<snap->count; i++)
+      if(!g_strcmp0(snap->ifaces[i].name, p[1].value.string))
+        iface = &snap->ifaces[i];
+  }
+  else if(snap->route>=0)
+    iface = &snap->ifaces[snap->route];
   if(!iface)
+  {
+    module_snapshot_release(&net_state, snap);
     return value_na;
+  }
 
-  if(!g_ascii_strcasecmp(p[0].value.string, "ip"))
-    result = net_getaddr(&iface->ip, AF_INET);
-  else if(!g_ascii_strcasecmp(p[0].value.string, "mask"))
-    result = net_getaddr(&iface->mask, AF_INET);
-  else if(!g_ascii_strcasecmp(p[0].value.string, "cidr"))
-    result = net_get_cidr(iface->mask.s_addr);
-  else if(!g_ascii_strcasecmp(p[0].value.string, "ip6"))
-    result = net_getaddr(&iface->ip6, AF_INET6);
-  else if(!g_ascii_strcasecmp(p[0].value.string, "mask6"))
-    result = net_getaddr(&iface->mask6, AF_INET6);
-  else if(!g_ascii_strcasecmp(p[0].value.string, "gateway"))
-    result = net_getaddr(&iface->gateway, AF_INET);
-  else if(!g_ascii_strcasecmp(p[0].value.string, "gateway6"))
-    result = net_getaddr(&iface->gateway6, AF_INET6);
-  else if(!g_ascii_strcasecmp(p[0].value.string, "essid"))
-    result = g_strdup(iface->essid?iface->essid:"");
-  else if(!g_ascii_strcasecmp(p[0].value.string, "interface"))
-    result = g_strdup(iface->name);
-  else
-    result = g_strdup("invalid query");
+  switch(sel)
+  {
+    case NET_INFO_IP:
+      result = net_getaddr(&iface->ip, AF_INET);
+      break;
+    case NET_INFO_MASK:
+      result = net_getaddr(&iface->mask, AF_INET);
+      break;
+    case NET_INFO_CIDR:
+      result = net_get_cidr(iface->mask.s_addr);
+      break;
+    case NET_INFO_IP6:
+      result = net_getaddr(&iface->ip6, AF_INET6);
+      break;
+    case NET_INFO_MASK6:
+      result = net_getaddr(&iface->mask6, AF_INET6);
+      break;
+    case NET_INFO_GATEWAY:
+      result = net_getaddr(&iface->gateway, AF_INET);
+      break;
+    case NET_INFO_GATEWAY6:
+      result = net_getaddr(&iface->gateway6, AF_INET6);
+      break;
+    case NET_INFO_ESSID:
+      result = g_strdup(iface->essid?iface->essid:"");
+      break;
+    default:
+      result = g_strdup(iface->name);
+      break;
+  }
+  module_snapshot_release(&net_state, snap);
 
   return value_new_string(result);
 }
@@ -753,7 +958,9 @@ gboolean sfwbar_module_init ( void )
 
   g_debug("network: socket: %d", sock);
   vm_func_add("netstat", network_func_netstat, FALSE, FALSE);
-  vm_func_add("netinfo", network_func_netinfo, FALSE, FALSE);
+  vm_func_add("netinfo", network_func_netinfo, FALSE, TRUE);
+  vm_func_selectors_add("netstat", 0, netstat_keys);
+  vm_func_selectors_add("netinfo", 0, netinfo_keys);
   module_channel_watch_add(chan, G_PRIORITY_DEFAULT,
       G_IO_IN | G_IO_PRI |G_IO_ERR | G_IO_HUP, net_rt_parse, NULL, NULL);
   net_rt_request(sock);
@@ -44,6 +44,10 @@ guint16 sfwbar_module_version = MODULE_API_VERSION;
 module_thread_t sfwbar_module_thread = MODULE_THREAD_MODULE;
 extern ModuleInterfaceV1 sfwbar_interface;
 
+typedef struct _pulse_snapshot {
+  pulse_interface_t iface[3];
+} pulse_snapshot_t;
+
 static pa_context *pctx;
 static pulse_interface_t pulse_interfaces[];
 
@@ -159,6 +163,74 @@ static pulse_info *pulse_addr_parse ( const gchar *addr,
   return info;
 }
 
+static void pulse_info_free ( pulse_info *info )
+{
+  g_free(info->name);
+  g_free(info->icon);
+  g_free(info->form);
+  g_free(info->port);
+  g_free(info->monitor);
+  g_free(info->description);
+  g_free(info);
+}
+
+static pulse_info *pulse_info_dup ( pulse_info *info )
+{
+  pulse_info *copy;
+
+  copy = g_memdup2(info, sizeof(pulse_info));
+  copy->name = g_strdup(info->name);
+  copy->icon = g_strdup(info->icon);
+  copy->form = g_strdup(info->form);
+  copy->port = g_strdup(info->port);
+  copy->monitor = g_strdup(info->monitor);
+  copy->description = g_strdup(info->description);
+
+  return copy;
+}
+
+static void pulse_snapshot_clear ( pulse_snapshot_t *snap )
+{
+  gint i;
+
+  for(i=0; i<3; i++)
+  {
+    g_free(snap->iface[i].default_device);
+    g_free(snap->iface[i].default_control);
+    g_list_free_full(snap->iface[i].list, (GDestroyNotify)pulse_info_free);
+  }
+}
+
+static module_snapshot_t pulse_state = {
+  .clear = (GDestroyNotify)pulse_snapshot_clear
+};
+
+/* publish a copy of device state for the Volume function */
+static void pulse_publish ( void )
+{
+  pulse_snapshot_t *snap;
+  gint i;
+
+  snap = module_snapshot_alloc(sizeof(pulse_snapshot_t));
+  for(i=0; i<3; i++)
+  {
+    snap->iface[i].prefix = pulse_interfaces[i].prefix;
+    snap->iface[i].default_device =
+      g_strdup(pulse_interfaces[i].default_device);
+    snap->iface[i].default_control =
+      g_strdup(pulse_interfaces[i].default_control);
+    snap->iface[i].list = g_list_copy_deep(pulse_interfaces[i].list,
+        (GCopyFunc)pulse_info_dup, NULL);
+  }
+  module_snapshot_publish(&pulse_state, snap);
+}
+
+static void pulse_emit ( void )
+{
+  pulse_publish();
+  trigger_emit("volume");
+}
+
 static void pulse_set_default_control ( pulse_interface_t *iface, const gchar *name,
     gboolean fixed )
 {
@@ -179,7 +251,7 @@ static void pulse_set_default_control ( pulse_interface_t *iface, const gchar *n
   iface->fixed = fixed;
   g_free(iface->default_control);
   iface->default_control = g_strdup(name);
-  trigger_emit("volume");
+  pulse_emit();
 }
 
 static void pulse_set_default_device ( pulse_interface_t *iface,
@@ -224,13 +296,7 @@ static void pulse_remove_device ( pulse_interface_t *iface, guint32 idx )
       if(info->name)
         trigger_emit_with_string("volume-conf-removed", "device_id",
             g_strdup_printf("@pulse-%s-%d", iface->prefix, idx));
-      g_free(info->name);
-      g_free(info->icon);
-      g_free(info->form);
-      g_free(info->port);
-      g_free(info->monitor);
-      g_free(info->description);
-      g_free(info);
+      pulse_info_free(info);
       return;
     }
 }
@@ -307,7 +373,7 @@ static void pulse_sink_cb ( pa_context *ctx, const pa_sink_info *pinfo,
   if(new)
     pulse_device_advertise(0, &pinfo->channel_map, pinfo->index);
 
-  trigger_emit("volume");
+  pulse_emit();
 }
 
 static void pulse_client_cb ( pa_context *ctx, const pa_client_info *cinfo,
@@ -332,7 +398,7 @@ static void pulse_client_cb ( pa_context *ctx, const pa_client_info *cinfo,
   }
 
   if(change)
-    trigger_emit("volume");
+    pulse_emit();
 }
 
 static void pulse_sink_input_cb ( pa_context *ctx,
@@ -359,7 +425,7 @@ static void pulse_sink_input_cb ( pa_context *ctx,
   info->mute = pinfo->mute;
   info->cmap = pinfo->channel_map;
   info->client = pinfo->client;
-  trigger_emit("volume");
+  pulse_emit();
 
   if(new)
     pulse_device_advertise(2, &pinfo->channel_map, pinfo->index);
@@ -394,7 +460,7 @@ static void pulse_source_cb ( pa_context *ctx, const pa_source_info *pinfo,
   info->idx = pinfo->index;
   info->cvol = pinfo->volume;
   info->mute = pinfo->mute;
-  trigger_emit("volume");
+  pulse_emit();
 }
 
 static void pulse_server_cb ( pa_context *ctx, const pa_server_info *info,
@@ -427,6 +493,7 @@ static void pulse_subscribe_cb ( pa_context *ctx,
         pulse_remove_device(&pulse_interfaces[2], idx);
         break;
     }
+    pulse_publish();
   }
   if(!(type & PA_SUBSCRIPTION_EVENT_CHANGE))
     return;
@@ -472,7 +539,7 @@ static void pulse_state_cb ( pa_context *ctx, gpointer data )
     pa_context_disconnect(ctx);
     pa_context_unref(ctx);
     module_interface_deactivate(&sfwbar_interface);
-    trigger_emit("volume");
+    pulse_emit();
   }
   else if(state == PA_CONTEXT_READY)
   {
@@ -566,48 +633,93 @@ static void pulse_client_set_sink ( pulse_info *info, gchar *dest )
         dinfo->idx, NULL, NULL), "pa_context_move_sink_input_by_index");
 }
 
-static value_t pulse_volume_func ( vm_t *vm, value_t p[], gint np )
+enum pulse_query_t {
+  PULSE_COUNT,
+  PULSE_VOLUME,
+  PULSE_MUTE,
+  PULSE_IS_DEFAULT_DEVICE,
+  PULSE_IS_DEFAULT,
+  PULSE_ICON,
+  PULSE_FORM,
+  PULSE_PORT,
+  PULSE_MONITOR,
+  PULSE_DESCRIPTION,
+  PULSE_QUERY_LAST
+};
+
+static const gchar *pulse_query_names[] = { "count", "volume", "mute",
+  "is-default-device", "is-default", "icon", "form", "port", "monitor",
+  "description" };
+
+/* interface prefixed queries, i.e. "sink-volume", built on module init */
+static const gchar *pulse_keys[3*PULSE_QUERY_LAST+1];
+
+static value_t pulse_volume_query ( pulse_interface_t *iface, gint query,
+    const gchar *addr )
 {
   pulse_info *info;
-  pulse_interface_t *iface;
-  gchar *cmd;
   gint cidx;
 
+  if(query == PULSE_COUNT)
+    return value_new_numeric(g_list_length(iface->list));
+
+  if( !(info = pulse_addr_parse(addr, iface, &cidx)) )
+    return value_na;
+
+  switch(query)
+  {
+    case PULSE_VOLUME:
+      return value_new_numeric(
+          100.0*pulse_volume_get(info,cidx)/PA_VOLUME_NORM);
+    case PULSE_MUTE:
+      return value_new_numeric(info->mute);
+    case PULSE_IS_DEFAULT_DEVICE:
+      return value_new_numeric(!g_strcmp0(info->name, iface->default_device));
+    case PULSE_IS_DEFAULT:
+      return value_new_numeric(!g_strcmp0(info->name, iface->default_control));
+    case PULSE_ICON:
+      return value_new_string(g_strdup(info->icon? info->icon : ""));
+    case PULSE_FORM:
+      return value_new_string(g_strdup(info->form? info->form : ""));
+    case PULSE_PORT:
+      return value_new_string(g_strdup(info->port? info->port : ""));
+    case PULSE_MONITOR:
+      return value_new_string(g_strdup(info->monitor? info->monitor : ""));
+    case PULSE_DESCRIPTION:
+      return value_new_string(
+          g_strdup(info->description? info->description:""));
+  }
+
+  return value_na;
+}
+
+/* reads published state only, so it can run on any thread */
+static value_t pulse_volume_func ( vm_t *vm, value_t p[], gint np )
+{
+  pulse_snapshot_t *snap;
+  value_t result;
+  gchar *cmd;
+  gint sel;
+
   vm_param_check_np_range(vm, np, 1, 2, "Volume");
-  vm_param_check_string(vm, p, 0, "Volume");
   if(np==2)
     vm_param_check_string(vm, p, 1, "Volume");
 
-  if( !(iface = pulse_interface_get(value_get_string(p[0]), &cmd)) )
+  if( (sel = vm_param_selector(p[0], pulse_keys))<0 )
+  {
+    if(value_is_string(p[0]) && pulse_interface_get(p[0].value.string, &cmd))
+      return value_new_string(
+          g_strdup_printf("pulse: invalid property: %s", cmd));
     return value_na;
+  }
 
-  if(!g_ascii_strcasecmp(cmd, "count"))
-    return value_new_numeric(g_list_length(iface->list));
-
-  if( !(info = pulse_addr_parse(np==2? value_get_string(p[1]) : NULL, iface,
-          &cidx)) )
+  if( !(snap = module_snapshot_acquire(&pulse_state)) )
     return value_na;
+  result = pulse_volume_query(&snap->iface[sel / PULSE_QUERY_LAST],
+      sel % PULSE_QUERY_LAST, np==2? value_get_string(p[1]) : NULL);
+  module_snapshot_release(&pulse_state, snap);
 
-  if(info && !g_ascii_strcasecmp(cmd, "volume"))
-    return value_new_numeric(100.0*pulse_volume_get(info,cidx)/PA_VOLUME_NORM);
-  if(info && !g_ascii_strcasecmp(cmd, "mute"))
-    return value_new_numeric(info->mute);
-  if(info && !g_ascii_strcasecmp(cmd, "is-default-device"))
-    return value_new_numeric(!g_strcmp0(info->name, iface->default_device));
-  if(info && !g_ascii_strcasecmp(cmd, "is-default"))
-    return value_new_numeric(!g_strcmp0(info->name, iface->default_control));
-  if(!g_ascii_strcasecmp(cmd, "icon"))
-    return value_new_string(g_strdup(info->icon? info->icon : ""));
-  if(!g_ascii_strcasecmp(cmd, "form"))
-    return value_new_string(g_strdup(info->form? info->form : ""));
-  if(!g_ascii_strcasecmp(cmd, "port"))
-    return value_new_string(g_strdup(info->port? info->port : ""));
-  if(!g_ascii_strcasecmp(cmd, "monitor"))
-    return value_new_string(g_strdup(info->monitor? info->monitor : ""));
-  if(!g_ascii_strcasecmp(cmd, "description"))
-    return value_new_string(g_strdup(info->description? info->description:""));
-
-  return value_new_string(g_strdup_printf("pulse: invalid property: %s", cmd));
+  return result;
 }
 
 static value_t pulse_volume_ctl_action ( vm_t *vm, value_t p[], gint np )
@@ -646,15 +758,15 @@ static value_t pulse_volume_ctl_action ( vm_t *vm, value_t p[], gint np )
 static void pulse_activate ( void )
 {
   g_debug("pulse: activating");
-  vm_func_add("volume", pulse_volume_func, FALSE, FALSE);
-  vm_func_add("volumeinfo", pulse_volume_func, FALSE, FALSE);
+  vm_func_add("volume", pulse_volume_func, FALSE, TRUE);
+  vm_func_add("volumeinfo", pulse_volume_func, FALSE, TRUE);
   vm_func_add("volumectl", pulse_volume_ctl_action, TRUE, FALSE);
   pa_context_set_subscribe_callback(pctx, pulse_subscribe_cb, NULL);
   pulse_operation(pa_context_subscribe(pctx, PA_SUBSCRIPTION_MASK_SERVER |
         PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SINK_INPUT |
         PA_SUBSCRIPTION_MASK_SOURCE | PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT,
         NULL, NULL), "pa_context_subscribe");
-  trigger_emit("volume");
+  pulse_emit();
 }
 
 static void pulse_deactivate ( void )
@@ -669,6 +781,7 @@ static void pulse_deactivate ( void )
       pulse_remove_device(&pulse_interfaces[i],
           ((pulse_info *)pulse_interfaces[i].list->data)->idx);
   }
+  module_snapshot_publish(&pulse_state, NULL);
 
   vm_func_remove("volume", pulse_volume_func);
   vm_func_remove("volumeinfo", pulse_volume_func);
@@ -678,6 +791,14 @@ static void pulse_deactivate ( void )
 gboolean sfwbar_module_init ( void )
 {
   pa_glib_mainloop *ploop;
+  gint i, j;
+
+  for(i=0; i<3; i++)
+    for(j=0; j<PULSE_QUERY_LAST; j++)
+      pulse_keys[i*PULSE_QUERY_LAST+j] = g_strconcat(
+          pulse_interfaces[i].prefix, "-", pulse_query_names[j], NULL);
+  vm_func_selectors_add("volume", 0, pulse_keys);
+  vm_func_selectors_add("volumeinfo", 0, pulse_keys);
 
   ploop = pa_glib_mainloop_new(g_main_context_get_thread_default());
   papi = pa_glib_mainloop_get_api(ploop);
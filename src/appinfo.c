@@ -1,15 +1,23 @@
 #include <gio/gio.h>
 #include <glib.h>
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
 #include <sys/stat.h>
 #include "appinfo.h"
+#include "locale1.h"
+#include "util/string.h"
+
+#define APP_INFO_INDEX_VERSION 1
+#define APP_INFO_ENTRY_TYPE "(ssxusssssss)"
+#define APP_INFO_ENTRY_FORMAT "(&s&sxu&s&s&s&s&s&s&s)"
+#define APP_INFO_INDEX_TYPE "(usa" APP_INFO_ENTRY_TYPE ")"
 
 static GHashTable *app_info_wm_class_map;
+static GHashTable *app_info_index;
 static GHashTable *icon_map;
 static GtkIconTheme *app_info_theme;
 static GList *app_info_add, *app_info_delete;
-static GList *app_info_entries;
-static time_t app_info_mtime;
+static gchar *app_info_locale;
 GMutex icon_map_mutex;
 
 void app_icon_map_add ( gchar *appid, gchar *icon )
@@ -53,86 +61,408 @@ GDesktopAppInfo *app_info_from_id ( const gchar *desktop_id )
 }
 void app_info_add_handlers ( AppInfoHandler add, AppInfoHandler del )
 {
-  GList *iter;
+  GHashTableIter hiter;
+  gpointer id;
 
   app_info_add = g_list_append(app_info_add, add);
   app_info_delete = g_list_append(app_info_delete, del);
 
-  if(add)
-    for(iter=app_info_entries; iter; iter=g_list_next(iter))
-      add(iter->data);
+  if(add && app_info_index)
+  {
+    g_hash_table_iter_init(&hiter, app_info_index);
+    while(g_hash_table_iter_next(&hiter, &id, NULL))
+      add(id);
+  }
 }
 
 void app_info_remove_handlers ( AppInfoHandler add, AppInfoHandler del )
 {
-  GList *iter;
+  GHashTableIter hiter;
+  gpointer id;
 
-  if(del)
-    for(iter=app_info_entries; iter; iter=g_list_next(iter))
-      del(iter->data);
+  if(del && app_info_index)
+  {
+    g_hash_table_iter_init(&hiter, app_info_index);
+    while(g_hash_table_iter_next(&hiter, &id, NULL))
+      del(id);
+  }
 
   app_info_add = g_list_remove(app_info_add, add);
   app_info_delete = g_list_remove(app_info_delete, del);
 }
 
-static time_t app_info_mtime_get ( GDesktopAppInfo *app )
+static void app_info_emit ( GList *handlers, const gchar *id )
 {
-  struct stat stattr;
-  const gchar *fname;
+  GList *iter;
 
-  if( (fname = g_desktop_app_info_get_filename(app)) && !stat(fname, &stattr))
-    return stattr.st_mtime;
+  for(iter=handlers; iter; iter=g_list_next(iter))
+    ((AppInfoHandler)(iter->data))(id);
+}
 
-  return 0;
+static const gchar *app_info_str ( const gchar *str )
+{
+  return (str && *str)? str : NULL;
 }
 
-static void app_info_monitor_cb ( GAppInfoMonitor *mon, gpointer d )
+static app_info_entry_t *app_info_entry_new ( GVariant *data )
 {
-  GDesktopAppInfo *app;
-  GList *list, *iter, *handler, *removed, *item;
-  const gchar *class, *id;
+  app_info_entry_t *entry;
+
+  entry = g_malloc0(sizeof(app_info_entry_t));
+  entry->data = g_variant_ref_sink(data);
+  g_variant_get(data, APP_INFO_ENTRY_FORMAT, &entry->id, &entry->path,
+      &entry->mtime, &entry->flags, &entry->wm_class, &entry->categories,
+      &entry->only_show_in, &entry->try_exec, &entry->icon, &entry->label,
+      &entry->comment);
+  entry->wm_class = app_info_str(entry->wm_class);
+  entry->categories = app_info_str(entry->categories);
+  entry->only_show_in = app_info_str(entry->only_show_in);
+  entry->try_exec = app_info_str(entry->try_exec);
+  entry->icon = app_info_str(entry->icon);
+  entry->label = app_info_str(entry->label);
+  entry->comment = app_info_str(entry->comment);
+
+  return entry;
+}
+
+static void app_info_entry_free ( app_info_entry_t *entry )
+{
+  g_variant_unref(entry->data);
+  g_free(entry);
+}
+
+static gchar *app_info_key_get ( GKeyFile *keyfile, const gchar *key,
+    const gchar *locale )
+{
+  return g_key_file_get_locale_string(keyfile, G_KEY_FILE_DESKTOP_GROUP, key,
+      locale, NULL);
+}
+
+static app_info_entry_t *app_info_entry_parse ( const gchar *id,
+    const gchar *path, gint64 mtime )
+{
+  GKeyFile *keyfile;
+  GVariant *data;
+  gchar *str[7], *type, *not_show_in;
+  const gchar *locale;
+  guint32 flags = 0;
+  gint i;
+
+  keyfile = g_key_file_new();
+  if(!g_key_file_load_from_file(keyfile, path, G_KEY_FILE_KEEP_TRANSLATIONS,
+        NULL))
+  {
+    g_key_file_unref(keyfile);
+    return NULL;
+  }
+
+  locale = locale1_get_locale();
+  type = g_key_file_get_string(keyfile, G_KEY_FILE_DESKTOP_GROUP,
+      G_KEY_FILE_DESKTOP_KEY_TYPE, NULL);
+  if(g_strcmp0(type, G_KEY_FILE_DESKTOP_TYPE_APPLICATION))
+    flags |= APP_INFO_NOTAPP;
+  g_free(type);
+  if(g_key_file_get_boolean(keyfile, G_KEY_FILE_DESKTOP_GROUP,
+        G_KEY_FILE_DESKTOP_KEY_HIDDEN, NULL))
+    flags |= APP_INFO_HIDDEN;
+  if(g_key_file_get_boolean(keyfile, G_KEY_FILE_DESKTOP_GROUP,
+        G_KEY_FILE_DESKTOP_KEY_NO_DISPLAY, NULL))
+    flags |= APP_INFO_NODISPLAY;
+  if( (not_show_in = g_key_file_get_string(keyfile, G_KEY_FILE_DESKTOP_GROUP,
+          G_KEY_FILE_DESKTOP_KEY_NOT_SHOW_IN, NULL)) )
+    flags |= APP_INFO_NOTSHOWIN;
+  g_free(not_show_in);
+
+  str[0] = g_key_file_get_string(keyfile, G_KEY_FILE_DESKTOP_GROUP,
+      G_KEY_FILE_DESKTOP_KEY_STARTUP_WM_CLASS, NULL);
+  str[1] = g_key_file_get_string(keyfile, G_KEY_FILE_DESKTOP_GROUP,
+      G_KEY_FILE_DESKTOP_KEY_CATEGORIES, NULL);
+  str[2] = g_key_file_get_string(keyfile, G_KEY_FILE_DESKTOP_GROUP,
+      G_KEY_FILE_DESKTOP_KEY_ONLY_SHOW_IN, NULL);
+  str[3] = g_key_file_get_string(keyfile, G_KEY_FILE_DESKTOP_GROUP,
+      G_KEY_FILE_DESKTOP_KEY_TRY_EXEC, NULL);
+  str[4] = g_key_file_get_string(keyfile, G_KEY_FILE_DESKTOP_GROUP,
+      G_KEY_FILE_DESKTOP_KEY_ICON, NULL);
+  if( !(str[5] = app_info_key_get(keyfile, "X-GNOME-FullName", locale)) )
+    str[5] = app_info_key_get(keyfile, G_KEY_FILE_DESKTOP_KEY_NAME, locale);
+  str[6] = app_info_key_get(keyfile, G_KEY_FILE_DESKTOP_KEY_COMMENT, NULL);
+  g_key_file_unref(keyfile);
+
+  data = g_variant_new(APP_INFO_ENTRY_TYPE, id, path, mtime, flags,
+      str[0]? str[0] : "", str[1]? str[1] : "", str[2]? str[2] : "",
+      str[3]? str[3] : "", str[4]? str[4] : "", str[5]? str[5] : "",
+      str[6]? str[6] : "");
+  for(i=0; i<7; i++)
+    g_free(str[i]);
+
+  return app_info_entry_new(data);
+}
+
+const app_info_entry_t *app_info_entry_lookup ( const gchar *desktop_id )
+{
+  if(!app_info_index || !desktop_id)
+    return NULL;
+
+  return g_hash_table_lookup(app_info_index, desktop_id);
+}
+
+gboolean app_info_entry_visible ( const app_info_entry_t *entry )
+{
+  const gchar *desktops;
+  gchar **list, **current, *exec;
+  gboolean result;
+  gint i, j;
+
+  if(!entry || entry->flags)
+    return FALSE;
+
+  if(entry->try_exec)
+  {
+    if( !(exec = g_find_program_in_path(entry->try_exec)) )
+      return FALSE;
+    g_free(exec);
+  }
+
+  if(!entry->only_show_in)
+    return TRUE;
+
+  if( !(desktops = g_getenv("XDG_CURRENT_DESKTOP")) )
+    return FALSE;
+
+  list = g_strsplit(entry->only_show_in, ";", -1);
+  current = g_strsplit(desktops, ":", -1);
+  result = FALSE;
+  for(i=0; list[i] && !result; i++)
+    for(j=0; current[j] && !result; j++)
+      result = *list[i] && !g_ascii_strcasecmp(list[i], current[j]);
+  g_strfreev(current);
+  g_strfreev(list);
+
+  return result;
+}
+
+static void app_info_index_insert ( app_info_entry_t *entry )
+{
+  g_hash_table_insert(app_info_index, (gpointer)entry->id, entry);
+}
+
+static void app_info_wm_class_update ( void )
+{
+  GHashTableIter hiter;
+  app_info_entry_t *entry;
 
-  removed = g_list_copy(app_info_entries);
-  list = g_app_info_get_all();
   g_hash_table_remove_all(app_info_wm_class_map);
-  for(iter=list; iter; iter=g_list_next(iter))
+  g_hash_table_iter_init(&hiter, app_info_index);
+  while(g_hash_table_iter_next(&hiter, NULL, (gpointer *)&entry))
+    if(entry->wm_class)
+      g_hash_table_insert(app_info_wm_class_map, g_strdup(entry->wm_class),
+          g_strdup(entry->id));
+}
+
+static gchar *app_info_index_path ( void )
+{
+  return g_build_filename(g_get_user_cache_dir(), "sfwbar", "appinfo.idx",
+      NULL);
+}
+
+/* the index is a serialized GVariant, mapped and used in place. Entries
+ * loaded from it reference the mapping through their data variant */
+static void app_info_index_load ( void )
+{
+  GMappedFile *map;
+  GBytes *bytes;
+  GVariant *index, *data;
+  GVariantIter *iter;
+  const gchar *locale;
+  gchar *path;
+  guint32 version;
+
+  path = app_info_index_path();
+  map = g_mapped_file_new(path, FALSE, NULL);
+  g_free(path);
+  if(!map)
+    return;
+
+  bytes = g_mapped_file_get_bytes(map);
+  g_mapped_file_unref(map);
+  index = g_variant_ref_sink(g_variant_new_from_bytes(
+        G_VARIANT_TYPE(APP_INFO_INDEX_TYPE), bytes, FALSE));
+  g_bytes_unref(bytes);
+
+  g_variant_get(index, "(u&sa" APP_INFO_ENTRY_TYPE ")", &version, &locale,
+      &iter);
+  if(version == APP_INFO_INDEX_VERSION)
   {
-    if( (id = g_app_info_get_id(iter->data)) &&
-        (app = g_desktop_app_info_new(id)) )
+    app_info_locale = *locale? g_strdup(locale) : NULL;
+    while( (data = g_variant_iter_next_value(iter)) )
     {
-      if( (class = g_desktop_app_info_get_startup_wm_class(app)) )
-        g_hash_table_insert(app_info_wm_class_map, g_strdup(class),
-            g_strdup(id));
+      app_info_index_insert(app_info_entry_new(data));
+      g_variant_unref(data);
+    }
+  }
+  g_variant_iter_free(iter);
+  g_variant_unref(index);
+  app_info_wm_class_update();
+  g_debug("appinfo: loaded %u entries from index",
+      g_hash_table_size(app_info_index));
+}
 
-      if( (item = g_list_find_custom(removed, id, (GCompareFunc)g_strcmp0)) )
-        removed = g_list_remove(removed, item->data);
-      if(!g_list_find_custom(app_info_entries, id, (GCompareFunc)g_strcmp0))
-      {
-        app_info_entries = g_list_append(app_info_entries, g_strdup(id));
-        for(handler=app_info_add; handler; handler=g_list_next(handler))
-          ((AppInfoHandler)(handler->data))(id);
-      }
-      else if(app_info_mtime_get(app) > app_info_mtime)
+static void app_info_index_save ( void )
+{
+  GVariantBuilder builder;
+  GHashTableIter hiter;
+  GVariant *index;
+  app_info_entry_t *entry;
+  gchar *path, *dir;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a" APP_INFO_ENTRY_TYPE));
+  g_hash_table_iter_init(&hiter, app_info_index);
+  while(g_hash_table_iter_next(&hiter, NULL, (gpointer *)&entry))
+    g_variant_builder_add_value(&builder, entry->data);
+
+  index = g_variant_ref_sink(g_variant_new(APP_INFO_INDEX_TYPE,
+        APP_INFO_INDEX_VERSION, app_info_locale? app_info_locale : "",
+        &builder));
+
+  path = app_info_index_path();
+  dir = g_path_get_dirname(path);
+  if(!g_mkdir_with_parents(dir, 0700))
+    g_file_set_contents(path, g_variant_get_data(index),
+        g_variant_get_size(index), NULL);
+  g_free(dir);
+  g_free(path);
+  g_variant_unref(index);
+}
+
+/* check a directory of desktop files against the index. Only new or
+ * modified files are parsed */
+static gboolean app_info_index_scan ( const gchar *dir, const gchar *prefix,
+    GHashTable *seen, gboolean reparse )
+{
+  GDir *gdir;
+  GStatBuf stattr;
+  app_info_entry_t *entry, *old;
+  const gchar *file;
+  gchar *path, *id, *sub;
+  gboolean changed = FALSE;
+  gint64 mtime;
+
+  if( !(gdir = g_dir_open(dir, 0, NULL)) )
+    return FALSE;
+
+  while( (file = g_dir_read_name(gdir)) )
+  {
+    path = g_build_filename(dir, file, NULL);
+    if(g_stat(path, &stattr))
+    {
+      g_free(path);
+      continue;
+    }
+    if(S_ISDIR(stattr.st_mode))
+    {
+      sub = g_strconcat(prefix, file, "-", NULL);
+      changed |= app_info_index_scan(path, sub, seen, reparse);
+      g_free(sub);
+    }
+    else if(g_str_has_suffix(file, ".desktop"))
+    {
+      id = g_strconcat(prefix, file, NULL);
+      mtime = stattr.st_mtime;
+      old = g_hash_table_lookup(app_info_index, id);
+      if(g_hash_table_contains(seen, id))
+        g_free(id);
+      else if(!reparse && old && old->mtime==mtime &&
+          !g_strcmp0(old->path, path))
+        g_hash_table_add(seen, id);
+      else if( (entry = app_info_entry_parse(id, path, mtime)) )
       {
-        for(handler=app_info_delete; handler; handler=g_list_next(handler))
-          ((AppInfoHandler)(handler->data))(id);
-        for(handler=app_info_add; handler; handler=g_list_next(handler))
-          ((AppInfoHandler)(handler->data))(id);
+        g_debug("appinfo: indexed '%s'", id);
+        if(old)
+          app_info_emit(app_info_delete, id);
+        g_hash_table_remove(app_info_index, id);
+        app_info_index_insert(entry);
+        app_info_emit(app_info_add, entry->id);
+        g_hash_table_add(seen, id);
+        changed = TRUE;
       }
-      g_object_unref(G_OBJECT(app));
+      else
+        g_free(id);
     }
+    g_free(path);
+  }
+  g_dir_close(gdir);
+
+  return changed;
+}
+
+void app_info_index_update ( void )
+{
+  GHashTable *seen;
+  GHashTableIter hiter;
+  GList *removed, *iter;
+  const gchar * const *sysdirs;
+  app_info_entry_t *entry;
+  gchar *dir;
+  gboolean changed, reparse;
+  gsize i;
+
+  /* labels are localized, reparse everything if the locale changed. The
+   * locale isn't known until locale1 reports it, keep the index until then */
+  reparse = locale1_get_locale() &&
+    g_strcmp0(app_info_locale, locale1_get_locale());
+  if(reparse)
+    str_assign(&app_info_locale, g_strdup(locale1_get_locale()));
+
+  seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  dir = g_build_filename(g_get_user_data_dir(), "applications", NULL);
+  changed = app_info_index_scan(dir, "", seen, reparse);
+  g_free(dir);
+  sysdirs = g_get_system_data_dirs();
+  for(i=0; sysdirs[i]; i++)
+  {
+    dir = g_build_filename(sysdirs[i], "applications", NULL);
+    changed |= app_info_index_scan(dir, "", seen, reparse);
+    g_free(dir);
   }
+
+  removed = NULL;
+  g_hash_table_iter_init(&hiter, app_info_index);
+  while(g_hash_table_iter_next(&hiter, NULL, (gpointer *)&entry))
+    if(!g_hash_table_contains(seen, entry->id))
+      removed = g_list_prepend(removed, entry);
   for(iter=removed; iter; iter=g_list_next(iter))
   {
-    for(handler=app_info_delete; handler; handler=g_list_next(handler))
-      ((AppInfoHandler)(handler->data))(iter->data);
-    if( (item = g_list_find_custom(app_info_entries, iter->data,
-            (GCompareFunc)g_strcmp0)) )
-      app_info_entries = g_list_remove(app_info_entries, item->data);
+    entry = iter->data;
+    g_debug("appinfo: removed '%s'", entry->id);
+    app_info_emit(app_info_delete, entry->id);
+    g_hash_table_remove(app_info_index, entry->id);
+    changed = TRUE;
   }
   g_list_free(removed);
-  g_list_free_full(list, g_object_unref);
-  app_info_mtime = g_get_real_time() / 1000000;
+  g_hash_table_destroy(seen);
+
+  if(!changed)
+    return;
+
+  app_info_wm_class_update();
+  app_info_index_save();
+}
+
+/* GAppInfoMonitor only emits "changed" again once GIO has re-read the
+ * application directories. A lookup by id re-arms it without parsing
+ * every desktop file the way g_app_info_get_all() would */
+static void app_info_monitor_arm ( void )
+{
+  GDesktopAppInfo *info;
+
+  if( (info = g_desktop_app_info_new("sfwbar.desktop")) )
+    g_object_unref(info);
+}
+
+static void app_info_monitor_cb ( GAppInfoMonitor *mon, gpointer d )
+{
+  app_info_monitor_arm();
+  app_info_index_update();
 }
 
 void app_info_init ( void )
@@ -141,11 +471,15 @@ void app_info_init ( void )
 
   app_info_wm_class_map = g_hash_table_new_full(g_str_hash, g_str_equal,
       g_free, g_free);
+  app_info_index = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify)app_info_entry_free);
   app_info_theme = gtk_icon_theme_get_default();
+  app_info_index_load();
   mon = g_app_info_monitor_get();
   g_signal_connect(G_OBJECT(mon), "changed", (GCallback)app_info_monitor_cb,
       NULL);
-  app_info_monitor_cb(mon, NULL);
+  app_info_monitor_arm();
+  app_info_index_update();
 }
 
 gchar *app_info_icon_test ( const gchar *icon, gboolean symbolic_pref )
@@ -5,11 +5,31 @@
 
 typedef void (*AppInfoHandler)( const gchar * );
 
+/* a parsed desktop entry. Strings point into data and are NULL if the key
+ * isn't present. Entries are only valid until the next index update */
+typedef struct _app_info_entry {
+  GVariant *data;
+  const gchar *id, *path, *wm_class, *categories, *only_show_in, *try_exec;
+  const gchar *icon, *label, *comment;
+  gint64 mtime;
+  guint32 flags;
+} app_info_entry_t;
+
+enum {
+  APP_INFO_HIDDEN    = 1,
+  APP_INFO_NODISPLAY = 2,
+  APP_INFO_NOTSHOWIN = 4,
+  APP_INFO_NOTAPP    = 8
+};
+
 void app_info_init ( void );
 void app_info_add_handlers ( AppInfoHandler add, AppInfoHandler del );
 void app_info_remove_handlers ( AppInfoHandler add, AppInfoHandler del );
 void app_icon_map_add ( gchar *appid, gchar *icon );
 gchar *app_info_icon_lookup ( gchar *app_id, gboolean prefer_symbolic );
 GDesktopAppInfo *app_info_from_id ( const gchar *desktop_id );
+const app_info_entry_t *app_info_entry_lookup ( const gchar *desktop_id );
+gboolean app_info_entry_visible ( const app_info_entry_t *entry );
+void app_info_index_update ( void );
 
 #endif
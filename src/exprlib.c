@@ -3,7 +3,6 @@
  * Copyright 2020- sfwbar maintainers
  */
 
-#include <sys/statvfs.h>
 #include <exec.h>
 #include <locale.h>
 #include "input.h"
@@ -13,6 +12,8 @@
 #include "gui/basewidget.h"
 #include "gui/taskbaritem.h"
 #include "gui/bar.h"
+#include "util/clock.h"
+#include "util/disk.h"
 #include "util/file.h"
 #include "util/string.h"
 #include "vm/expr.h"
@@ -234,34 +235,18 @@ static value_t expr_lib_pad ( vm_t *vm, value_t p[], gint np )
 /* Get current time string */
 static value_t expr_lib_time ( vm_t *vm, value_t p[], gint np )
 {
-  GTimeZone *tz;
-  GDateTime *time;
-  gchar *str;
-
   vm_param_check_np_range(vm, np, 0, 2, "time");
   if(np>0)
     vm_param_check_string(vm, p, 0, "time");
   if(np==2)
     vm_param_check_string(vm, p, 1, "time");
-  if(np<2)
-    time = g_date_time_new_now_local();
-  else
-  {
-#if GLIB_MAJOR_VERSION == 2 && GLIB_MINOR_VERSION >= 68
-    if( !(tz = g_time_zone_new_identifier(value_get_string(p[1]))) )
-      tz = g_time_zone_new_utc();
-#else
-    tz = g_time_zone_new(value_get_string(p[1]));
-#endif
-    time = g_date_time_new_now(tz);
-    g_time_zone_unref(tz);
-  }
 
-  str = g_date_time_format (time, (np>0)? value_get_string(p[0]) :
-      "%a %b %d %H:%M:%S %Y" );
-  g_date_time_unref(time);
+  if(vm->expr)
+    vm->expr->clock = TRUE;
 
-  return value_new_string(str);
+  return value_new_string(clock_format(
+        (np>0)? value_get_string(p[0]) : "%a %b %d %H:%M:%S %Y",
+        (np==2)? value_get_string(p[1]) : NULL));
 }
 
 static value_t expr_lib_elapsed_str ( vm_t *vm, value_t p[], gint np )
@@ -287,30 +272,48 @@ static value_t expr_lib_getlocale ( vm_t *vm, value_t p[], gint np )
   return value_new_string(g_strdup(setlocale(LC_ALL, NULL)));
 }
 
+enum disk_query_t {
+  DISK_TOTAL,
+  DISK_AVAIL,
+  DISK_FREE,
+  DISK_PAVAIL,
+  DISK_PUSED,
+};
+
+static const gchar *disk_keys[] = {
+  "total", "avail", "free", "%avail", "%used", NULL
+};
+
 /* generate disk space utilization for a device */
 static value_t expr_lib_disk ( vm_t *vm, value_t p[], gint np )
 {
   struct statvfs fs;
+  gint sel;
 
   vm_param_check_np(vm, np, 2, "disk");
   vm_param_check_string(vm, p, 0, "disk");
-  vm_param_check_string(vm, p, 1, "disk");
 
-  if(statvfs(value_get_string(p[0]), &fs))
+  if( (sel = vm_param_selector(p[1], disk_keys))<0 )
+    return value_na;
+
+  if(!disk_stat_get(value_get_string(p[0]), &fs))
     return value_na;
 
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "total"))
-    return value_new_numeric(fs.f_blocks * fs.f_frsize);
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "avail"))
-    return value_new_numeric(fs.f_bavail * fs.f_bsize);
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "free"))
-    return value_new_numeric(fs.f_bfree * fs.f_bsize);
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "%avail"))
-    return value_new_numeric(((gdouble)(fs.f_bfree*fs.f_bsize) /
-        (gdouble)(fs.f_blocks*fs.f_frsize))*100);
-  if(!g_ascii_strcasecmp(value_get_string(p[1]), "%used"))
-    return value_new_numeric((1.0 - (gdouble)(fs.f_bfree*fs.f_bsize) /
-        (gdouble)(fs.f_blocks*fs.f_frsize))*100);
+  switch(sel)
+  {
+    case DISK_TOTAL:
+      return value_new_numeric(fs.f_blocks * fs.f_frsize);
+    case DISK_AVAIL:
+      return value_new_numeric(fs.f_bavail * fs.f_bsize);
+    case DISK_FREE:
+      return value_new_numeric(fs.f_bfree * fs.f_bsize);
+    case DISK_PAVAIL:
+      return value_new_numeric(((gdouble)(fs.f_bfree*fs.f_bsize) /
+          (gdouble)(fs.f_blocks*fs.f_frsize))*100);
+    case DISK_PUSED:
+      return value_new_numeric((1.0 - (gdouble)(fs.f_bfree*fs.f_bsize) /
+          (gdouble)(fs.f_blocks*fs.f_frsize))*100);
+  }
 
   return value_na;
 }
@@ -829,6 +832,7 @@ void expr_lib_init ( void )
   vm_func_add("elapsedstr", expr_lib_elapsed_str, TRUE, TRUE);
   vm_func_add("getlocale", expr_lib_getlocale, FALSE, FALSE);
   vm_func_add("disk", expr_lib_disk, FALSE, TRUE);
+  vm_func_selectors_add("disk", 1, disk_keys);
   vm_func_add("activewin", expr_lib_active, FALSE, FALSE);
   vm_func_add("max", expr_lib_max, TRUE, TRUE);
   vm_func_add("min", expr_lib_min, TRUE, TRUE);
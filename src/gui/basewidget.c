@@ -11,8 +11,13 @@
 #include "gui/bar.h"
 #include "gui/css.h"
 #include "gui/grid.h"
+#include "util/clock.h"
+#include "util/disk.h"
 #include "util/string.h"
 
+/* microseconds past a clock edge to wake clock widgets */
+#define BASE_WIDGET_EDGE_GUARD 1000
+
 G_DEFINE_TYPE_WITH_CODE (BaseWidget, base_widget, GTK_TYPE_EVENT_BOX,
     G_ADD_PRIVATE (BaseWidget))
 
@@ -42,10 +47,18 @@ GEnumValue tristate_defs[] = {
   { 0, NULL, NULL },
 };
 
+enum {
+  BASE_WIDGET_DIRTY_VALUE = 1,
+  BASE_WIDGET_DIRTY_STYLE = 2,
+};
+
 static GList *widgets_scan;
 static GMutex widget_mutex;
 static gint64 base_widget_default_id = 0;
-static GPtrArray *base_widgets;
+static GHashTable *base_widgets;
+static GHashTable *base_widgets_dirty;
+static GMutex dirty_mutex;
+static guint base_widget_flush_id;
 static GThreadPool *pool;
 static gint base_widget_double_click_time;
 
@@ -87,7 +100,7 @@ static gboolean base_widget_update_value ( GtkWidget *self )
 {
   BaseWidgetPrivate *priv;
 
-  if(!g_ptr_array_find(base_widgets, self, NULL))
+  if(!g_hash_table_contains(base_widgets, self))
     return FALSE;
   priv = base_widget_get_instance_private(BASE_WIDGET(self));
 
@@ -110,12 +123,16 @@ static gboolean base_widget_style ( GtkWidget *self )
 {
   BaseWidgetPrivate *priv;
 
-  if(!g_ptr_array_find(base_widgets, self, NULL))
+  if(!g_hash_table_contains(base_widgets, self))
     return FALSE;
   priv = base_widget_get_instance_private(
       BASE_WIDGET(base_widget_get_mirror_parent(self)));
-  gtk_widget_set_name(base_widget_get_child(self), priv->style->cache);
-  css_widget_cascade(self, NULL);
+  if(g_strcmp0(gtk_widget_get_name(base_widget_get_child(self)),
+        priv->style->cache))
+  {
+    gtk_widget_set_name(base_widget_get_child(self), priv->style->cache);
+    css_widget_cascade(self, NULL);
+  }
 
   if(!priv->local_state)
     g_list_foreach(base_widget_get_mirror_children(self),
@@ -124,27 +141,70 @@ static gboolean base_widget_style ( GtkWidget *self )
   return FALSE;
 }
 
+/* apply all updates queued since the last main loop iteration in one go,
+ * ahead of the gtk resize and redraw sources */
+static gboolean base_widget_flush ( gpointer d )
+{
+  GHashTable *dirty;
+  GHashTableIter iter;
+  gpointer self, flags;
+
+  g_mutex_lock(&dirty_mutex);
+  dirty = base_widgets_dirty;
+  base_widgets_dirty = NULL;
+  base_widget_flush_id = 0;
+  g_mutex_unlock(&dirty_mutex);
+
+  if(!dirty)
+    return G_SOURCE_REMOVE;
+
+  g_hash_table_iter_init(&iter, dirty);
+  while(g_hash_table_iter_next(&iter, &self, &flags))
+  {
+    if(GPOINTER_TO_INT(flags) & BASE_WIDGET_DIRTY_VALUE)
+      base_widget_update_value(self);
+    if(GPOINTER_TO_INT(flags) & BASE_WIDGET_DIRTY_STYLE)
+      base_widget_style(self);
+  }
+  g_hash_table_destroy(dirty);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void base_widget_queue_update ( GtkWidget *self, gint flags )
+{
+  g_mutex_lock(&dirty_mutex);
+  if(!base_widgets_dirty)
+    base_widgets_dirty = g_hash_table_new(g_direct_hash, g_direct_equal);
+  flags |= GPOINTER_TO_INT(g_hash_table_lookup(base_widgets_dirty, self));
+  g_hash_table_insert(base_widgets_dirty, self, GINT_TO_POINTER(flags));
+  if(!base_widget_flush_id)
+    base_widget_flush_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+        base_widget_flush, NULL, NULL);
+  g_mutex_unlock(&dirty_mutex);
+}
+
 static void base_widget_eval_finish ( vm_t *vm, gpointer d )
 {
   GtkWidget *w;
-  GSourceFunc func;
+  gint flags;
 
   w = vm_widget_get(vm, NULL);
-  func = vm->user_data;
+  flags = GPOINTER_TO_INT(vm->user_data);
 
   if(vm_expr_run(vm))
-    g_main_context_invoke(NULL, func, w);
+    base_widget_queue_update(w, flags);
 }
 
 static void base_widget_eval_async ( GtkWidget *self, expr_cache_t *expr,
-    GSourceFunc func )
+    gint flags )
 {
   vm_t *vm;
 
   if( !(vm = vm_expr_prep(expr)) )
     return;
 
-  vm->user_data = func;
+  vm->user_data = GINT_TO_POINTER(flags);
   g_thread_pool_push(pool, vm, NULL);
 }
 
@@ -157,8 +217,8 @@ static gboolean base_widget_update ( GtkWidget *self )
 
   g_debug("widget update: %s", priv->id);
 
-  base_widget_eval_async(self, priv->value, (GSourceFunc)base_widget_update_value);
-  base_widget_eval_async(self, priv->style, (GSourceFunc)base_widget_style);
+  base_widget_eval_async(self, priv->value, BASE_WIDGET_DIRTY_VALUE);
+  base_widget_eval_async(self, priv->style, BASE_WIDGET_DIRTY_STYLE);
   if(priv->local_state)
     g_list_foreach(priv->mirror_children, (GFunc)base_widget_update, NULL);
   return FALSE;
@@ -179,7 +239,11 @@ static void base_widget_destroy ( GtkWidget *self )
   priv = base_widget_get_instance_private(BASE_WIDGET(self));
 
   g_debug("widget destroyed: '%s'", priv->id);
-  g_ptr_array_remove(base_widgets, self);
+  g_hash_table_remove(base_widgets, self);
+  g_mutex_lock(&dirty_mutex);
+  if(base_widgets_dirty)
+    g_hash_table_remove(base_widgets_dirty, self);
+  g_mutex_unlock(&dirty_mutex);
   trigger_remove((gchar *)(priv->trigger),
       (trigger_func_t)base_widget_update_expressions, self);
   priv->trigger = NULL;
@@ -552,6 +616,7 @@ static void base_widget_set_value ( GtkWidget *self, GBytes *code )
   priv->value->code = code? g_bytes_ref(code) : NULL;
   priv->value->widget = self;
   priv->value->invalid = !!code;
+  priv->value->clock = FALSE;
   priv->value->always_update = BASE_WIDGET_GET_CLASS(self)->always_update;
 
 
@@ -582,6 +647,7 @@ static void base_widget_set_style ( GtkWidget *self, GBytes *code )
   priv->style->code = code? g_bytes_ref(code) : NULL;
   priv->style->widget = self;
   priv->style->invalid = !!code;
+  priv->style->clock = FALSE;
   priv->style->always_update = BASE_WIDGET_GET_CLASS(self)->always_update;
 
   if((priv->mirror_parent && !priv->local_state) ||
@@ -823,16 +889,24 @@ static void base_widget_set_property ( GObject *self, guint id,
             TRUE);
       break;
     case BASE_WIDGET_HEXPAND:
+      if(priv->hexpand == g_value_get_enum(value))
+        break;
       priv->hexpand = g_value_get_enum(value);
       if(priv->hexpand != TRISTATE_UNINIT)
         gtk_widget_set_hexpand(base_widget_get_child(GTK_WIDGET(self)),
             priv->hexpand);
+      else if(base_widget_get_child(GTK_WIDGET(self)))
+        css_custom_handle(base_widget_get_child(GTK_WIDGET(self)));
       break;
     case BASE_WIDGET_VEXPAND:
+      if(priv->vexpand == g_value_get_enum(value))
+        break;
       priv->vexpand = g_value_get_enum(value);
       if(priv->vexpand != TRISTATE_UNINIT)
         gtk_widget_set_vexpand(base_widget_get_child(GTK_WIDGET(self)),
             priv->vexpand);
+      else if(base_widget_get_child(GTK_WIDGET(self)))
+        css_custom_handle(base_widget_get_child(GTK_WIDGET(self)));
       break;
     case BASE_WIDGET_DISABLE:
       priv->disabled = g_value_get_boolean(value);
@@ -931,7 +1005,7 @@ static void base_widget_class_init ( BaseWidgetClass *kclass )
       g_param_spec_enum("vexpand", "vertical expand", "sfwbar_config",
         tristate_enum, TRISTATE_UNINIT, G_PARAM_READWRITE));
 
-  base_widgets = g_ptr_array_new();
+  base_widgets = g_hash_table_new(g_direct_hash, g_direct_equal);
   g_object_get(G_OBJECT(gtk_settings_get_default()), "gtk-double-click-time",
       &base_widget_double_click_time, NULL);
 }
@@ -957,7 +1031,7 @@ static void base_widget_init ( BaseWidget *self )
   priv->hexpand = TRISTATE_UNINIT;
   priv->vexpand = TRISTATE_UNINIT;
   base_widget_set_id(GTK_WIDGET(self), NULL);
-  g_ptr_array_add(base_widgets, self);
+  g_hash_table_add(base_widgets, self);
 
   gtk_widget_add_events(GTK_WIDGET(self),
       GDK_BUTTON_RELEASE_MASK | GDK_SCROLL_MASK);
@@ -1178,6 +1252,20 @@ GtkWidget *base_widget_get_mirror_parent ( GtkWidget *self )
     return self;
 }
 
+/* widgets showing Time() with a whole second interval are woken just past
+ * wall clock edges rather than at an arbitrary phase. The edge is measured
+ * from the current time, since the updates may have taken a while since
+ * the scan started at ctime */
+static gint64 base_widget_poll_next ( BaseWidgetPrivate *priv, gint64 ctime )
+{
+  if((priv->value->clock || priv->style->clock) &&
+      priv->interval >= G_USEC_PER_SEC && !(priv->interval % G_USEC_PER_SEC))
+    return g_get_monotonic_time() + clock_edge_delay(priv->interval) +
+      BASE_WIDGET_EDGE_GUARD;
+
+  return ctime + priv->interval;
+}
+
 gpointer base_widget_scanner_thread ( GMainContext *gmc )
 {
   BaseWidgetPrivate *priv;
@@ -1191,6 +1279,7 @@ gpointer base_widget_scanner_thread ( GMainContext *gmc )
   {
     scanner_invalidate();
     module_invalidate_all();
+    disk_invalidate();
     timer = G_MAXINT64;
     ctime = g_get_monotonic_time();
    
@@ -1204,7 +1293,7 @@ gpointer base_widget_scanner_thread ( GMainContext *gmc )
           base_widget_update(iter->data);
         priv = base_widget_get_instance_private(BASE_WIDGET(iter->data));
         if(!priv->trigger)
-          priv->next_poll = ctime + priv->interval;
+          priv->next_poll = base_widget_poll_next(priv, ctime);
       }
       timer = MIN(timer, base_widget_get_next_poll(iter->data));
     }
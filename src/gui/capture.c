@@ -21,7 +21,6 @@ static struct ext_foreign_toplevel_image_capture_source_manager_v1
 static struct ext_output_image_capture_source_manager_v1
   *capture_output_source;
 static struct ext_image_copy_capture_manager_v1 *capture_manager;
-static gint capture_counter;
 
 typedef struct _capture_node {
   struct ext_image_copy_capture_session_v1 *session;
@@ -33,12 +32,41 @@ typedef struct _capture_node {
   void (*callback)(gpointer, gchar *);
 } capture_node_t;
 
+/* a long-lived session feeding a live window preview. The buffer and the
+ * surface are kept across frames, the surface is published in the image
+ * cache under a fixed name and frames are only requested while a preview
+ * is mapped */
+typedef struct _capture_live {
+  gpointer uid;
+  gchar *name;
+  struct ext_image_copy_capture_session_v1 *session;
+  struct ext_image_copy_capture_frame_v1 *frame;
+  struct ext_image_capture_source_v1 *source;
+  guint32 width, height, shm_format;
+  wayland_buffer_t *buff;
+  cairo_surface_t *surface;
+  cairo_region_t *damage;
+  gboolean full;
+  gint visible;
+  gint64 last;
+  guint timeout;
+} capture_live_t;
+
+#define CAPTURE_RATE_DEFAULT 2
+
+static GHashTable *capture_live_map;
+static guint capture_live_serial;
+static gdouble capture_rate = CAPTURE_RATE_DEFAULT;
+
+static void capture_live_arm ( capture_live_t *live );
+
 static void capture_node_free ( capture_node_t *node )
 {
-  if(node->buff)
-    wayland_buffer_free(node->buff);
+  /* destroy the frame before the buffer goes back to the shm pool */
   if(node->frame)
     ext_image_copy_capture_frame_v1_destroy(node->frame);
+  if(node->buff)
+    wayland_buffer_free(node->buff);
   if(node->session)
     ext_image_copy_capture_session_v1_destroy(node->session);
   if(node->source)
@@ -68,17 +96,14 @@ static void capture_frame_ready ( void *data,
 {
   capture_node_t *node = data;
   cairo_surface_t *cs;
-  gchar *name;
 
   cs = cairo_image_surface_create_for_data((guchar *)node->buff->data,
       CAIRO_FORMAT_ARGB32, node->width, node->height,
       cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, node->width));
   if(cairo_surface_status(cs) == CAIRO_STATUS_SUCCESS)
   {
-    name = g_strdup_printf("<pixbufcache/>capture-%u", capture_counter++);
-    scale_image_cache_insert(name,
-        gdk_pixbuf_get_from_surface(cs, 0, 0, node->width, node->height));
-    node->callback(node->data, name);
+    node->callback(node->data, scale_image_cache_insert(
+          gdk_pixbuf_get_from_surface(cs, 0, 0, node->width, node->height)));
   }
   cairo_surface_destroy(cs);
 
@@ -165,6 +190,335 @@ static struct ext_image_copy_capture_session_v1_listener capture_session_listene
   .stopped = capture_session_stopped,
 };
 
+static void capture_live_free ( capture_live_t *live )
+{
+  if(live->timeout)
+    g_source_remove(live->timeout);
+  if(live->frame)
+    ext_image_copy_capture_frame_v1_destroy(live->frame);
+  if(live->buff)
+    wayland_buffer_free(live->buff);
+  if(live->session)
+    ext_image_copy_capture_session_v1_destroy(live->session);
+  if(live->source)
+    ext_image_capture_source_v1_destroy(live->source);
+  g_clear_pointer(&live->surface, cairo_surface_destroy);
+  cairo_region_destroy(live->damage);
+  g_free(live->name);
+  g_free(live);
+}
+
+static void capture_live_remove ( capture_live_t *live )
+{
+  g_hash_table_remove(capture_live_map, live->uid);
+}
+
+static void capture_live_buffer_release ( capture_live_t *live )
+{
+  g_clear_pointer(&live->buff, wayland_buffer_free);
+}
+
+/* the session may be resized while a frame is in flight */
+static gboolean capture_live_buffer_valid ( capture_live_t *live )
+{
+  return live->buff && live->buff->size == live->height *
+    cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, live->width);
+}
+
+/* copy the damaged areas of the shm buffer into the retained surface. A
+ * new surface is only allocated for the first frame or after a resize */
+static gboolean capture_live_surface ( capture_live_t *live )
+{
+  cairo_rectangle_int_t rect;
+  guchar *dst, *src;
+  gint stride, i, n, y;
+
+  if(live->surface &&
+      (cairo_image_surface_get_width(live->surface) != live->width ||
+       cairo_image_surface_get_height(live->surface) != live->height))
+    g_clear_pointer(&live->surface, cairo_surface_destroy);
+
+  if(!live->surface)
+  {
+    live->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+        live->width, live->height);
+    if(cairo_surface_status(live->surface) != CAIRO_STATUS_SUCCESS)
+    {
+      g_clear_pointer(&live->surface, cairo_surface_destroy);
+      return FALSE;
+    }
+    live->full = TRUE;
+  }
+  cairo_surface_flush(live->surface);
+  dst = cairo_image_surface_get_data(live->surface);
+  src = live->buff->data;
+  stride = cairo_image_surface_get_stride(live->surface);
+
+  if(live->full)
+  {
+    memcpy(dst, src, (gsize)stride * live->height);
+    cairo_surface_mark_dirty(live->surface);
+  }
+  else
+  {
+    n = cairo_region_num_rectangles(live->damage);
+    for(i=0; i<n; i++)
+    {
+      cairo_region_get_rectangle(live->damage, i, &rect);
+      for(y=rect.y; y<rect.y+rect.height; y++)
+        memcpy(dst + y*stride + rect.x*4, src + y*stride + rect.x*4,
+            rect.width*4);
+      cairo_surface_mark_dirty_rectangle(live->surface, rect.x, rect.y,
+          rect.width, rect.height);
+    }
+  }
+  live->full = FALSE;
+
+  return TRUE;
+}
+
+static void capture_live_frame_damage ( void *data,
+    struct ext_image_copy_capture_frame_v1 *frame,
+    int32_t x, int32_t y, int32_t width, int32_t height)
+{
+  capture_live_t *live = data;
+  cairo_rectangle_int_t rect = { x, y, width, height };
+  cairo_rectangle_int_t bounds = { 0, 0, live->width, live->height };
+
+  cairo_region_union_rectangle(live->damage, &rect);
+  cairo_region_intersect_rectangle(live->damage, &bounds);
+}
+
+static void capture_live_frame_ready ( void *data,
+    struct ext_image_copy_capture_frame_v1 *frame )
+{
+  capture_live_t *live = data;
+  window_t *win;
+
+  g_clear_pointer(&live->frame, ext_image_copy_capture_frame_v1_destroy);
+  live->last = g_get_monotonic_time();
+
+  if( (win = wintree_from_id(live->uid)) && capture_live_buffer_valid(live) &&
+      (live->full || !cairo_region_is_empty(live->damage)) &&
+      capture_live_surface(live) )
+  {
+    /* once the window shows the live image, frames only redraw it */
+    if(!g_strcmp0(win->image, live->name))
+      scale_image_cache_update(live->name, live->surface);
+    else
+    {
+      scale_image_cache_unref(win->image);
+      str_assign(&win->image, scale_image_cache_insert_named(live->name,
+            cairo_surface_reference(live->surface)));
+      wintree_commit(win);
+    }
+  }
+  cairo_region_subtract(live->damage, live->damage);
+
+  if(live->visible)
+    capture_live_arm(live);
+  else
+    capture_live_buffer_release(live);
+}
+
+static void capture_live_frame_failed ( void *data,
+    struct ext_image_copy_capture_frame_v1 *frame, uint32_t reason)
+{
+  capture_live_t *live = data;
+
+  g_clear_pointer(&live->frame, ext_image_copy_capture_frame_v1_destroy);
+  live->last = g_get_monotonic_time();
+  if(reason == EXT_IMAGE_COPY_CAPTURE_FRAME_V1_FAILURE_REASON_STOPPED)
+    capture_live_remove(live);
+  else if(reason ==
+      EXT_IMAGE_COPY_CAPTURE_FRAME_V1_FAILURE_REASON_BUFFER_CONSTRAINTS)
+    capture_live_buffer_release(live);
+  else if(live->visible)
+    capture_live_arm(live);
+}
+
+static struct ext_image_copy_capture_frame_v1_listener capture_live_frame_listener = {
+  .transform = capture_frame_transform,
+  .damage = capture_live_frame_damage,
+  .presentation_time = capture_frame_presentation_time,
+  .ready = capture_live_frame_ready,
+  .failed = capture_live_frame_failed,
+};
+
+static gboolean capture_live_timeout_cb ( capture_live_t *live )
+{
+  live->timeout = 0;
+  capture_live_arm(live);
+  return FALSE;
+}
+
+/* request the next frame, no sooner than the preview frame rate allows.
+ * The compositor completes it once the window has new damage */
+static void capture_live_arm ( capture_live_t *live )
+{
+  gint64 delay;
+
+  if(!live->visible || live->frame || live->timeout || !live->width ||
+      live->shm_format != WL_SHM_FORMAT_ARGB8888 || capture_rate <= 0)
+    return;
+
+  delay = live->last + (gint64)(G_USEC_PER_SEC / capture_rate) -
+    g_get_monotonic_time();
+  if(delay > 0)
+  {
+    live->timeout = g_timeout_add(delay/1000 + 1,
+        (GSourceFunc)capture_live_timeout_cb, live);
+    return;
+  }
+
+  if(live->buff && !capture_live_buffer_valid(live))
+    capture_live_buffer_release(live);
+  if(!live->buff)
+  {
+    if( !(live->buff = wayland_buffer_new(live->width, live->height,
+            live->shm_format)) )
+      return;
+    live->full = TRUE;
+  }
+
+  live->frame = ext_image_copy_capture_session_v1_create_frame(live->session);
+  ext_image_copy_capture_frame_v1_add_listener(live->frame,
+      &capture_live_frame_listener, live);
+  ext_image_copy_capture_frame_v1_attach_buffer(live->frame,
+      live->buff->buffer);
+  if(live->full)
+    ext_image_copy_capture_frame_v1_damage_buffer(live->frame, 0, 0,
+        live->width, live->height);
+  ext_image_copy_capture_frame_v1_capture(live->frame);
+}
+
+static void capture_live_buffer_size_handle ( void *data,
+    struct ext_image_copy_capture_session_v1 *session,
+    uint32_t width, uint32_t height)
+{
+  capture_live_t *live = data;
+
+  live->width = width;
+  live->height = height;
+}
+
+static void capture_live_shm_format_handle ( void *data,
+    struct ext_image_copy_capture_session_v1 *session, uint32_t format )
+{
+  capture_live_t *live = data;
+
+  if(format == WL_SHM_FORMAT_ARGB8888)
+    live->shm_format = format;
+}
+
+static void capture_live_done ( void *data,
+    struct ext_image_copy_capture_session_v1 *session )
+{
+  capture_live_arm(data);
+}
+
+static void capture_live_stopped ( void *data,
+    struct ext_image_copy_capture_session_v1 *session )
+{
+  capture_live_remove(data);
+}
+
+static struct ext_image_copy_capture_session_v1_listener capture_live_session_listener = {
+  .buffer_size = capture_live_buffer_size_handle,
+  .shm_format = capture_live_shm_format_handle,
+  .dmabuf_device = capture_session_dmabuf_device_handle,
+  .dmabuf_format = capture_session_dmabuf_format_handle,
+  .done = capture_live_done,
+  .stopped = capture_live_stopped,
+};
+
+static void capture_live_ref ( window_t *win )
+{
+  capture_live_t *live;
+  gpointer toplevel;
+
+  if( !(live = g_hash_table_lookup(capture_live_map, win->uid)) )
+  {
+    if(!win->stable_id || !(toplevel = ext_ftl_lookup(win->stable_id)) )
+      return;
+    live = g_malloc0(sizeof(capture_live_t));
+    live->uid = win->uid;
+    live->name = g_strdup_printf("<pixbufcache/>live-%u",
+        ++capture_live_serial);
+    live->damage = cairo_region_create();
+    live->source =
+      ext_foreign_toplevel_image_capture_source_manager_v1_create_source(
+          capture_toplevel_source, toplevel);
+    live->session = ext_image_copy_capture_manager_v1_create_session(
+        capture_manager, live->source, 0);
+    ext_image_copy_capture_session_v1_add_listener(live->session,
+        &capture_live_session_listener, live);
+    g_hash_table_insert(capture_live_map, live->uid, live);
+  }
+  live->visible++;
+  capture_live_arm(live);
+}
+
+static void capture_live_unref ( gpointer uid )
+{
+  capture_live_t *live;
+
+  if( !(live = g_hash_table_lookup(capture_live_map, uid)) || !live->visible)
+    return;
+
+  /* paused sessions keep no buffer and request no frames */
+  if(!--live->visible)
+  {
+    g_clear_handle_id(&live->timeout, g_source_remove);
+    if(!live->frame)
+      capture_live_buffer_release(live);
+  }
+}
+
+static void capture_live_map_cb ( GtkWidget *image, gpointer uid )
+{
+  window_t *win;
+
+  if( (win = wintree_from_id(uid)) )
+    capture_live_ref(win);
+}
+
+static void capture_live_unmap_cb ( GtkWidget *image, gpointer uid )
+{
+  capture_live_unref(uid);
+}
+
+static void capture_live_watch ( GtkWidget *image, window_t *win,
+    gboolean preview )
+{
+  gpointer uid;
+
+  uid = g_object_get_data(G_OBJECT(image), "capture-uid");
+  if(uid == (preview? win->uid : NULL))
+    return;
+
+  if(uid)
+  {
+    g_signal_handlers_disconnect_by_func(image,
+        (gpointer)capture_live_map_cb, uid);
+    g_signal_handlers_disconnect_by_func(image,
+        (gpointer)capture_live_unmap_cb, uid);
+    if(gtk_widget_get_mapped(image))
+      capture_live_unref(uid);
+  }
+  g_object_set_data(G_OBJECT(image), "capture-uid", NULL);
+  if(!preview)
+    return;
+
+  g_object_set_data(G_OBJECT(image), "capture-uid", win->uid);
+  g_signal_connect(G_OBJECT(image), "map", G_CALLBACK(capture_live_map_cb),
+      win->uid);
+  g_signal_connect(G_OBJECT(image), "unmap",
+      G_CALLBACK(capture_live_unmap_cb), win->uid);
+  if(gtk_widget_get_mapped(image))
+    capture_live_ref(win);
+}
+
 static void capture_from_source ( struct ext_image_capture_source_v1 *source,
    void (*callback)(gpointer, gchar *), gpointer data )
 {
@@ -209,9 +563,13 @@ static void capture_toplevel_cb ( gpointer data, gchar *name )
   window_t *win;
 
   if( !(win = wintree_from_id(data)) )
+  {
+    scale_image_cache_unref(name);
+    g_free(name);
     return;
+  }
 
-  scale_image_cache_remove(win->image);
+  scale_image_cache_unref(win->image);
   str_assign(&win->image, name);
   wintree_commit(win);
 }
@@ -233,9 +591,12 @@ void capture_window_image_set ( GtkWidget *image, window_t *win,
 {
   gchar *ptr, *tmp;
 
-  if(capture_support_check(CAPTURE_TYPE_WINDOW) &&
-      win->stable_id && !win->image)
-    capture_window(win);
+  if(capture_support_check(CAPTURE_TYPE_WINDOW))
+  {
+    if(win->stable_id && !win->image)
+      capture_window(win);
+    capture_live_watch(image, win, preview);
+  }
 
   if(preview && win->image && scale_image_set_image(image, win->image, NULL))
     return;
@@ -280,13 +641,38 @@ static value_t capture_screenshot ( vm_t *vm, value_t p[], gint np )
   return value_na;
 }
 
+static value_t capture_preview_rate ( vm_t *vm, value_t p[], gint np )
+{
+  GHashTableIter hiter;
+  capture_live_t *live;
+
+  vm_param_check_np(vm, np, 1, "SetPreviewRate");
+  vm_param_check_numeric(vm, p, 0, "SetPreviewRate");
+
+  capture_rate = value_get_numeric(p[0]);
+  g_hash_table_iter_init(&hiter, capture_live_map);
+  while(g_hash_table_iter_next(&hiter, NULL, (gpointer *)&live))
+  {
+    g_clear_handle_id(&live->timeout, g_source_remove);
+    capture_live_arm(live);
+  }
+
+  return value_na;
+}
+
 static void capture_window_new_handle ( window_t *win, gpointer d )
 {
   capture_window(win);
 }
 
+static void capture_window_destroy_handle ( window_t *win, gpointer d )
+{
+  g_hash_table_remove(capture_live_map, win->uid);
+}
+
 static window_listener_t capture_window_listener = {
   .window_new = capture_window_new_handle,
+  .window_destroy = capture_window_destroy_handle,
 };
 
 void capture_init ( void )
@@ -306,5 +692,10 @@ void capture_init ( void )
   if(capture_support_check(CAPTURE_TYPE_OUTPUT))
     vm_func_add("Screenshot", capture_screenshot, TRUE, FALSE);
   if(capture_support_check(CAPTURE_TYPE_WINDOW))
+  {
+    capture_live_map = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        NULL, (GDestroyNotify)capture_live_free);
+    vm_func_add("SetPreviewRate", capture_preview_rate, TRUE, FALSE);
     wintree_listener_register(&capture_window_listener, NULL);
+  }
 }
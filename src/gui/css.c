@@ -58,23 +58,72 @@ void css_file_load ( gchar *name )
   g_free(fname);
 }
 
+static void css_stats_add ( guint n )
+{
+  static guint count;
+  static gint64 since;
+  gint64 now;
+
+  count += n;
+  now = g_get_monotonic_time();
+  if(now - since < G_USEC_PER_SEC)
+    return;
+  if(since)
+    g_debug("css: %.1f style lookups/s",
+        (gdouble)count * G_USEC_PER_SEC / (now - since));
+  count = 0;
+  since = now;
+}
+
+/* size limits of a base widget are styled on its child */
+static void css_max_size_update ( GtkWidget *widget )
+{
+  guint maxw, maxh;
+
+  gtk_widget_style_get(base_widget_get_child(widget), "max-width", &maxw,
+      "max-height", &maxh, NULL);
+  css_stats_add(2);
+  base_widget_set_max_width(widget, maxw);
+  base_widget_set_max_height(widget, maxh);
+}
+
+/* properties are compared against the live widget state, so only the ones
+ * that differ are applied and unchanged widgets don't get queued for resize */
 void css_custom_handle ( GtkWidget *widget )
 {
   GtkWidget *parent;
   background_effect_t effect;
-  gboolean state, change = FALSE;
+  gboolean visible, hexpand, vexpand, ellipsize, wrap, change = FALSE;
   gdouble xalign;
-  GtkAlign align;
-  guint x;
+  GtkAlign halign, valign;
+  tristate_t phexpand, pvexpand;
 
-  gtk_widget_style_get(widget, "visible", &state, NULL);
-  if(state)
-    gtk_widget_show(widget);
+  if(GTK_IS_LABEL(widget))
+  {
+    gtk_widget_style_get(widget, "visible", &visible, "hexpand", &hexpand,
+        "vexpand", &vexpand, "background-effect", &effect, "halign", &halign,
+        "valign", &valign, "align", &xalign, "ellipsize", &ellipsize,
+        "wrap", &wrap, NULL);
+    css_stats_add(9);
+  }
   else
   {
-    if(GTK_IS_WINDOW(widget))
-      window_collapse_popups(widget);
-    gtk_widget_hide(widget);
+    gtk_widget_style_get(widget, "visible", &visible, "hexpand", &hexpand,
+        "vexpand", &vexpand, "background-effect", &effect, "halign", &halign,
+        "valign", &valign, NULL);
+    css_stats_add(6);
+  }
+
+  if(visible != gtk_widget_get_visible(widget))
+  {
+    if(visible)
+      gtk_widget_show(widget);
+    else
+    {
+      if(GTK_IS_WINDOW(widget))
+        window_collapse_popups(widget);
+      gtk_widget_hide(widget);
+    }
   }
   if(!GTK_IS_VIEWPORT(widget) && !GTK_IS_SCROLLED_WINDOW(widget) &&
       !GTK_IS_EVENT_BOX(widget))
@@ -83,60 +132,65 @@ void css_custom_handle ( GtkWidget *widget )
     while(GTK_IS_VIEWPORT(parent) || GTK_IS_SCROLLED_WINDOW(parent))
       parent = gtk_widget_get_parent(parent);
     if(parent && IS_BASE_WIDGET(parent))
-      g_object_get(G_OBJECT(parent), "hexpand", &state, NULL);
+      g_object_get(G_OBJECT(parent), "hexpand", &phexpand,
+          "vexpand", &pvexpand, NULL);
     else
-      state = TRISTATE_UNINIT;
-    if(state == TRISTATE_UNINIT)
+      phexpand = pvexpand = TRISTATE_UNINIT;
+    if(phexpand == TRISTATE_UNINIT && (!gtk_widget_get_hexpand_set(widget) ||
+          hexpand != gtk_widget_get_hexpand(widget)))
     {
-      gtk_widget_style_get(widget, "hexpand", &state, NULL);
-      change |= (state != gtk_widget_get_hexpand(widget));
-      gtk_widget_set_hexpand(widget, state);
+      gtk_widget_set_hexpand(widget, hexpand);
+      change = TRUE;
     }
-    if(parent && IS_BASE_WIDGET(parent))
-      g_object_get(G_OBJECT(parent), "vexpand", &state, NULL);
-    else
-      state = TRISTATE_UNINIT;
-    if(state == TRISTATE_UNINIT)
+    if(pvexpand == TRISTATE_UNINIT && (!gtk_widget_get_vexpand_set(widget) ||
+          vexpand != gtk_widget_get_vexpand(widget)))
     {
-      gtk_widget_style_get(widget, "vexpand", &state, NULL);
-      change |= (state != gtk_widget_get_vexpand(widget));
-      gtk_widget_set_vexpand(widget, state);
+      gtk_widget_set_vexpand(widget, vexpand);
+      change = TRUE;
     }
     if(change && gtk_widget_get_ancestor(widget, GTK_TYPE_GRID))
       gtk_widget_queue_allocate(gtk_widget_get_ancestor(widget, GTK_TYPE_GRID));
-    gtk_widget_style_get(widget, "background-effect", &effect, NULL);
-    background_effect_set(widget, effect);
-    gtk_widget_style_get(widget, "halign", &align, NULL);
-    gtk_widget_set_halign(widget, align);
-    gtk_widget_style_get(widget, "valign", &align, NULL);
-    gtk_widget_set_valign(widget, align);
+    if(effect != background_effect_get(widget))
+      background_effect_set(widget, effect);
+    if(halign != gtk_widget_get_halign(widget))
+      gtk_widget_set_halign(widget, halign);
+    if(valign != gtk_widget_get_valign(widget))
+      gtk_widget_set_valign(widget, valign);
   }
   if(IS_GRID(widget))
     grid_style_updated(base_widget_get_child(widget), widget);
   if(GTK_IS_LABEL(widget))
   {
-    gtk_widget_style_get(widget, "align", &xalign, NULL);
-    gtk_label_set_xalign(GTK_LABEL(widget), xalign);
-    gtk_widget_style_get(widget, "ellipsize", &state, NULL);
-    gtk_label_set_ellipsize(GTK_LABEL(widget),
-        state?PANGO_ELLIPSIZE_END:PANGO_ELLIPSIZE_NONE);
-
-    gtk_widget_style_get(widget, "wrap", &state, NULL);
-    gtk_label_set_line_wrap(GTK_LABEL(widget), state);
+    if(xalign != gtk_label_get_xalign(GTK_LABEL(widget)))
+      gtk_label_set_xalign(GTK_LABEL(widget), xalign);
+    if(ellipsize != (gtk_label_get_ellipsize(GTK_LABEL(widget)) ==
+          PANGO_ELLIPSIZE_END))
+      gtk_label_set_ellipsize(GTK_LABEL(widget),
+          ellipsize?PANGO_ELLIPSIZE_END:PANGO_ELLIPSIZE_NONE);
+    if(wrap != gtk_label_get_line_wrap(GTK_LABEL(widget)))
+      gtk_label_set_line_wrap(GTK_LABEL(widget), wrap);
   }
   if(IS_BASE_WIDGET(widget))
-  {
-    gtk_widget_style_get(base_widget_get_child(widget), "max-width", &x, NULL);
-    base_widget_set_max_width(widget, x);
-    gtk_widget_style_get(base_widget_get_child(widget), "max-height", &x,NULL);
-    base_widget_set_max_height(widget, x);
-  }
+    css_max_size_update(widget);
 }
 
 static void css_style_updated ( GtkWidget *widget )
 {
   css_style_updated_original(widget);
+  if(!g_object_get_data(G_OBJECT(widget), "css-tracked"))
+    css_custom_handle(widget);
+}
+
+static void css_widget_style_updated_cb ( GtkWidget *widget, gpointer d )
+{
+  GtkWidget *parent;
+
   css_custom_handle(widget);
+  parent = gtk_widget_get_parent(widget);
+  while(GTK_IS_VIEWPORT(parent) || GTK_IS_SCROLLED_WINDOW(parent))
+    parent = gtk_widget_get_parent(parent);
+  if(IS_BASE_WIDGET(parent) && base_widget_get_child(parent) == widget)
+    css_max_size_update(parent);
 }
 
 void css_init ( gchar *cssname )
@@ -267,9 +321,20 @@ GtkCssProvider *css_widget_apply ( GtkWidget *widget, gchar *css )
   return provider;
 }
 
+/* once a widget has been handled, its style-updated signal re-applies the
+ * custom properties whenever its style changes, so the cascade skips it.
+ * GTK doesn't validate styles of hidden widgets, these are always handled */
 void css_widget_cascade ( GtkWidget *widget, gpointer data )
 {
-  css_custom_handle(widget);
+  if(!g_object_get_data(G_OBJECT(widget), "css-tracked"))
+  {
+    g_object_set_data(G_OBJECT(widget), "css-tracked", GINT_TO_POINTER(TRUE));
+    g_signal_connect(G_OBJECT(widget), "style-updated",
+        G_CALLBACK(css_widget_style_updated_cb), NULL);
+    css_custom_handle(widget);
+  }
+  else if(!gtk_widget_get_visible(widget))
+    css_custom_handle(widget);
 
   if(GTK_IS_CONTAINER(widget))
     gtk_container_forall(GTK_CONTAINER(widget), css_widget_cascade, NULL);
@@ -13,6 +13,8 @@
 G_DEFINE_TYPE_WITH_CODE (FlowGrid, flow_grid, BASE_WIDGET_TYPE,
     G_ADD_PRIVATE(FlowGrid))
 
+#define FLOW_GRID_POS(x, y) GUINT_TO_POINTER(((guint)(x)<<16 | (guint)(y)) + 1)
+
 enum {
   FLOW_GRID_LABELS = 1,
   FLOW_GRID_ICONS,
@@ -67,16 +69,32 @@ static void flow_grid_get_preferred_height (GtkWidget *self, gint *minimal,
 static void flow_grid_destroy( GtkWidget *self )
 {
   FlowGridPrivate *priv;
+  GPtrArray *children;
 
   g_return_if_fail(IS_FLOW_GRID(self));
   priv = flow_grid_get_instance_private(FLOW_GRID(self));
 
   g_clear_pointer(&priv->dnd_target, gtk_target_entry_free);
-  g_list_free_full(g_steal_pointer(&priv->children),
-      (GDestroyNotify)gtk_widget_destroy);
+  children = priv->children;
+  priv->children = g_ptr_array_new();
+  g_hash_table_remove_all(priv->placement);
+  g_ptr_array_foreach(children, (GFunc)gtk_widget_destroy, NULL);
+  g_ptr_array_unref(children);
+  g_list_free(g_steal_pointer(&priv->fill));
   GTK_WIDGET_CLASS(flow_grid_parent_class)->destroy(self);
 }
 
+static void flow_grid_finalize( GObject *self )
+{
+  FlowGridPrivate *priv;
+
+  priv = flow_grid_get_instance_private(FLOW_GRID(self));
+
+  g_clear_pointer(&priv->children, g_ptr_array_unref);
+  g_clear_pointer(&priv->placement, g_hash_table_destroy);
+  G_OBJECT_CLASS(flow_grid_parent_class)->finalize(self);
+}
+
 static void flow_grid_style_updated ( GtkWidget *self )
 {
   FlowGridPrivate *priv;
@@ -243,6 +261,7 @@ static void flow_grid_class_init ( FlowGridClass *kclass )
 
   G_OBJECT_CLASS(kclass)->get_property = flow_grid_get_property;
   G_OBJECT_CLASS(kclass)->set_property = flow_grid_set_property;
+  G_OBJECT_CLASS(kclass)->finalize = flow_grid_finalize;
   BASE_WIDGET_CLASS(kclass)->mirror = flow_grid_mirror;
 
   g_object_class_install_property(G_OBJECT_CLASS(kclass), FLOW_GRID_LABELS,
@@ -294,6 +313,8 @@ static void flow_grid_init ( FlowGrid *self )
 
   priv->grid = gtk_grid_new();
   gtk_container_add(GTK_CONTAINER(self), priv->grid);
+  priv->children = g_ptr_array_new();
+  priv->placement = g_hash_table_new(g_direct_hash, g_direct_equal);
 
   sig = g_strdup_printf("flow-item-%p", (void *)self);
   priv->dnd_target = gtk_target_entry_new(sig, 0, SFWB_DND_TARGET_FLOW_ITEM);
@@ -329,7 +350,8 @@ static void flow_grid_remove_widget_maybe (GtkWidget *widget, GtkWidget *self)
   g_return_if_fail(IS_FLOW_GRID(self));
   priv = flow_grid_get_instance_private(FLOW_GRID(self));
 
-  if(!g_list_find(priv->children, widget))
+  if(!g_hash_table_contains(priv->placement, widget) &&
+      !g_list_find(priv->fill, widget))
     gtk_container_remove (GTK_CONTAINER(priv->grid), widget);
 }
 
@@ -354,7 +376,10 @@ void flow_grid_add_child ( GtkWidget *self, GtkWidget *child )
   g_return_if_fail(IS_FLOW_GRID(self));
   priv = flow_grid_get_instance_private(FLOW_GRID(self));
 
-  priv->children = g_list_append(priv->children, child);
+  if(g_hash_table_contains(priv->placement, child))
+    return;
+  g_ptr_array_add(priv->children, child);
+  g_hash_table_insert(priv->placement, child, NULL);
   flow_item_set_parent(child, self);
   flow_grid_invalidate(self);
 }
@@ -370,29 +395,106 @@ void flow_grid_delete_child ( GtkWidget *self, void *source )
   if( !(child = flow_grid_find_child(self, source)) )
     return;
 
-  priv->children = g_list_remove(priv->children, child);
+  g_ptr_array_remove(priv->children, child);
+  g_hash_table_remove(priv->placement, child);
   g_object_unref(child);
   flow_grid_invalidate(self);
 }
 
-static void flow_grid_child_position ( GtkGrid *grid, GtkWidget *child,
+/* returns TRUE if the child had to be attached or moved */
+static gboolean flow_grid_child_position ( GtkWidget *self, GtkWidget *child,
     gint x, gint y )
 {
+  FlowGridPrivate *priv;
+  gpointer pos;
+
+  priv = flow_grid_get_instance_private(FLOW_GRID(self));
+  pos = FLOW_GRID_POS(x, y);
+
   if(!gtk_widget_get_parent(child))
-    gtk_grid_attach(GTK_GRID(grid), child, x, y, 1, 1);
-  else
-    gtk_container_child_set(GTK_CONTAINER(grid), child,
+    gtk_grid_attach(GTK_GRID(priv->grid), child, x, y, 1, 1);
+  else if(g_hash_table_lookup(priv->placement, child) != pos)
+    gtk_container_child_set(GTK_CONTAINER(priv->grid), child,
         "left-attach", x,
         "top-attach", y,
         "width", 1,
         "height", 1,
         NULL);
+  else
+    return FALSE;
+
+  g_hash_table_insert(priv->placement, child, pos);
+  return TRUE;
+}
+
+static gint flow_grid_child_compare ( GtkWidget *self, GtkWidget *c1,
+    GtkWidget *c2 )
+{
+  FlowGridPrivate *priv;
+
+  priv = flow_grid_get_instance_private(FLOW_GRID(self));
+
+  if(priv->sort_reverse)
+    return flow_item_compare(c2, c1, self);
+  return flow_item_compare(c1, c2, self);
+}
+
+/* insertion sort: stable and linear when only a few items moved since the
+ * last relayout, which is the common case */
+static void flow_grid_children_sort ( GtkWidget *self )
+{
+  FlowGridPrivate *priv;
+  gpointer child;
+  guint i, j;
+
+  priv = flow_grid_get_instance_private(FLOW_GRID(self));
+
+  for(i=1; i<priv->children->len; i++)
+  {
+    child = g_ptr_array_index(priv->children, i);
+    for(j=i; j>0 && flow_grid_child_compare(self,
+          g_ptr_array_index(priv->children, j-1), child)>0; j--)
+      priv->children->pdata[j] = priv->children->pdata[j-1];
+    priv->children->pdata[j] = child;
+  }
+}
+
+static void flow_grid_fill ( GtkWidget *self, gint start, gint span,
+    gboolean axis_cols )
+{
+  FlowGridPrivate *priv;
+  GtkWidget *label;
+  gint i;
+
+  priv = flow_grid_get_instance_private(FLOW_GRID(self));
+
+  if(start>=span)
+    start = span = 0;
+  if(priv->fill_start == start && priv->fill_span == span &&
+      priv->fill_cols == axis_cols)
+    return;
+
+  g_list_free_full(g_steal_pointer(&priv->fill),
+      (GDestroyNotify)gtk_widget_destroy);
+  priv->fill_start = start;
+  priv->fill_span = span;
+  priv->fill_cols = axis_cols;
+
+  for(i=start; i<span; i++)
+  {
+    label = gtk_label_new("");
+    gtk_grid_attach(GTK_GRID(priv->grid), label,
+        axis_cols? 0 : i, axis_cols? i : 0, 1, 1);
+    priv->fill = g_list_prepend(priv->fill, label);
+  }
 }
 
 gboolean flow_grid_update ( GtkWidget *self )
 {
   FlowGridPrivate *priv;
-  GList *iter;
+  GtkWidget *child;
+  GHashTable *updated;
+  guint n;
   gint count, i, span, rows, cols, dir;
   gboolean axis_cols;
 
@@ -417,18 +519,16 @@ gboolean flow_grid_update ( GtkWidget *self )
       (GtkCallback)flow_grid_remove_widget_maybe, self);
 
   if(priv->sort)
-  {
-    priv->children = g_list_sort_with_data(priv->children,
-        (GCompareDataFunc)flow_item_compare, self);
-    if(priv->sort_reverse)
-      priv->children = g_list_reverse(priv->children);
-  }
+    flow_grid_children_sort(self);
 
   count = 0;
-  for(iter=priv->children; iter; iter=g_list_next(iter))
+  updated = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for(n=0; n<priv->children->len; n++)
   {
-    flow_item_update(iter->data);
-    if(flow_item_get_active(iter->data))
+    child = g_ptr_array_index(priv->children, n);
+    if(flow_item_update(child))
+      g_hash_table_add(updated, child);
+    if(flow_item_get_active(child))
       count++;
   }
 
@@ -441,24 +541,37 @@ gboolean flow_grid_update ( GtkWidget *self )
     span = cols>0? cols : (count/rows) + !!(count%rows);
 
   if(!span)
+  {
+    g_hash_table_destroy(updated);
     return TRUE;
+  }
 
   i = 0;
-  for(iter=priv->children; iter; iter=g_list_next(iter))
-    if(flow_item_get_active(iter->data))
+  for(n=0; n<priv->children->len; n++)
+  {
+    child = g_ptr_array_index(priv->children, n);
+    if(flow_item_get_active(child))
     {
-      flow_grid_child_position(GTK_GRID(priv->grid), iter->data,
-          axis_cols? i/span : i%span, axis_cols? i%span : i/span);
+      /* updated items may have switched state classes */
+      if(flow_grid_child_position(self, child,
+          axis_cols? i/span : i%span, axis_cols? i%span : i/span) ||
+          g_hash_table_contains(updated, child))
+        css_widget_cascade(child, NULL);
       i += 1 + (i%span==span-2 && i/span>=count%span && axis_cols^(rows>0));
     }
-    else if(gtk_widget_get_parent(iter->data) == priv->grid)
-      gtk_container_remove(GTK_CONTAINER(priv->grid), iter->data);
+    else if(gtk_widget_get_parent(child) == priv->grid)
+    {
+      gtk_container_remove(GTK_CONTAINER(priv->grid), child);
+      g_hash_table_insert(priv->placement, child, NULL);
+    }
+  }
+
+  g_hash_table_destroy(updated);
 
   if(FLOW_GRID_GET_CLASS(self)->fill)
-    for(;i<span; i++)
-      gtk_grid_attach(GTK_GRID(priv->grid), gtk_label_new(""),
-          axis_cols? 0 : i, axis_cols? i : 0, 1, 1);
-  css_widget_cascade(self, NULL);
+    flow_grid_fill(self, i, span, axis_cols);
+  css_custom_handle(self);
+  css_custom_handle(priv->grid);
 
   return TRUE;
 }
@@ -466,14 +579,16 @@ gboolean flow_grid_update ( GtkWidget *self )
 guint flow_grid_n_children ( GtkWidget *self, gboolean active )
 {
   FlowGridPrivate *priv;
-  GList *iter;
-  guint n = 0;
+  guint i, n = 0;
 
   g_return_val_if_fail(IS_FLOW_GRID(self),0);
   priv = flow_grid_get_instance_private(FLOW_GRID(self));
 
-  for(iter=priv->children; iter; iter=g_list_next(iter))
-    if(!active || flow_item_get_active(iter->data))
+  if(!active)
+    return priv->children->len;
+
+  for(i=0; i<priv->children->len; i++)
+    if(flow_item_get_active(g_ptr_array_index(priv->children, i)))
       n++;
 
   return n;
@@ -482,19 +597,19 @@ guint flow_grid_n_children ( GtkWidget *self, gboolean active )
 gpointer flow_grid_get_sole_source ( GtkWidget *self )
 {
   FlowGridPrivate *priv;
-  GList *iter;
   gpointer source = NULL;
+  guint i;
 
   g_return_val_if_fail(IS_FLOW_GRID(self), NULL);
   priv = flow_grid_get_instance_private(FLOW_GRID(self));
 
-  for(iter=priv->children; iter; iter=g_list_next(iter))
-    if(flow_item_get_active(iter->data))
+  for(i=0; i<priv->children->len; i++)
+    if(flow_item_get_active(g_ptr_array_index(priv->children, i)))
     {
       if(source)
         return NULL;
       else
-        source = flow_item_get_source(iter->data);
+        source = flow_item_get_source(g_ptr_array_index(priv->children, i));
     }
 
   return source;
@@ -503,32 +618,34 @@ gpointer flow_grid_get_sole_source ( GtkWidget *self )
 GtkWidget *flow_grid_find_child ( GtkWidget *self, gconstpointer source )
 {
   FlowGridPrivate *priv;
-  GList *iter;
+  guint i;
 
   g_return_val_if_fail(IS_FLOW_GRID(self), NULL);
   priv = flow_grid_get_instance_private(FLOW_GRID(self));
 
-  iter = g_list_find_custom(priv->children, source,
-      (GCompareFunc)flow_item_check_source);
-  return iter? iter->data : NULL;
+  for(i=0; i<priv->children->len; i++)
+    if(!flow_item_check_source(g_ptr_array_index(priv->children, i), source))
+      return g_ptr_array_index(priv->children, i);
+  return NULL;
 }
 
 void flow_grid_children_order ( GtkWidget *self, GtkWidget *ref,
     GtkWidget *child, gboolean after )
 {
   FlowGridPrivate *priv;
-  GList *dlist;
+  guint index;
 
   g_return_if_fail(IS_FLOW_GRID(self));
   priv = flow_grid_get_instance_private(FLOW_GRID(self));
 
-  dlist = g_list_find(priv->children, ref);
-  if(!dlist || !g_list_find(priv->children, child))
+  if(ref == child || !g_hash_table_contains(priv->placement, ref) ||
+      !g_hash_table_contains(priv->placement, child))
     return;
 
-  priv->children = g_list_remove(priv->children, child);
-  priv->children = g_list_insert_before(priv->children,
-      after ? g_list_next(dlist) : dlist, child);
+  g_ptr_array_remove(priv->children, child);
+  if(!g_ptr_array_find(priv->children, ref, &index))
+    return;
+  g_ptr_array_insert(priv->children, after? index+1 : index, child);
 
   flow_item_invalidate(child);
   flow_item_invalidate(ref);
@@ -49,7 +49,11 @@ struct _FlowGridPrivate
   gboolean invalid;
   gboolean sort;
   gboolean sort_reverse;
-  GList *children;
+  GPtrArray *children;
+  GHashTable *placement;
+  GList *fill;
+  gint fill_start, fill_span;
+  gboolean fill_cols;
   gint (*comp)( GtkWidget *, GtkWidget *, GtkWidget * );
   GtkTargetEntry *dnd_target;
   GtkWidget *parent;
@@ -112,20 +112,33 @@ static void flow_item_init ( FlowItem *self )
   flow_item_set_active(GTK_WIDGET(self),TRUE);
 }
 
-void flow_item_update ( GtkWidget *self )
+/* returns TRUE if the item was invalidated since the last update */
+gboolean flow_item_update ( GtkWidget *self )
 {
-  g_return_if_fail(IS_FLOW_ITEM(self));
+  FlowItemPrivate *priv;
+  gboolean invalid;
+
+  g_return_val_if_fail(IS_FLOW_ITEM(self), FALSE);
+  priv = flow_item_get_instance_private(FLOW_ITEM(self));
 
+  invalid = priv->invalid;
+  priv->invalid = FALSE;
   if(FLOW_ITEM_GET_CLASS(self)->update)
     FLOW_ITEM_GET_CLASS(self)->update(self);
+
+  return invalid;
 }
 
 void flow_item_invalidate ( GtkWidget *self )
 {
+  FlowItemPrivate *priv;
+
   if(!self)
     return;
 
   g_return_if_fail(IS_FLOW_ITEM(self));
+  priv = flow_item_get_instance_private(FLOW_ITEM(self));
+  priv->invalid = TRUE;
 
   if(FLOW_ITEM_GET_CLASS(self)->invalidate)
     FLOW_ITEM_GET_CLASS(self)->invalidate(self);
@@ -36,13 +36,14 @@ typedef struct _FlowItemPrivate FlowItemPrivate;
 struct _FlowItemPrivate
 {
   gboolean active;
+  gboolean invalid;
   GBinding *store_binding;
   GtkWidget *parent;
 };
 
 GType flow_item_get_type ( void );
 
-void flow_item_update ( GtkWidget *self );
+gboolean flow_item_update ( GtkWidget *self );
 void flow_item_invalidate ( GtkWidget *self );
 void *flow_item_get_source ( GtkWidget *self );
 void flow_item_set_parent ( GtkWidget *self, GtkWidget *parent );
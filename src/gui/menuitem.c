@@ -256,6 +256,30 @@ void menu_item_update_from_app ( GtkWidget *self, GDesktopAppInfo *app )
   }
 }
 
+void menu_item_update_from_entry ( GtkWidget *self,
+    const app_info_entry_t *entry )
+{
+  MenuItemPrivate *priv;
+
+  priv = g_object_get_data(G_OBJECT(self), "menu_item_private");
+  g_return_if_fail(priv);
+
+  g_free(priv->desktop_file);
+  priv->desktop_file = g_strdup(entry->path);
+
+  if( !(priv->flags & MI_LABEL) )
+    gtk_label_set_text_with_mnemonic(GTK_LABEL(priv->label),
+        entry->label? entry->label : entry->id);
+
+  if( !(priv->flags & MI_ICON) && entry->icon)
+  {
+    scale_image_set_image(priv->icon, entry->icon, NULL);
+    css_set_class(priv->icon, "hidden", FALSE);
+  }
+  if( !(priv->flags & MI_TOOLTIP) && entry->comment)
+    gtk_widget_set_tooltip_text(self, entry->comment);
+}
+
 void menu_item_update_from_desktop ( GtkWidget *self, const gchar *desktop_id )
 {
   GDesktopAppInfo *app;
@@ -3,6 +3,7 @@
 
 #include <gtk/gtk.h>
 #include <gio/gdesktopappinfo.h>
+#include "appinfo.h"
 #include "vm/vm.h"
 
 #define DECLARE_MENU_ITEM(T_c, T_u, T_s, T_e, T_p) \
@@ -70,6 +71,8 @@ GtkWidget *menu_item_get ( gchar *id, gboolean create );
 gboolean menu_item_remove ( gchar *id );
 void menu_item_update_from_desktop ( GtkWidget *self, const gchar *desktop_id);
 void menu_item_update_from_app ( GtkWidget *self, GDesktopAppInfo *app);
+void menu_item_update_from_entry ( GtkWidget *self,
+    const app_info_entry_t *entry );
 void menu_item_set_id ( GtkWidget *self, gchar *id );
 gchar *menu_item_get_id ( GtkWidget *self );
 void menu_item_set_label ( GtkWidget *self, const gchar *label );
@@ -58,6 +58,8 @@ void pager_item_update ( GtkWidget *self )
 
   g_object_get(G_OBJECT(priv->pager), "preview", &preview, NULL);
   gtk_widget_set_has_tooltip(priv->button, preview);
+  if(preview)
+    gtk_widget_trigger_tooltip_query(priv->button);
 
   css_set_class(priv->button, "focused", priv->ws->state & WS_STATE_FOCUSED);
   css_set_class(priv->button, "visible", priv->ws->state & WS_STATE_VISIBLE);
@@ -13,20 +13,270 @@
 G_DEFINE_TYPE_WITH_CODE (ScaleImage, scale_image, GTK_TYPE_IMAGE,
     G_ADD_PRIVATE (ScaleImage))
 
-static GHashTable *scaleimage_cache;
+typedef struct _scale_image_cache_entry {
+  gchar *name;
+  GdkPixbuf *pixbuf;
+  cairo_surface_t *surface;
+  gsize size;
+  gint refcount;
+  guint serial;
+} scale_image_cache_entry_t;
+
+static GHashTable *scaleimage_cache, *scaleimage_viewers;
+static GMutex scaleimage_mutex;
+static gsize scaleimage_cache_bytes;
+
+static void scale_image_cache_refresh ( GtkWidget *self );
+
+static void scale_image_cache_entry_free ( scale_image_cache_entry_t *entry )
+{
+  g_clear_pointer(&entry->pixbuf, g_object_unref);
+  g_clear_pointer(&entry->surface, cairo_surface_destroy);
+  g_free(entry->name);
+  g_free(entry);
+}
 
-gboolean scale_image_cache_insert ( gchar *name, GdkPixbuf *pb )
+/* only the pixels of each row are hashed, the padding between rows may be
+ * left uninitialized */
+static gchar *scale_image_cache_hash ( gint meta[4], const guchar *data,
+    gint stride, gsize rowlen )
 {
+  GChecksum *sum;
+  gchar *name;
+  gint i;
+
+  sum = g_checksum_new(G_CHECKSUM_SHA1);
+  g_checksum_update(sum, (guchar *)meta, 4*sizeof(gint));
+  for(i=0; i<meta[1]; i++)
+    g_checksum_update(sum, data + (gsize)i*stride, rowlen);
+  name = g_strconcat("<pixbufcache/>", g_checksum_get_string(sum), NULL);
+  g_checksum_free(sum);
+
+  return name;
+}
+
+static gchar *scale_image_cache_add ( gchar *name, GdkPixbuf *pb,
+    cairo_surface_t *cs, gsize size )
+{
+  scale_image_cache_entry_t *entry;
+
+  g_mutex_lock(&scaleimage_mutex);
   if(!scaleimage_cache)
     scaleimage_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
-        g_free, g_object_unref);
+        NULL, (GDestroyNotify)scale_image_cache_entry_free);
+
+  if( (entry = g_hash_table_lookup(scaleimage_cache, name)) )
+  {
+    entry->refcount++;
+    if(pb)
+      g_object_unref(pb);
+    if(cs)
+      cairo_surface_destroy(cs);
+  }
+  else
+  {
+    entry = g_malloc0(sizeof(scale_image_cache_entry_t));
+    entry->name = g_strdup(name);
+    entry->pixbuf = pb;
+    entry->surface = cs;
+    entry->size = size;
+    entry->refcount = 1;
+    scaleimage_cache_bytes += entry->size;
+    g_hash_table_insert(scaleimage_cache, entry->name, entry);
+    g_debug("pixbuf cache: added %s, %" G_GSIZE_FORMAT " bytes resident",
+        name, scaleimage_cache_bytes);
+  }
+  g_mutex_unlock(&scaleimage_mutex);
 
-  return g_hash_table_insert(scaleimage_cache, g_strdup(name), pb);
+  return name;
 }
 
-gboolean scale_image_cache_remove ( gchar *name )
+/* store a pixbuf (taking ownership) under a name derived from its content.
+ * Identical images share an entry. The returned name holds a reference that
+ * must be dropped with scale_image_cache_unref */
+gchar *scale_image_cache_insert ( GdkPixbuf *pb )
 {
-  return name?g_hash_table_remove(scaleimage_cache, name):FALSE;
+  gint meta[4];
+
+  if(!pb)
+    return NULL;
+
+  meta[0] = gdk_pixbuf_get_width(pb);
+  meta[1] = gdk_pixbuf_get_height(pb);
+  meta[2] = gdk_pixbuf_get_n_channels(pb);
+  meta[3] = gdk_pixbuf_get_has_alpha(pb);
+
+  return scale_image_cache_add(scale_image_cache_hash(meta,
+        gdk_pixbuf_read_pixels(pb), gdk_pixbuf_get_rowstride(pb),
+        (gsize)meta[0] * meta[2]), pb, NULL, gdk_pixbuf_get_byte_length(pb));
+}
+
+/* same as above for an ARGB32 image surface, used as is by ScaleImage */
+gchar *scale_image_cache_insert_surface ( cairo_surface_t *cs )
+{
+  gint meta[4];
+
+  if(!cs)
+    return NULL;
+
+  cairo_surface_flush(cs);
+  meta[0] = cairo_image_surface_get_width(cs);
+  meta[1] = cairo_image_surface_get_height(cs);
+  meta[2] = cairo_image_surface_get_format(cs);
+  meta[3] = -1;
+
+  return scale_image_cache_add(scale_image_cache_hash(meta,
+        cairo_image_surface_get_data(cs), cairo_image_surface_get_stride(cs),
+        (gsize)meta[0] * 4), NULL, cs, (gsize)meta[1] *
+      cairo_image_surface_get_stride(cs));
+}
+
+/* publish an ARGB32 surface (taking ownership) under a fixed name. The
+ * owner may then draw into it and republish it with scale_image_cache_update
+ * rather than hashing a new entry for every change */
+gchar *scale_image_cache_insert_named ( const gchar *name,
+    cairo_surface_t *cs )
+{
+  if(!name || !cs)
+    return NULL;
+
+  scale_image_cache_update(name, cs);
+  return scale_image_cache_add(g_strdup(name), NULL, cs,
+      (gsize)cairo_image_surface_get_height(cs) *
+      cairo_image_surface_get_stride(cs));
+}
+
+/* widgets showing a surface entry, so that updates can be pushed to them.
+ * These are only touched from the main thread */
+static void scale_image_viewer_add ( GtkWidget *self, const gchar *name )
+{
+  GList *list;
+
+  if(!scaleimage_viewers)
+    scaleimage_viewers = g_hash_table_new_full(g_str_hash, g_str_equal,
+        g_free, NULL);
+  list = g_hash_table_lookup(scaleimage_viewers, name);
+  if(!g_list_find(list, self))
+    g_hash_table_insert(scaleimage_viewers, g_strdup(name),
+        g_list_prepend(list, self));
+}
+
+static void scale_image_viewer_remove ( GtkWidget *self, const gchar *name )
+{
+  GList *list;
+
+  if(!scaleimage_viewers ||
+      !(list = g_hash_table_lookup(scaleimage_viewers, name)) )
+    return;
+  if( (list = g_list_remove(list, self)) )
+    g_hash_table_insert(scaleimage_viewers, g_strdup(name), list);
+  else
+    g_hash_table_remove(scaleimage_viewers, name);
+}
+
+/* redraw the widgets showing the entry with the new surface, must be
+ * called from the main thread */
+void scale_image_cache_update ( const gchar *name, cairo_surface_t *cs )
+{
+  scale_image_cache_entry_t *entry;
+  GList *iter;
+  gsize size;
+
+  g_mutex_lock(&scaleimage_mutex);
+  if(scaleimage_cache &&
+      (entry = g_hash_table_lookup(scaleimage_cache, name)) &&
+      entry->surface)
+  {
+    if(entry->surface != cs)
+    {
+      size = (gsize)cairo_image_surface_get_height(cs) *
+        cairo_image_surface_get_stride(cs);
+      cairo_surface_destroy(entry->surface);
+      entry->surface = cairo_surface_reference(cs);
+      scaleimage_cache_bytes += size - entry->size;
+      entry->size = size;
+    }
+    entry->serial++;
+  }
+  g_mutex_unlock(&scaleimage_mutex);
+
+  if(scaleimage_viewers)
+    for(iter=g_hash_table_lookup(scaleimage_viewers, name); iter;
+        iter=g_list_next(iter))
+      scale_image_cache_refresh(iter->data);
+}
+
+/* images already shown by a widget stay alive through the widget's own
+ * pixbuf reference after their entry is evicted */
+void scale_image_cache_unref ( const gchar *name )
+{
+  scale_image_cache_entry_t *entry;
+
+  if(!name || !g_str_has_prefix(name, "<pixbufcache/>"))
+    return;
+
+  g_mutex_lock(&scaleimage_mutex);
+  if(scaleimage_cache &&
+      (entry = g_hash_table_lookup(scaleimage_cache, name)) &&
+      !--entry->refcount)
+  {
+    scaleimage_cache_bytes -= entry->size;
+    g_debug("pixbuf cache: evicted %s, %" G_GSIZE_FORMAT " bytes resident",
+        name, scaleimage_cache_bytes);
+    g_hash_table_remove(scaleimage_cache, name);
+  }
+  g_mutex_unlock(&scaleimage_mutex);
+}
+
+static gboolean scale_image_cache_lookup ( ScaleImagePrivate *priv )
+{
+  scale_image_cache_entry_t *entry;
+  gboolean found = FALSE;
+
+  g_mutex_lock(&scaleimage_mutex);
+  if(scaleimage_cache &&
+      (entry = g_hash_table_lookup(scaleimage_cache, priv->file)) )
+  {
+    g_clear_pointer(&priv->pixbuf, g_object_unref);
+    g_clear_pointer(&priv->source, cairo_surface_destroy);
+    if(entry->surface)
+    {
+      priv->source = cairo_surface_reference(entry->surface);
+      priv->serial = entry->serial;
+      priv->ftype = SI_SURF;
+    }
+    else
+    {
+      priv->pixbuf = g_object_ref(entry->pixbuf);
+      priv->ftype = SI_BUFF;
+    }
+    found = TRUE;
+  }
+  g_mutex_unlock(&scaleimage_mutex);
+
+  return found;
+}
+
+/* redraw a surface entry that was updated since the widget last read it */
+static void scale_image_cache_refresh ( GtkWidget *self )
+{
+  ScaleImagePrivate *priv;
+  scale_image_cache_entry_t *entry;
+  gboolean stale;
+
+  priv = scale_image_get_instance_private(SCALE_IMAGE(self));
+
+  g_mutex_lock(&scaleimage_mutex);
+  stale = scaleimage_cache &&
+    (entry = g_hash_table_lookup(scaleimage_cache, priv->file)) &&
+    entry->serial != priv->serial;
+  g_mutex_unlock(&scaleimage_mutex);
+
+  if(!stale || !scale_image_cache_lookup(priv))
+    return;
+  g_clear_pointer(&priv->cs, cairo_surface_destroy);
+  g_clear_pointer(&priv->shadow, cairo_surface_destroy);
+  gtk_widget_queue_draw(self);
 }
 
 static void scale_image_get_preferred_width ( GtkWidget *self, gint *m,
@@ -149,6 +399,46 @@ static void scale_image_blur_render ( GtkWidget *self )
   }
 }
 
+/* draw a cached image surface at w x h pixels, keeping its aspect ratio */
+static void scale_image_surface_from_source ( GtkWidget *self, gint w,
+    gint h )
+{
+  ScaleImagePrivate *priv;
+  GdkWindow *win;
+  cairo_t *cr;
+  gdouble sw, sh, aspect;
+  gint scale;
+
+  priv = scale_image_get_instance_private(SCALE_IMAGE(self));
+
+  sw = cairo_image_surface_get_width(priv->source);
+  sh = cairo_image_surface_get_height(priv->source);
+  aspect = sw / sh;
+  if((gdouble)w/h > aspect)
+    w = MAX(1, h * aspect);
+  else if((gdouble)w/h < aspect)
+    h = MAX(1, w / aspect);
+
+  g_clear_pointer(&priv->cs, cairo_surface_destroy);
+  g_clear_pointer(&priv->shadow, cairo_surface_destroy);
+
+  priv->cs = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+  cr = cairo_create(priv->cs);
+  cairo_scale(cr, w / sw, h / sh);
+  cairo_set_source_surface(cr, priv->source, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+
+  win = gtk_widget_get_window(self);
+  scale = win? gdk_window_get_scale_factor(win) : 1;
+  cairo_surface_set_device_scale(priv->cs, scale, scale);
+
+  priv->width = w;
+  priv->height = h;
+  scale_image_blur_render(self);
+}
+
 static void scale_image_surface_update ( GtkWidget *self, gint w, gint h )
 {
   ScaleImagePrivate *priv;
@@ -161,6 +451,12 @@ static void scale_image_surface_update ( GtkWidget *self, gint w, gint h )
   priv = scale_image_get_instance_private(SCALE_IMAGE(self));
   priv->fallback = FALSE;
 
+  if(priv->ftype == SI_SURF && priv->source)
+  {
+    scale_image_surface_from_source(self, w, h);
+    return;
+  }
+
   if(priv->ftype == SI_ICON)
     buf =  gtk_icon_theme_load_icon(priv->theme, priv->fname, MIN(w, h), 0,
         NULL);
@@ -347,10 +643,13 @@ static void scale_image_clear ( GtkWidget *self )
 
   priv = scale_image_get_instance_private(SCALE_IMAGE(self));
 
+  if(priv->ftype == SI_SURF && priv->file)
+    scale_image_viewer_remove(self, priv->file);
   g_clear_pointer(&priv->fname, g_free);
   g_clear_pointer(&priv->file, g_free);
   g_clear_pointer(&priv->extra, g_free);
   g_clear_pointer(&priv->pixbuf, g_object_unref);
+  g_clear_pointer(&priv->source, cairo_surface_destroy);
   g_clear_pointer(&priv->cs, cairo_surface_destroy);
   g_clear_pointer(&priv->shadow, cairo_surface_destroy);
   g_clear_pointer(&priv->shadow_color, gdk_rgba_free);
@@ -467,11 +766,11 @@ static gboolean scale_image_set ( GtkWidget *self )
     return TRUE;
   }
 
-  if(g_str_has_prefix(priv->file, "<pixbufcache/>") && scaleimage_cache &&
-      (buf = g_hash_table_lookup(scaleimage_cache, priv->file)) )
+  if(g_str_has_prefix(priv->file, "<pixbufcache/>") &&
+      scale_image_cache_lookup(priv))
   {
-    priv->pixbuf = g_object_ref(buf);
-    priv->ftype = SI_BUFF;
+    if(priv->ftype == SI_SURF)
+      scale_image_viewer_add(self, priv->file);
     return TRUE;
   }
 
@@ -528,7 +827,11 @@ gboolean scale_image_set_image ( GtkWidget *self, const gchar *image,
     return FALSE;
 
   if( !g_strcmp0(priv->file, image) && !g_strcmp0(priv->extra, extra) )
+  {
+    if(priv->ftype == SI_SURF)
+      scale_image_cache_refresh(self);
     return (priv->ftype != SI_NONE);
+  }
 
   scale_image_clear(self);
   priv->file = g_strdup(image);
@@ -549,6 +852,7 @@ static void scale_image_init ( ScaleImage *self )
   priv->file = NULL;
   priv->fname = NULL;
   priv->pixbuf = NULL;
+  priv->source = NULL;
   priv->cs = NULL;
   priv->width = 0;
   priv->height = 0;
@@ -40,7 +40,9 @@ struct _ScaleImagePrivate
   gchar *fname;
   GtkIconTheme *theme;
   GdkPixbuf *pixbuf;
+  cairo_surface_t *source;
   cairo_surface_t *cs, *shadow;
+  guint serial;
 };
 
 enum {
@@ -48,14 +50,19 @@ enum {
   SI_ICON,
   SI_FILE,
   SI_BUFF,
-  SI_DATA
+  SI_DATA,
+  SI_SURF
 };
 
 GType scale_image_get_type ( void );
 gboolean scale_image_set_image ( GtkWidget *, const gchar *, gchar *);
 GtkWidget *scale_image_new();
 int scale_image_update ( GtkWidget *widget );
-gboolean scale_image_cache_insert ( gchar *name, GdkPixbuf *pb );
-gboolean scale_image_cache_remove ( gchar *name );
+gchar *scale_image_cache_insert ( GdkPixbuf *pb );
+gchar *scale_image_cache_insert_surface ( cairo_surface_t *cs );
+gchar *scale_image_cache_insert_named ( const gchar *name,
+    cairo_surface_t *cs );
+void scale_image_cache_update ( const gchar *name, cairo_surface_t *cs );
+void scale_image_cache_unref ( const gchar *name );
 
 #endif
@@ -112,11 +112,11 @@ static gboolean taskbar_item_check ( GtkWidget *self )
     g_object_get(G_OBJECT(taskbar), "group", &group, NULL);
     if(group != TASKBAR_SHELL_API_POPUP && group != TASKBAR_SHELL_API_DEFAULT)
       return FALSE;
-    for(iter=wintree_get_list(); iter; iter=g_list_next(iter))
+    for(iter=wintree_from_appid(priv->win->appid); iter;
+        iter=g_list_next(iter))
     {
       win = iter->data;
-      if(win != priv->win && !g_strcmp0(win->appid, priv->win->appid) &&
-          filter_window_check(taskbar, win) )
+      if(win != priv->win && filter_window_check(taskbar, win) )
         return FALSE;
     }
     return TRUE;
@@ -206,6 +206,13 @@ static void tray_item_invalidate ( GtkWidget *self )
   priv->invalid = TRUE;
 }
 
+static void tray_item_icon_allocate ( GtkWidget *icon, GtkAllocation *alloc,
+    sni_item_t *sni )
+{
+  sni_item_set_icon_size(sni, MIN(alloc->width, alloc->height) *
+      gtk_widget_get_scale_factor(icon));
+}
+
 static void tray_item_class_init ( TrayItemClass *kclass )
 {
   BASE_WIDGET_CLASS(kclass)->action_exec = tray_item_action_exec;
@@ -240,6 +247,8 @@ GtkWidget *tray_item_new( sni_item_t *sni, GtkWidget *tray )
   flow_grid_child_dnd_enable(tray, self, priv->button);
 
   priv->icon = scale_image_new();
+  g_signal_connect(G_OBJECT(priv->icon), "size-allocate",
+      G_CALLBACK(tray_item_icon_allocate), sni);
   priv->label = gtk_label_new("");
   priv->sni = sni;
   priv->tray = tray;
@@ -12,8 +12,23 @@
 #define hypr_ipc_parse_id(x, y) GSIZE_TO_POINTER(str_ascii_toull(x, y, 16))
 #define hypr_ipc_parse_ws(x, y) GSIZE_TO_POINTER(str_ascii_toll(x, y, 10))
 
-static gchar *ipc_sockaddr;
+typedef struct _hypr_client {
+  gpointer id;
+  gpointer wsid;
+  GdkRectangle rect;
+} hypr_client_t;
+
+typedef struct _hypr_query {
+  const gchar *cmd;
+  void (*handler)( json_object *json );
+  gboolean busy, stale;
+  guint handle;
+} hypr_query_t;
+
+static json_conn_t *hypr_conn;
 static gchar **hypr_layouts, *hypr_layout_str;
+static GHashTable *hypr_ws_monitors, *hypr_monitors, *hypr_place_pending;
+static GArray *hypr_clients;
 
 static gpointer hypr_ipc_window_id ( json_object *json )
 {
@@ -32,33 +47,6 @@ static gpointer hypr_ipc_workspace_id ( json_object *json )
   return NULL;
 }
 
-static gboolean hypr_ipc_request ( gchar *addr, gchar *command, json_object **json )
-{
-  gint sock;
-
-  if(!command)
-    return FALSE;
-
-  if( (sock = socket_connect(addr, 1000))==-1 )
-  {
-    g_debug("hypr: can't open socket");
-    return FALSE;
-  }
-
-  if(write(sock, command, strlen(command))==-1)
-  {
-    g_debug("hypr: can't write to socket");
-    close(sock);
-    return FALSE;
-  }
-
-  if(json)
-    *json = recv_json(sock, -1);
-
-  close(sock);
-  return TRUE;
-}
-
 static void hypr_ipc_command ( gchar *cmd, ... )
 {
   va_list args;
@@ -70,37 +58,144 @@ static void hypr_ipc_command ( gchar *cmd, ... )
   va_start(args, cmd);
   buf = g_strdup_vprintf(cmd, args);
   g_debug("hypr command: %s", buf);
-  if(!hypr_ipc_request (ipc_sockaddr, buf, NULL))
+  if(!json_conn_send(hypr_conn, NULL, buf, strlen(buf), NULL, NULL))
     g_debug("hypr: unable to send command");
   g_free(buf);
   va_end(args);
 }
 
-static gchar *hypr_ipc_workspace_data ( workspace_t *ws, gchar *field )
+static void hypr_ipc_query_send ( hypr_query_t *query );
+
+static void hypr_ipc_query_cb ( json_object *json, hypr_query_t *query )
 {
-  json_object *json, *ptr;
-  gint i;
-  gchar *res = NULL;
+  query->busy = FALSE;
+  if(json)
+    query->handler(json);
+  if(query->stale)
+    hypr_ipc_query_send(query);
+}
+
+/* only one reply per query is in flight, plus one more if anything changed
+ * after it was requested */
+static void hypr_ipc_query_send ( hypr_query_t *query )
+{
+  query->stale = query->busy;
+  if(!query->busy)
+    query->busy = json_conn_send(hypr_conn, NULL, query->cmd,
+        strlen(query->cmd), (json_reply_cb)hypr_ipc_query_cb, query);
+}
 
-  if(!ws || !hypr_ipc_request(ipc_sockaddr, "j/workspaces", &json) || !json)
-    return NULL;
+static gboolean hypr_ipc_query_idle ( hypr_query_t *query )
+{
+  query->handle = 0;
+  hypr_ipc_query_send(query);
+  return G_SOURCE_REMOVE;
+}
 
-  if(json_object_is_type(json, json_type_array))
-    for(i=0; i<json_object_array_length(json); i++)
+/* a burst of events coalesces into a single query */
+static void hypr_ipc_query_schedule ( hypr_query_t *query )
+{
+  if(!query->handle)
+    query->handle = g_idle_add((GSourceFunc)hypr_ipc_query_idle, query);
+}
+
+static void hypr_ipc_place_flush ( void );
+static GdkRectangle hypr_ipc_get_output_geom ( gpointer wsid );
+
+static void hypr_ipc_workspace_monitor_set ( gpointer wsid,
+    const gchar *monitor )
+{
+  if(monitor)
+    g_hash_table_insert(hypr_ws_monitors, wsid, g_strdup(monitor));
+  else
+    g_hash_table_remove(hypr_ws_monitors, wsid);
+}
+
+static gboolean hypr_ipc_window_outputs ( window_t *win )
+{
+  const gchar *monitor;
+
+  if(!win->workspace ||
+      !(monitor = g_hash_table_lookup(hypr_ws_monitors, win->workspace->id)) ||
+      g_list_find_custom(win->outputs, monitor, (GCompareFunc)g_strcmp0))
+    return FALSE;
+
+  g_list_free_full(win->outputs, g_free);
+  win->outputs = g_list_prepend(NULL, g_strdup(monitor));
+  return TRUE;
+}
+
+/* refresh the local workspace -> monitor mirror, creating any workspaces
+ * we haven't seen yet */
+static void hypr_ipc_workspaces_handle ( json_object *json )
+{
+  json_object *ptr;
+  workspace_t *ws;
+  GList *iter;
+  gint i, wid;
+
+  if(!json_object_is_type(json, json_type_array))
+    return;
+  for(i=0; i<json_object_array_length(json); i++)
+  {
+    ptr = json_object_array_get_idx(json, i);
+    wid = json_int_by_name(ptr, "id", -1);
+    if(wid<0)
+      continue;
+    if(!workspace_from_id(GINT_TO_POINTER(wid)))
     {
-      ptr = json_object_array_get_idx(json, i);
-      if(ws->id==GINT_TO_POINTER(json_int_by_name(ptr, "id", 0)))
-        res = g_strdup(json_string_by_name(ptr, field));
+      ws = workspace_new(GINT_TO_POINTER(wid));
+      workspace_set_name(ws, json_string_by_name(ptr, "name"));
     }
-  json_object_put(json);
-  return res;
+    hypr_ipc_workspace_monitor_set(GINT_TO_POINTER(wid),
+        json_string_by_name(ptr, "monitor"));
+  }
+
+  for(iter=wintree_get_list(); iter; iter=g_list_next(iter))
+    if(hypr_ipc_window_outputs(iter->data))
+      wintree_commit(iter->data);
+  hypr_ipc_place_flush();
+}
+
+static hypr_query_t hypr_workspaces_query = {
+  .cmd = "j/workspaces",
+  .handler = hypr_ipc_workspaces_handle,
+};
+
+static void hypr_ipc_window_set_workspace ( window_t *win, gpointer wsid )
+{
+  win->state &= ~WS_MINIMIZED;
+  wintree_set_workspace(win->uid, wsid);
+  if(!win->workspace)
+    return;
+  if(!g_hash_table_contains(hypr_ws_monitors, win->workspace->id))
+    hypr_ipc_query_schedule(&hypr_workspaces_query);
+  else
+    hypr_ipc_window_outputs(win);
+}
+
+static gboolean hypr_ipc_window_geom ( json_object *json, GdkRectangle *res )
+{
+  json_object *ptr;
+
+  if(!json_object_object_get_ex(json, "at", &ptr) || !ptr)
+    return FALSE;
+  res->x = json_object_get_int(json_object_array_get_idx(ptr, 0));
+  res->y = json_object_get_int(json_object_array_get_idx(ptr, 1));
+  if(!json_object_object_get_ex(json, "size", &ptr) || !ptr)
+    return FALSE;
+  res->width = json_object_get_int(json_object_array_get_idx(ptr, 0));
+  res->height = json_object_get_int(json_object_array_get_idx(ptr, 1));
+
+  return TRUE;
 }
 
-static void hypr_ipc_handle_window ( json_object *obj )
+static void hypr_ipc_handle_window ( json_object *obj, gboolean create )
 {
   window_t *win;
   gpointer id;
-  gchar *monitor;
+  gboolean floating;
+  gint64 pid;
 
   id = hypr_ipc_window_id(obj);
   if(!id)
@@ -108,6 +203,10 @@ static void hypr_ipc_handle_window ( json_object *obj )
 
   if( !(win = wintree_from_id(id)) )
   {
+    /* a refresh reply may race a closewindow event, only the initial
+     * client list is allowed to add windows */
+    if(!create)
+      return;
     win = wintree_window_init();
     win->uid = id;
     win->pid = json_int_by_name(obj, "pid", 0);
@@ -121,45 +220,195 @@ static void hypr_ipc_handle_window ( json_object *obj )
     wintree_log(id);
   }
   else
+  {
     wintree_set_title(id, json_string_by_name(obj, "title"));
+    /* windows built from an openwindow event don't have a pid yet */
+    if( (pid = json_int_by_name(obj, "pid", win->pid)) != win->pid )
+    {
+      win->pid = pid;
+      wintree_window_append(win);
+    }
+    floating = json_bool_by_name(obj, "floating", win->floating);
+    if(floating != win->floating)
+      wintree_set_float(id, floating);
+  }
 
   if(hypr_ipc_workspace_id(obj)==GINT_TO_POINTER(-99))
     win->state |= WS_MINIMIZED;
   else
+    hypr_ipc_window_set_workspace(win, hypr_ipc_workspace_id(obj));
+}
+
+/* update windows from a j/clients reply and rebuild the geometry mirror,
+ * keeping the compositor's client order. Pagers showing a workspace whose
+ * windows moved are redrawn */
+static void hypr_ipc_clients_mirror ( json_object *json, gboolean create )
+{
+  json_object *iter;
+  hypr_client_t client, *old;
+  GArray *prev;
+  guint i;
+
+  prev = hypr_clients;
+  hypr_clients = g_array_new(FALSE, FALSE, sizeof(hypr_client_t));
+  for(i=0; i<json_object_array_length(json); i++)
   {
-    win->state &= ~WS_MINIMIZED;
-    wintree_set_workspace(win->uid, hypr_ipc_workspace_id(obj));
-    monitor = hypr_ipc_workspace_data(win->workspace, "monitor");
-    if(!g_list_find_custom(win->outputs, monitor, (GCompareFunc)g_strcmp0))
+    iter = json_object_array_get_idx(json, i);
+    hypr_ipc_handle_window(iter, create);
+    if( !(client.id = hypr_ipc_window_id(iter)) ||
+        !hypr_ipc_window_geom(iter, &client.rect) )
+      continue;
+    client.wsid = hypr_ipc_workspace_id(iter);
+    g_array_append_val(hypr_clients, client);
+  }
+
+  for(i=0; i<MAX(prev->len, hypr_clients->len); i++)
+  {
+    old = i<prev->len? &g_array_index(prev, hypr_client_t, i) : NULL;
+    if(i<hypr_clients->len)
     {
-      g_list_free_full(win->outputs, g_free);
-      win->outputs = g_list_prepend(NULL, monitor);
+      client = g_array_index(hypr_clients, hypr_client_t, i);
+      if(old && old->id==client.id && old->wsid==client.wsid &&
+          gdk_rectangle_equal(&old->rect, &client.rect))
+        continue;
+      workspace_invalidate(workspace_from_id(client.wsid));
     }
-    else
-      g_free(monitor);
+    if(old)
+      workspace_invalidate(workspace_from_id(old->wsid));
   }
+  g_array_unref(prev);
 }
 
-static gboolean hypr_ipc_get_clients ( gpointer *uid )
+static hypr_client_t *hypr_ipc_client_lookup ( gpointer id )
 {
-  json_object *json, *ptr;
-  gpointer id;
-  gint i;
+  guint i;
 
-  if(!hypr_ipc_request(ipc_sockaddr, "j/clients", &json) || !json)
-    return FALSE;
-  if( json_object_is_type(json, json_type_array) )
-    for(i=0; i<json_object_array_length(json); i++)
+  for(i=0; i<hypr_clients->len; i++)
+    if(g_array_index(hypr_clients, hypr_client_t, i).id == id)
+      return &g_array_index(hypr_clients, hypr_client_t, i);
+  return NULL;
+}
+
+static void hypr_ipc_client_remove ( gpointer id )
+{
+  guint i;
+
+  for(i=0; i<hypr_clients->len; i++)
+    if(g_array_index(hypr_clients, hypr_client_t, i).id == id)
     {
-      ptr = json_object_array_get_idx(json, i);
-      if( (id = hypr_ipc_window_id(ptr)) && (!uid || uid == id))
-        hypr_ipc_handle_window(ptr);
+      g_array_remove_index(hypr_clients, i);
+      return;
     }
-  json_object_put(json);
+}
+
+/* a new window stays pending until both its own geometry and the output
+ * of its workspace are known */
+static gboolean hypr_ipc_place_pending ( gpointer wid, gpointer v,
+    gpointer d )
+{
+  GdkRectangle window;
+  window_t *win;
+
+  if(!hypr_ipc_client_lookup(wid))
+    return FALSE;
+  if( !(win = wintree_from_id(wid)) || !win->workspace )
+    return TRUE;
+  if(hypr_ipc_get_output_geom(win->workspace->id).width<0)
+    return FALSE;
 
+  if(wintree_placer_calc(wid, &window))
+    hypr_ipc_command("dispatch movewindowpixel exact %d %d,address:0x%lx",
+      window.x, window.y, GPOINTER_TO_SIZE(wid));
   return TRUE;
 }
 
+static void hypr_ipc_place_flush ( void )
+{
+  g_hash_table_foreach_remove(hypr_place_pending, hypr_ipc_place_pending,
+      NULL);
+}
+
+static void hypr_ipc_clients_handle ( json_object *json )
+{
+  if(!json_object_is_type(json, json_type_array))
+    return;
+  hypr_ipc_clients_mirror(json, FALSE);
+  hypr_ipc_place_flush();
+}
+
+/* the client mirror is kept from events, a full refresh is only needed
+ * when a new window can't be looked up on its own */
+static hypr_query_t hypr_clients_query = {
+  .cmd = "j/clients",
+  .handler = hypr_ipc_clients_handle,
+};
+
+static void hypr_ipc_window_open_cb ( json_object *json, gpointer id )
+{
+  hypr_client_t client;
+
+  if(!g_hash_table_contains(hypr_place_pending, id))
+    return;
+
+  if(!json || hypr_ipc_window_id(json) != id ||
+      !hypr_ipc_window_geom(json, &client.rect))
+  {
+    hypr_ipc_query_schedule(&hypr_clients_query);
+    return;
+  }
+
+  hypr_ipc_handle_window(json, FALSE);
+  hypr_ipc_client_remove(id);
+  client.id = id;
+  client.wsid = hypr_ipc_workspace_id(json);
+  g_array_append_val(hypr_clients, client);
+  hypr_ipc_place_flush();
+}
+
+/* openwindow>>ADDRESS,WORKSPACE,CLASS,TITLE carries everything but the pid,
+ * floating state and geometry. A freshly mapped window is normally focused,
+ * so these come from the single object activewindow reply. The full client
+ * list is only fetched if another window took the focus meanwhile */
+static void hypr_ipc_window_open ( gchar *data )
+{
+  workspace_t *ws;
+  window_t *win;
+  gchar **fields;
+  gpointer id;
+
+  fields = g_strsplit(data, ",", 4);
+  if(g_strv_length(fields)<4 || !(id = hypr_ipc_parse_id(fields[0], NULL)) ||
+      wintree_from_id(id))
+  {
+    g_strfreev(fields);
+    return;
+  }
+
+  win = wintree_window_init();
+  win->uid = id;
+  wintree_window_append(win);
+  wintree_set_app_id(id, fields[2]);
+  wintree_set_title(id, fields[3]);
+  if(g_str_has_prefix(fields[1], "special"))
+    win->state |= WS_MINIMIZED;
+  else if( (ws = workspace_from_name(fields[1])) )
+    hypr_ipc_window_set_workspace(win, ws->id);
+  wintree_log(id);
+  g_strfreev(fields);
+
+  g_hash_table_add(hypr_place_pending, id);
+  if(!json_conn_send(hypr_conn, NULL, "j/activewindow", 14,
+        (json_reply_cb)hypr_ipc_window_open_cb, id))
+    g_hash_table_remove(hypr_place_pending, id);
+}
+
+static void hypr_ipc_window_close ( gpointer id )
+{
+  g_hash_table_remove(hypr_place_pending, id);
+  hypr_ipc_client_remove(id);
+  wintree_window_delete(id);
+}
+
 static void hypr_ipc_handle_focus ( gchar *data )
 {
   gpointer id;
@@ -201,6 +450,7 @@ static void hypr_ipc_handle_urgent ( gchar *data )
 
 static void hypr_ipc_track_workspace ( gchar *event )
 {
+  hypr_client_t *client;
   window_t *win;
   gpointer id;
   gint wsid;
@@ -217,131 +467,129 @@ static void hypr_ipc_track_workspace ( gchar *event )
     win->state &= ~WS_MINIMIZED;
     wintree_set_workspace(id, GINT_TO_POINTER(wsid));
   }
+  if( (client = hypr_ipc_client_lookup(id)) )
+    client->wsid = GINT_TO_POINTER(wsid);
   wintree_commit(win);
 }
 
-static GdkRectangle hypr_ipc_get_output_geom ( gpointer wsid )
+static void hypr_ipc_monitors_handle ( json_object *json )
 {
-  json_object *json, *iter;
+  json_object *iter;
+  GdkRectangle *rect;
+  const gchar *name;
   gint i, scale;
-  gchar *monitor = NULL;
-  GdkRectangle res;
-
-  res.x = -1;
-  res.y = -1;
-  res.width = -1;
-  res.height = -1;
-  if(!hypr_ipc_request(ipc_sockaddr, "j/workspaces", &json) || !json)
-    return res;
-  if( json_object_is_type(json, json_type_array) )
-    for(i=0; i<json_object_array_length(json); i++)
-    {
-      iter = json_object_array_get_idx(json, i);
-      if(json_int_by_name(iter, "id", -1) == GPOINTER_TO_INT(wsid))
-        monitor = g_strdup(json_string_by_name(iter, "monitor"));
-    }
-  json_object_put(json);
-  if(!monitor)
-    return res;
-  if(hypr_ipc_request(ipc_sockaddr, "j/monitors", &json) && json)
-    if( json_object_is_type(json, json_type_array) )
-      for(i=0; i<json_object_array_length(json); i++)
-      {
-        iter = json_object_array_get_idx(json, i);
-        if(!g_strcmp0(monitor, json_string_by_name(iter, "name")))
-        {
-          scale = json_int_by_name(iter, "scale", 1);
-          res.width = json_int_by_name(iter, "width", 0) / scale;
-          res.height = json_int_by_name(iter, "height", 0) / scale;
-        }
-      }
-  json_object_put(json);
-  g_free(monitor);
-  return res;
+
+  if(!json_object_is_type(json, json_type_array))
+    return;
+  g_hash_table_remove_all(hypr_monitors);
+  for(i=0; i<json_object_array_length(json); i++)
+  {
+    iter = json_object_array_get_idx(json, i);
+    if( !(name = json_string_by_name(iter, "name")) )
+      continue;
+    scale = MAX(json_int_by_name(iter, "scale", 1), 1);
+    rect = g_malloc(sizeof(GdkRectangle));
+    rect->x = -1;
+    rect->y = -1;
+    rect->width = json_int_by_name(iter, "width", 0) / scale;
+    rect->height = json_int_by_name(iter, "height", 0) / scale;
+    g_hash_table_insert(hypr_monitors, g_strdup(name), rect);
+  }
+  hypr_ipc_place_flush();
 }
 
-static gboolean hypr_ipc_window_geom ( json_object *json, GdkRectangle *res )
-{
-  json_object *ptr;
+static hypr_query_t hypr_monitors_query = {
+  .cmd = "j/monitors",
+  .handler = hypr_ipc_monitors_handle,
+};
 
-  if(!json_object_object_get_ex(json, "at", &ptr) || !ptr)
-    return FALSE;
-  res->x = json_object_get_int(json_object_array_get_idx(ptr, 0));
-  res->y = json_object_get_int(json_object_array_get_idx(ptr, 1));
-  if(!json_object_object_get_ex(json, "size", &ptr) || !ptr)
-    return FALSE;
-  res->width = json_object_get_int(json_object_array_get_idx(ptr, 0));
-  res->height = json_object_get_int(json_object_array_get_idx(ptr, 1));
+/* a miss in either mirror is fetched in the background. Pending windows
+ * are placed once the reply is in */
+static GdkRectangle hypr_ipc_get_output_geom ( gpointer wsid )
+{
+  GdkRectangle *rect, res = { -1, -1, -1, -1 };
+  const gchar *monitor;
 
-  return TRUE;
+  if( !(monitor = g_hash_table_lookup(hypr_ws_monitors, wsid)) )
+    hypr_ipc_query_schedule(&hypr_workspaces_query);
+  else if( !(rect = g_hash_table_lookup(hypr_monitors, monitor)) )
+    hypr_ipc_query_schedule(&hypr_monitors_query);
+  else
+    res = *rect;
+  return res;
 }
 
 static guint hypr_ipc_get_geom ( gpointer wid, GdkRectangle *place,
     gpointer wsid, GdkRectangle **wins, GdkRectangle *space, gint *focus )
 {
-  json_object *json, *iter;
-  gint i, n=0;
+  hypr_client_t *client;
+  guint i;
+  gint n=0;
 
   *space = hypr_ipc_get_output_geom(wsid);
   if(space->width<0)
     return 0;
-  if(!hypr_ipc_request(ipc_sockaddr, "j/clients", &json) || !json)
-    return 0;
-  if( json_object_is_type(json, json_type_array) )
+
+  /* tiled windows move without an event, the reply redraws the pager if
+   * any of them did */
+  if(!wid)
+    hypr_ipc_query_schedule(&hypr_clients_query);
+
+  *wins = g_malloc(sizeof(GdkRectangle)*hypr_clients->len);
+  for(i=0; i<hypr_clients->len; i++)
   {
-    *wins = g_malloc(sizeof(GdkRectangle)*json_object_array_length(json));
-    for(i=0; i<json_object_array_length(json); i++)
+    client = &g_array_index(hypr_clients, hypr_client_t, i);
+    if(client->wsid!=wsid)
+      continue;
+    if(!wid || client->id!=wid)
     {
-      iter = json_object_array_get_idx(json, i);
-      if(hypr_ipc_workspace_id(iter)==wsid)
-      {
-        if(!wid || hypr_ipc_window_id(iter)!=wid)
-        {
-          hypr_ipc_window_geom(iter, &((*wins)[n]));
-          if(hypr_ipc_window_id(iter)==wintree_get_focus())
-            *focus = n;
-          n++;
-        }
-        else if(place)
-          hypr_ipc_window_geom(iter, place);
-      }
+      (*wins)[n] = client->rect;
+      if(client->id==wintree_get_focus())
+        *focus = n;
+      n++;
     }
+    else if(place)
+      *place = client->rect;
   }
-  json_object_put(json);
   return n;
 }
 
-static void hypr_ipc_window_place ( gpointer wid )
+static void hypr_ipc_layouts_cb ( json_object *json, gpointer data )
 {
-  GdkRectangle window;
+  json_object *keyboards, *iter;
+  const gchar *str;
+  gint i;
 
-  if(wintree_placer_calc(wid, &window))
-    hypr_ipc_command("dispatch movewindowpixel exact %d %d,address:0x%lx",
-      window.x, window.y, GPOINTER_TO_SIZE(wid));
+  if(!json || !json_object_object_get_ex(json, "keyboards", &keyboards))
+    return;
+  for(i=0; i<json_object_array_length(keyboards); i++)
+    if( (iter = json_object_array_get_idx(keyboards, i)) )
+      if(json_bool_by_name(iter, "main", FALSE))
+        if( (str = json_string_by_name(iter, "layout")) )
+        if(g_strcmp0(hypr_layout_str, str))
+        {
+          str_assign(&hypr_layout_str, g_strdup(str));
+          g_clear_pointer(&hypr_layouts, g_strfreev);
+          hypr_layouts = g_strsplit(str, ", ", 0);
+          input_layout_list_set(hypr_layouts);
+        }
 }
 
-static void hypr_ipc_pager_populate( void )
+static void hypr_ipc_populate_clients ( json_object *json, gpointer data )
 {
-  json_object *json, *ptr, *iter;
-  gint i, wid;
+  if(json && json_object_is_type(json, json_type_array))
+    hypr_ipc_clients_mirror(json, TRUE);
+}
+
+static void hypr_ipc_populate_monitors ( json_object *json, gpointer data )
+{
+  json_object *ptr, *iter;
   workspace_t *ws;
+  gint i, wid;
 
-  if(!hypr_ipc_request(ipc_sockaddr, "j/workspaces", &json) || !json)
-    return;
-  if(json_object_is_type(json, json_type_array))
-    for(i=0; i<json_object_array_length(json); i++)
-    {
-      ptr = json_object_array_get_idx(json, i);
-      wid = json_int_by_name(ptr, "id", -1);
-      if(wid>=0 && !workspace_from_id(GINT_TO_POINTER(wid)))
-      {
-        ws = workspace_new(GINT_TO_POINTER(wid));
-        workspace_set_name(ws, json_string_by_name(ptr, "name"));
-      }
-    }
-  json_object_put(json);
-  if(!hypr_ipc_request(ipc_sockaddr, "j/monitors", &json) || !json)
+  if(!json)
     return;
+  hypr_ipc_monitors_handle(json);
   if(json_object_is_type(json, json_type_array))
     for(i=0; i<json_object_array_length(json); i++)
     {
@@ -357,30 +605,19 @@ static void hypr_ipc_pager_populate( void )
         }
       }
     }
-  json_object_put(json);
 }
 
-static void hypr_ipc_layouts_get ( void )
+/* clients and monitors refer to workspaces, so request them once the
+ * workspace list is in */
+static void hypr_ipc_populate ( json_object *json, gpointer data )
 {
-  json_object *json, *keyboards, *iter;
-  const gchar *str;
-  gint i;
-
-  if(!hypr_ipc_request(ipc_sockaddr, "j/devices", &json) || !json)
-    return;
-  if(!json_object_object_get_ex(json, "keyboards", &keyboards))
-    return;
-  for(i=0; i<json_object_array_length(keyboards); i++)
-    if( (iter = json_object_array_get_idx(keyboards, i)) )
-      if(json_bool_by_name(iter, "main", FALSE))
-        if( (str = json_string_by_name(iter, "layout")) )
-        if(g_strcmp0(hypr_layout_str, str))
-        {
-          str_assign(&hypr_layout_str, g_strdup(str));
-          g_clear_pointer(&hypr_layouts, g_strfreev);
-          hypr_layouts = g_strsplit(str, ", ", 0);
-          input_layout_list_set(hypr_layouts);
-        }
+  if(json)
+    hypr_ipc_workspaces_handle(json);
+  json_conn_send(hypr_conn, NULL, "j/clients", 9, hypr_ipc_populate_clients,
+      NULL);
+  json_conn_send(hypr_conn, NULL, "j/monitors", 10,
+      hypr_ipc_populate_monitors, NULL);
+  json_conn_send(hypr_conn, NULL, "j/devices", 9, hypr_ipc_layouts_cb, NULL);
 }
 
 static void hypr_ipc_title_handle ( gchar *str )
@@ -423,6 +660,36 @@ static void hypr_ipc_workspace_new ( gchar *data )
   workspace_set_name(ws, eptr+1);
 }
 
+static void hypr_ipc_workspace_move ( gchar *data )
+{
+  gchar **fields;
+
+  fields = g_strsplit(data, ",", 3);
+  if(g_strv_length(fields)==3)
+    hypr_ipc_workspace_monitor_set(hypr_ipc_parse_ws(fields[0], NULL),
+        fields[2]);
+  g_strfreev(fields);
+}
+
+static void hypr_ipc_workspace_rename ( gchar *data )
+{
+  workspace_t *ws;
+  gchar *eptr;
+
+  ws = workspace_from_id(hypr_ipc_parse_ws(data, &eptr));
+  if(ws && eptr && *eptr==',')
+    workspace_set_name(ws, eptr+1);
+}
+
+static void hypr_ipc_workspace_destroy ( gchar *data )
+{
+  gpointer id;
+
+  id = hypr_ipc_parse_ws(data, NULL);
+  g_hash_table_remove(hypr_ws_monitors, id);
+  workspace_unref(id);
+}
+
 static void hypr_ipc_set_maximized ( gboolean state )
 {
   window_t *win;
@@ -469,8 +736,8 @@ static void hypr_ipc_unmaximize ( gpointer id )
 
 static void hypr_ipc_minimize ( gpointer id )
 {
+  hypr_client_t *client;
   window_t *win;
-  json_object *json;
 
   win = wintree_from_id(id);
   if(!win || win->state & WS_MINIMIZED)
@@ -478,11 +745,8 @@ static void hypr_ipc_minimize ( gpointer id )
 
   if(wintree_get_disown())
     wintree_set_workspace(win->uid, NULL);
-  else if(hypr_ipc_request(ipc_sockaddr, "j/activewindow", &json) && json)
-  {
-    wintree_set_workspace(win->uid, hypr_ipc_workspace_id(json));
-    json_object_put(json);
-  }
+  else if( (client = hypr_ipc_client_lookup(id)) )
+    wintree_set_workspace(win->uid, client->wsid);
   hypr_ipc_command("dispatch movetoworkspacesilent special,address:0x%lx",
       GPOINTER_TO_SIZE(id));
 }
@@ -514,13 +778,7 @@ static void hypr_ipc_focus ( gpointer id )
 
 static void hypr_ipc_set_workspace ( workspace_t *ws )
 {
-  gchar *name;
-
-  if( (name = hypr_ipc_workspace_data(ws, "name")) )
-    hypr_ipc_command("dispatch workspace name:%s", name);
-  else
-    hypr_ipc_command("dispatch workspace name:%s", ws->name);
-  g_free(name);
+  hypr_ipc_command("dispatch workspace name:%s", ws->name);
 }
 
 static void hypr_ipc_move_to ( gpointer id, gpointer wsid )
@@ -588,12 +846,9 @@ static gboolean hypr_ipc_event ( GIOChannel *chan, GIOCondition cond,
     else if(!strncmp(event, "windowtitlev2>>", 15))
       hypr_ipc_title_handle(event+15);
     else if(!strncmp(event, "openwindow>>", 12))
-    {
-      hypr_ipc_get_clients(hypr_ipc_parse_id(event+12, NULL));
-      hypr_ipc_window_place(hypr_ipc_parse_id(event+12, NULL));
-    }
+      hypr_ipc_window_open(event+12);
     else if(!strncmp(event, "closewindow>>", 13))
-      wintree_window_delete(hypr_ipc_parse_id(event+13, NULL));
+      hypr_ipc_window_close(hypr_ipc_parse_id(event+13, NULL));
     else if(!strncmp(event, "fullscreen>>",12))
       hypr_ipc_set_maximized(g_ascii_digit_value(*(event+12)));
     else if(!strncmp(event, "movewindowv2>>", 14))
@@ -603,14 +858,29 @@ static gboolean hypr_ipc_event ( GIOChannel *chan, GIOCondition cond,
     else if(!strncmp(event, "focusedmonv2>>", 14))
     {
       if( (ptr = strchr(event+14, ',')) )
+      {
+        *ptr = 0;
+        hypr_ipc_workspace_monitor_set(hypr_ipc_parse_ws(ptr+1, NULL),
+            event+14);
         workspace_change_focus(hypr_ipc_parse_ws(ptr+1, NULL));
+      }
     }
+    else if(!strncmp(event, "moveworkspacev2>>", 17))
+      hypr_ipc_workspace_move(event+17);
     else if(!strncmp(event, "createworkspacev2>>", 19))
       hypr_ipc_workspace_new(event+19);
     else if(!strncmp(event, "changefloatingmode>>", 20))
       hypr_ipc_floating_set(event+20);
     else if(!strncmp(event, "destroyworkspacev2>>", 20))
-      workspace_unref(hypr_ipc_parse_ws(event+20, NULL));
+      hypr_ipc_workspace_destroy(event+20);
+    else if(!strncmp(event, "renameworkspace>>", 17))
+      hypr_ipc_workspace_rename(event+17);
+    else if(!strncmp(event, "monitoradded", 12) ||
+        !strncmp(event, "monitorremoved", 14))
+    {
+      hypr_ipc_query_schedule(&hypr_monitors_query);
+      hypr_ipc_query_schedule(&hypr_workspaces_query);
+    }
     else if(!strncmp(event, "urgent>>", 8))
       hypr_ipc_handle_urgent(event+8);
     else if(!strncmp(event, "activelayout>>", 14))
@@ -631,11 +901,24 @@ void hypr_ipc_init ( void )
   if(wintree_api_check())
     return;
 
-  ipc_sockaddr = g_build_filename(g_get_user_runtime_dir(), "hypr",
+  sockaddr = g_build_filename(g_get_user_runtime_dir(), "hypr",
       g_getenv("HYPRLAND_INSTANCE_SIGNATURE"), ".socket.sock", NULL);
-  if(!hypr_ipc_get_clients(NULL))
+  hypr_conn = json_conn_new(sockaddr, 1000, 0, NULL);
+  g_free(sockaddr);
+  hypr_ws_monitors = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+      NULL, g_free);
+  hypr_monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+      g_free);
+  hypr_place_pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+  hypr_clients = g_array_new(FALSE, FALSE, sizeof(hypr_client_t));
+  if(!json_conn_send(hypr_conn, NULL, "j/workspaces", 12, hypr_ipc_populate,
+        NULL))
   {
-    g_free(ipc_sockaddr);
+    g_clear_pointer(&hypr_conn, json_conn_free);
+    g_clear_pointer(&hypr_ws_monitors, g_hash_table_destroy);
+    g_clear_pointer(&hypr_monitors, g_hash_table_destroy);
+    g_clear_pointer(&hypr_place_pending, g_hash_table_destroy);
+    g_clear_pointer(&hypr_clients, g_array_unref);
     return;
   }
 
@@ -650,6 +933,4 @@ void hypr_ipc_init ( void )
   if(sock!=-1)
     g_io_add_watch(g_io_channel_unix_new(sock), G_IO_IN, hypr_ipc_event, NULL);
   g_free(sockaddr);
-  hypr_ipc_pager_populate();
-  hypr_ipc_layouts_get();
 }
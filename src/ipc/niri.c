@@ -10,6 +10,7 @@
 #include "gui/monitor.h"
 #include "util/json.h"
 #include "util/string.h"
+#include <unistd.h>
 
 typedef struct _niri_geom {
   gpointer id;
@@ -18,6 +19,7 @@ typedef struct _niri_geom {
 
 static gchar **niri_layouts;
 static GIOChannel *niri_command_ipc;
+static json_stream_t *niri_stream;
 static GList *niri_ipc_workspaces, *niri_ipc_geom;
 
 static void niri_ipc_action ( char *cmd, ... )
@@ -368,13 +370,9 @@ static void niri_ipc_layouts_changed_handle ( struct json_object *json )
     input_layout_list_set(niri_layouts);
 }
 
-static gboolean niri_ipc_event ( GIOChannel *chan, GIOCondition cond,
-    gpointer d )
+static void niri_ipc_event_handle ( json_object *obj )
 {
-  json_object *obj, *data;
-
-  if( !(obj = json_recv_channel(chan)) )
-    return FALSE;
+  json_object *data;
 
   if(json_object_object_get_ex(obj, "WorkspacesChanged", &data))
     niri_ipc_workspaces_changed_handle(data);
@@ -398,40 +396,60 @@ static gboolean niri_ipc_event ( GIOChannel *chan, GIOCondition cond,
     niri_ipc_layouts_changed_handle(data);
 
 //  g_message("%s", json_object_to_json_string(obj));
-  json_object_put(obj);
+}
+
+static gboolean niri_ipc_event ( GIOChannel *chan, GIOCondition cond,
+    gpointer d )
+{
+  json_object *obj;
+  gboolean alive;
 
-  return TRUE;
+  alive = json_stream_fill(niri_stream);
+  while(json_stream_next(niri_stream, NULL, &obj))
+  {
+    niri_ipc_event_handle(obj);
+    json_object_put(obj);
+  }
+
+  if(!alive)
+    g_clear_pointer(&niri_stream, json_stream_free);
+  return alive;
 }
 
 void niri_ipc_init ( void )
 {
   GIOChannel *chan;
+  json_object *json = NULL;
   const gchar *sockaddr;
   gint sock;
-  gchar *r = NULL;
 
   if(wintree_api_check() || !(sockaddr = g_getenv("NIRI_SOCKET")) )
     return;
   if( (sock = socket_connect(sockaddr, 1000))==-1)
     return;
 
-  chan = g_io_channel_unix_new(sock);
-  g_io_channel_set_close_on_unref(chan, TRUE);
-  if( g_io_channel_write_chars(chan, "\"EventStream\"\n", -1, NULL, NULL) ==
-      G_IO_STATUS_NORMAL &&
-      g_io_channel_flush(chan, NULL) == G_IO_STATUS_NORMAL &&
-      g_io_channel_read_line(chan, &r, NULL, NULL, NULL)==G_IO_STATUS_NORMAL &&
-      !g_strcmp0(r, "{\"Ok\":\"Handled\"}\n") )
+  /* the event stream is read raw, so read the handshake from the same
+   * buffer to avoid losing events queued behind it */
+  niri_stream = json_stream_new(sock, 0, NULL);
+  if( write(sock, "\"EventStream\"\n", 14)==14 &&
+      json_stream_read(niri_stream, NULL, &json, 1000) &&
+      !g_strcmp0(json_string_by_name(json, "Ok"), "Handled") )
   {
+    chan = g_io_channel_unix_new(sock);
+    g_io_channel_set_close_on_unref(chan, TRUE);
     g_io_add_watch(chan, G_IO_IN, niri_ipc_event, NULL);
+    g_io_channel_unref(chan);
     if( (sock = socket_connect(sockaddr, 1000))!=-1)
       niri_command_ipc = g_io_channel_unix_new(sock);
   }
   else
-    g_io_channel_unref(chan);
+  {
+    g_clear_pointer(&niri_stream, json_stream_free);
+    close(sock);
+  }
+  json_object_put(json);
   wintree_api_register(&niri_wintree_api);
   workspace_api_register(&niri_workspace_api);
   input_api_register(&niri_input_api);
   exec_api_set(niri_ipc_exec);
-  g_free(r);
 }
@@ -0,0 +1,524 @@
+/* This entire file is licensed under GNU General Public License v3.0
+ *
+ * Copyright 2026- sfwbar maintainers
+ */
+
+/* Record and replay of compositor IPC traffic. In record mode, each
+ * compositor socket is replaced by a proxy socket which forwards traffic to
+ * the compositor and logs it. In replay mode, the proxy sockets are served
+ * from a log, so IPC backends can be exercised without a compositor.
+ *
+ * Log format, one message per line:
+ * <usec> <endpoint> <connection> <direction> <base64 data>
+ * direction is '>' (from sfwbar), '<' (to sfwbar) or 'x' (closed) */
+
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <errno.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "sfwbar.h"
+#include "util/json.h"
+
+#define REPLAY_BUF_SIZE 65536
+#define REPLAY_TICK 10
+
+extern gchar *sockname;
+
+typedef struct _replay_endpoint {
+  gchar *name;
+  gchar *target;
+  gchar *path;
+  gint sock;
+  gint count;
+  GQueue scripts;
+} replay_endpoint_t;
+
+typedef struct _replay_msg {
+  gint64 time;
+  gchar dir;
+  GBytes *data;
+} replay_msg_t;
+
+typedef struct _replay_conn {
+  replay_endpoint_t *ep;
+  gint id;
+  gint client;
+  gint server;
+  GQueue msgs;
+} replay_conn_t;
+
+static GList *replay_endpoints;
+static gchar *replay_dir, *replay_hdir;
+static FILE *record_file;
+static GMutex record_mutex;
+static gint64 replay_start, replay_origin = -1;
+static gdouble replay_speed;
+static gint replay_pending;
+static gsize replay_msgs, replay_bytes;
+static gint64 replay_stall, replay_stall_max, replay_tick_last;
+static guint replay_tick_id;
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+static gsize replay_heap;
+#endif
+
+static void replay_record ( replay_conn_t *conn, gchar dir, gpointer data,
+    gsize len )
+{
+  gchar *b64;
+
+  b64 = len? g_base64_encode(data, len) : g_strdup("-");
+  g_mutex_lock(&record_mutex);
+  fprintf(record_file, "%" G_GINT64_FORMAT " %s %d %c %s\n",
+      g_get_monotonic_time() - replay_start, conn->ep->name, conn->id, dir,
+      b64);
+  g_mutex_unlock(&record_mutex);
+  g_free(b64);
+}
+
+static gboolean replay_write ( gint sock, const gchar *data, gsize len )
+{
+  gssize wlen;
+
+  while(len>0)
+  {
+    if( (wlen = write(sock, data, len))<0 && errno==EINTR )
+      continue;
+    if(wlen<=0)
+      return FALSE;
+    data += wlen;
+    len -= wlen;
+  }
+  return TRUE;
+}
+
+static gpointer replay_proxy_thread ( replay_conn_t *conn )
+{
+  struct pollfd pfd[2];
+  gchar *buf;
+  gssize rlen;
+  gint i;
+
+  buf = g_malloc(REPLAY_BUF_SIZE);
+  pfd[0].fd = conn->client;
+  pfd[1].fd = conn->server;
+  pfd[0].events = pfd[1].events = POLLIN;
+
+  while(TRUE)
+  {
+    if(poll(pfd, 2, -1)<0)
+    {
+      if(errno==EINTR)
+        continue;
+      break;
+    }
+    for(i=0; i<2; i++)
+      if(pfd[i].revents)
+      {
+        if( (rlen = read(pfd[i].fd, buf, REPLAY_BUF_SIZE))<=0 ||
+            !replay_write(pfd[!i].fd, buf, rlen) )
+          goto out;
+        replay_record(conn, i? '<' : '>', buf, rlen);
+      }
+  }
+out:
+  replay_record(conn, 'x', NULL, 0);
+  close(conn->client);
+  close(conn->server);
+  g_free(buf);
+  g_free(conn);
+
+  return NULL;
+}
+
+/* wait for the client to send up to len bytes, a client which was changed
+ * since the recording may send less, so give up after a short idle time */
+static void replay_drain ( gint sock, gsize len )
+{
+  struct pollfd pfd = { .fd = sock, .events = POLLIN };
+  gchar buf[4096];
+  gssize rlen;
+
+  while(len>0 && poll(&pfd, 1, 100)>0)
+  {
+    if( (rlen = read(sock, buf, MIN(len, sizeof(buf))))<=0 )
+      return;
+    len -= rlen;
+  }
+}
+
+static gboolean replay_report ( gpointer data )
+{
+  gint64 elapsed;
+
+  elapsed = MAX(g_get_monotonic_time() - replay_start, 1);
+  g_message("replay: %" G_GSIZE_FORMAT " messages, %" G_GSIZE_FORMAT
+      " bytes in %.3fs (%.1f messages/s)", replay_msgs, replay_bytes,
+      (gdouble)elapsed / G_USEC_PER_SEC,
+      (gdouble)replay_msgs * G_USEC_PER_SEC / elapsed);
+  g_message("replay: main loop stalled for %.3fs total, %.3fs max",
+      (gdouble)replay_stall / G_USEC_PER_SEC,
+      (gdouble)replay_stall_max / G_USEC_PER_SEC);
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  g_message("replay: heap in use grew by %" G_GSSIZE_FORMAT " bytes",
+      (gssize)(mallinfo2().uordblks - replay_heap));
+#endif
+  g_clear_handle_id(&replay_tick_id, g_source_remove);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void replay_msg_free ( replay_msg_t *msg )
+{
+  if(msg->data)
+    g_bytes_unref(msg->data);
+  g_free(msg);
+}
+
+static gpointer replay_play_thread ( replay_conn_t *conn )
+{
+  replay_msg_t *msg;
+  gboolean alive = TRUE;
+  gint64 delay;
+  gsize len;
+
+  while(alive && (msg = g_queue_pop_head(&conn->msgs)) )
+  {
+    len = msg->data? g_bytes_get_size(msg->data) : 0;
+    if(msg->dir=='x')
+      alive = FALSE;
+    else if(msg->dir=='>')
+      replay_drain(conn->client, len);
+    else if(msg->dir=='<' && len)
+    {
+      if(replay_speed>0)
+      {
+        delay = replay_start + (msg->time - replay_origin) / replay_speed -
+          g_get_monotonic_time();
+        if(delay>0)
+          g_usleep(delay);
+      }
+      alive = replay_write(conn->client, g_bytes_get_data(msg->data, NULL),
+          len);
+      g_atomic_pointer_add(&replay_msgs, 1);
+      g_atomic_pointer_add(&replay_bytes, len);
+    }
+    replay_msg_free(msg);
+  }
+  g_queue_clear_full(&conn->msgs, (GDestroyNotify)replay_msg_free);
+  close(conn->client);
+  g_free(conn);
+
+  if(g_atomic_int_dec_and_test(&replay_pending))
+    g_main_context_invoke(NULL, replay_report, NULL);
+
+  return NULL;
+}
+
+static gpointer replay_listen_thread ( replay_endpoint_t *ep )
+{
+  replay_conn_t *conn;
+  gint sock;
+
+  while( (sock = accept(ep->sock, NULL, NULL))>=0 || errno==EINTR )
+  {
+    if(sock<0)
+      continue;
+    if(record_file)
+    {
+      conn = g_malloc0(sizeof(replay_conn_t));
+      conn->ep = ep;
+      conn->id = ep->count++;
+      conn->client = sock;
+      if( (conn->server = socket_connect(ep->target, 0))<0 )
+      {
+        g_warning("replay: unable to connect to %s", ep->target);
+        close(sock);
+        g_free(conn);
+        continue;
+      }
+      g_thread_unref(g_thread_new("ipc-record",
+            (GThreadFunc)replay_proxy_thread, conn));
+    }
+    else if( (conn = g_queue_pop_head(&ep->scripts)) )
+    {
+      conn->client = sock;
+      g_thread_unref(g_thread_new("ipc-replay",
+            (GThreadFunc)replay_play_thread, conn));
+    }
+    else
+      close(sock);
+  }
+
+  return NULL;
+}
+
+static replay_endpoint_t *replay_endpoint_get ( const gchar *name )
+{
+  GList *iter;
+
+  for(iter=replay_endpoints; iter; iter=g_list_next(iter))
+    if(!g_strcmp0(((replay_endpoint_t *)iter->data)->name, name))
+      return iter->data;
+  return NULL;
+}
+
+static const gchar *replay_endpoint_add ( const gchar *name,
+    const gchar *target, const gchar *path )
+{
+  replay_endpoint_t *ep;
+  struct sockaddr_un addr;
+
+  if(record_file && (!target || !g_file_test(target, G_FILE_TEST_EXISTS)))
+    return NULL;
+  if(!record_file && !replay_endpoint_get(name))
+    return NULL;
+  if( !(ep = replay_endpoint_get(name)) )
+  {
+    ep = g_malloc0(sizeof(replay_endpoint_t));
+    ep->name = g_strdup(name);
+    ep->sock = -1;
+    replay_endpoints = g_list_append(replay_endpoints, ep);
+  }
+  if(ep->sock>=0)
+    return ep->path;
+
+  ep->target = g_strdup(target);
+  ep->path = g_strdup(path);
+  addr.sun_family = AF_UNIX;
+  g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+  g_unlink(path);
+  if( (ep->sock = socket(AF_UNIX, SOCK_STREAM, 0))<0 ||
+      bind(ep->sock, (struct sockaddr *)&addr, sizeof(addr))<0 ||
+      listen(ep->sock, 8)<0 )
+  {
+    g_warning("replay: unable to listen on %s", path);
+    return NULL;
+  }
+  g_thread_unref(g_thread_new("ipc-listen",
+        (GThreadFunc)replay_listen_thread, ep));
+  g_debug("replay: %s: %s -> %s", name, path, target? target : "(log)");
+
+  return ep->path;
+}
+
+/* remove the proxy sockets and their directories */
+void ipc_replay_cleanup ( void )
+{
+  replay_endpoint_t *ep;
+  GList *iter;
+
+  for(iter=replay_endpoints; iter; iter=g_list_next(iter))
+  {
+    ep = iter->data;
+    if(ep->sock>=0)
+      close(ep->sock);
+    ep->sock = -1;
+    if(ep->path)
+      g_unlink(ep->path);
+  }
+  if(replay_hdir)
+    g_rmdir(replay_hdir);
+  if(replay_dir)
+    g_rmdir(replay_dir);
+  g_clear_pointer(&replay_hdir, g_free);
+  g_clear_pointer(&replay_dir, g_free);
+}
+
+static gboolean replay_terminate ( gpointer data )
+{
+  exit(0);
+  return G_SOURCE_REMOVE;
+}
+
+static void replay_endpoints_setup ( void )
+{
+  const gchar *path;
+  gchar *dir, *sig, *hdir, *proxy, *target;
+
+  if( !(dir = g_dir_make_tmp("sfwbar-ipc-XXXXXX", NULL)) )
+  {
+    g_warning("replay: unable to create a socket directory");
+    return;
+  }
+  replay_dir = g_strdup(dir);
+  atexit(ipc_replay_cleanup);
+  g_unix_signal_add(SIGINT, replay_terminate, NULL);
+  g_unix_signal_add(SIGTERM, replay_terminate, NULL);
+
+  proxy = g_build_filename(dir, "socket", NULL);
+  if( (path = replay_endpoint_add("socket", sockname, proxy)) )
+    sockname = g_strdup(path);
+  g_free(proxy);
+
+  proxy = g_build_filename(dir, "sway", NULL);
+  if( (path = replay_endpoint_add("sway", g_getenv("SWAYSOCK"), proxy)) )
+    g_setenv("SWAYSOCK", path, TRUE);
+  g_free(proxy);
+
+  proxy = g_build_filename(dir, "wayfire", NULL);
+  if( (path = replay_endpoint_add("wayfire", g_getenv("WAYFIRE_SOCKET"),
+          proxy)) )
+    g_setenv("WAYFIRE_SOCKET", path, TRUE);
+  g_free(proxy);
+
+  proxy = g_build_filename(dir, "niri", NULL);
+  if( (path = replay_endpoint_add("niri", g_getenv("NIRI_SOCKET"), proxy)) )
+    g_setenv("NIRI_SOCKET", path, TRUE);
+  g_free(proxy);
+
+  /* hyprland sockets are found via the instance signature */
+  if(!replay_endpoint_get("hypr") &&
+      !(record_file && g_getenv("HYPRLAND_INSTANCE_SIGNATURE")))
+  {
+    g_free(dir);
+    return;
+  }
+  sig = g_strdup_printf("sfwbar-replay-%d", getpid());
+  hdir = g_build_filename(g_get_user_runtime_dir(), "hypr", sig, NULL);
+  g_mkdir_with_parents(hdir, 0700);
+  replay_hdir = g_strdup(hdir);
+  target = g_getenv("HYPRLAND_INSTANCE_SIGNATURE")? g_build_filename(
+      g_get_user_runtime_dir(), "hypr", g_getenv("HYPRLAND_INSTANCE_SIGNATURE"),
+      ".socket.sock", NULL) : NULL;
+  proxy = g_build_filename(hdir, ".socket.sock", NULL);
+  path = replay_endpoint_add("hypr", target, proxy);
+  g_free(proxy);
+  g_free(target);
+  target = g_getenv("HYPRLAND_INSTANCE_SIGNATURE")? g_build_filename(
+      g_get_user_runtime_dir(), "hypr", g_getenv("HYPRLAND_INSTANCE_SIGNATURE"),
+      ".socket2.sock", NULL) : NULL;
+  proxy = g_build_filename(hdir, ".socket2.sock", NULL);
+  replay_endpoint_add("hypr-events", target, proxy);
+  if(path)
+    g_setenv("HYPRLAND_INSTANCE_SIGNATURE", sig, TRUE);
+  g_free(proxy);
+  g_free(target);
+  g_free(hdir);
+  g_free(sig);
+  g_free(dir);
+}
+
+static gboolean replay_load ( const gchar *fname )
+{
+  replay_endpoint_t *ep;
+  replay_conn_t *conn;
+  replay_msg_t *msg;
+  GHashTable *conns;
+  gchar *buf, **lines, **field, *key;
+  guchar *data;
+  gsize len;
+  gint i;
+
+  if(!g_file_get_contents(fname, &buf, NULL, NULL))
+  {
+    g_warning("replay: unable to read %s", fname);
+    return FALSE;
+  }
+
+  conns = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  lines = g_strsplit(buf, "\n", -1);
+  g_free(buf);
+  for(i=0; lines[i]; i++)
+  {
+    field = g_strsplit(lines[i], " ", 5);
+    if(g_strv_length(field)==5)
+    {
+      key = g_strconcat(field[1], ":", field[2], NULL);
+      if( !(conn = g_hash_table_lookup(conns, key)) )
+      {
+        if( !(ep = replay_endpoint_get(field[1])) )
+        {
+          ep = g_malloc0(sizeof(replay_endpoint_t));
+          ep->name = g_strdup(field[1]);
+          ep->sock = -1;
+          replay_endpoints = g_list_append(replay_endpoints, ep);
+        }
+        conn = g_malloc0(sizeof(replay_conn_t));
+        conn->ep = ep;
+        conn->id = g_ascii_strtoll(field[2], NULL, 10);
+        g_queue_push_tail(&ep->scripts, conn);
+        g_hash_table_insert(conns, g_strdup(key), conn);
+        replay_pending++;
+      }
+      msg = g_malloc0(sizeof(replay_msg_t));
+      msg->time = g_ascii_strtoll(field[0], NULL, 10);
+      msg->dir = *field[3];
+      if(g_strcmp0(field[4], "-"))
+      {
+        data = g_base64_decode(field[4], &len);
+        msg->data = g_bytes_new_take(data, len);
+      }
+      if(replay_origin<0 || msg->time<replay_origin)
+        replay_origin = msg->time;
+      g_queue_push_tail(&conn->msgs, msg);
+      g_free(key);
+    }
+    g_strfreev(field);
+  }
+  g_strfreev(lines);
+  g_hash_table_destroy(conns);
+
+  return replay_pending>0;
+}
+
+static gboolean replay_tick ( gpointer data )
+{
+  gint64 now, stall;
+
+  now = g_get_monotonic_time();
+  stall = now - replay_tick_last - REPLAY_TICK * 1000;
+  if(stall>0)
+  {
+    replay_stall += stall;
+    replay_stall_max = MAX(replay_stall_max, stall);
+  }
+  replay_tick_last = now;
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* must be called before the IPC backends are initialized */
+void ipc_replay_init ( const gchar *record, const gchar *replay,
+    gdouble speed )
+{
+  if(!record && !replay)
+    return;
+
+  replay_start = g_get_monotonic_time();
+  if(record)
+  {
+    if( !(record_file = fopen(record, "w")) )
+    {
+      g_warning("replay: unable to open %s", record);
+      return;
+    }
+    setvbuf(record_file, NULL, _IOLBF, 0);
+    replay_endpoints_setup();
+    return;
+  }
+
+  if(!replay_load(replay))
+    return;
+  replay_speed = speed;
+  g_unsetenv("SWAYSOCK");
+  g_unsetenv("WAYFIRE_SOCKET");
+  g_unsetenv("NIRI_SOCKET");
+  g_unsetenv("HYPRLAND_INSTANCE_SIGNATURE");
+  sockname = NULL;
+  replay_endpoints_setup();
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  replay_heap = mallinfo2().uordblks;
+#endif
+  replay_tick_last = g_get_monotonic_time();
+  replay_tick_id = g_timeout_add_full(G_PRIORITY_HIGH, REPLAY_TICK,
+      replay_tick, NULL, NULL);
+}
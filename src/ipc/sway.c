@@ -14,82 +14,98 @@
 #include "util/string.h"
 #include "vm/vm.h"
 
+typedef struct _sway_con {
+  gint id;
+  gpointer wsid;
+  GdkRectangle rect;
+  gboolean floating;
+} sway_con_t;
+
 static gint main_ipc;
+static json_stream_t *sway_stream;
+static json_conn_t *sway_conn;
+static gboolean sway_tree_pending, sway_tree_dirty;
+static GHashTable *sway_cons, *sway_workspaces;
 static source_t *sway_file;
 static gchar **sway_layouts;
 
 extern gchar *sockname;
 
-static json_object *sway_ipc_poll ( gint sock, guint32 *etype )
+static const gchar *sway_ipc_path ( void )
 {
-  gint8 sway_ipc_header[14];
-  guint32 len;
-
-  if(!recv_retry(sock, sway_ipc_header, 14))
-    return NULL;
-
-  if(etype)
-    memcpy(etype, sway_ipc_header + 10, sizeof(guint32));
-
-  memcpy(&len, sway_ipc_header + 6, sizeof(guint32));
-  return recv_json(sock, len);
+  return sockname? sockname : g_getenv("SWAYSOCK");
 }
 
 static int sway_ipc_open (int to)
 {
   const gchar *socket_path;
 
-  if( !(socket_path = sockname?sockname:g_getenv("SWAYSOCK")) )
+  if( !(socket_path = sway_ipc_path()) )
     return -1;
   return socket_connect(socket_path, to);
 }
 
+static void sway_ipc_header ( gint8 *header, gint32 type, guint32 len )
+{
+  static const gint8 magic[6] = {0x69, 0x33, 0x2d, 0x69, 0x70, 0x63};
+
+  memcpy(header, magic, sizeof(magic));
+  memcpy(header + 6, &len, sizeof(guint32));
+  memcpy(header + 10, &type, sizeof(gint32));
+}
+
+static gssize sway_ipc_frame ( const gchar *header )
+{
+  guint32 len;
+
+  if(memcmp(header, "i3-ipc", 6))
+    return -1;
+  memcpy(&len, header + 6, sizeof(guint32));
+  return len;
+}
+
 static int sway_ipc_send ( gint sock, gint32 type, gchar *command )
 {
-  static gint8 sway_ipc_header[14] = {0x69, 0x33, 0x2d, 0x69, 0x70, 0x63};
-  static guint32 *sway_ipc_len = (void *)&sway_ipc_header + 6;
-  static guint32 *sway_ipc_type = (void *)&sway_ipc_header + 10;
+  gint8 header[14];
+  guint32 len;
 
-  *sway_ipc_len = strlen(command);
-  *sway_ipc_type = type;
-  if(write(sock, sway_ipc_header, sizeof(sway_ipc_header))==-1)
+  len = strlen(command);
+  sway_ipc_header(header, type, len);
+  if(write(sock, header, sizeof(header))==-1)
     return -1;
-  if(*sway_ipc_len>0)
-    if(write(sock, command, *sway_ipc_len)==-1)
+  if(len>0)
+    if(write(sock, command, len)==-1)
       return -1;
   return 0;
 }
 
+static gboolean sway_ipc_request_async ( gchar *command, gint32 type,
+    json_reply_cb cb )
+{
+  gint8 header[14];
+
+  if(!sway_conn)
+    return FALSE;
+  sway_ipc_header(header, type, strlen(command));
+  return json_conn_send(sway_conn, header, command, strlen(command), cb,
+      NULL);
+}
+
 static void sway_ipc_command ( gchar *cmd, ... )
 {
   va_list args;
   gchar *buf;
   
-  if(!cmd || main_ipc<1)
+  if(!cmd)
     return;
 
   va_start(args, cmd);
   buf = g_strdup_vprintf(cmd, args);
-  sway_ipc_send (main_ipc, 0, buf);
+  sway_ipc_request_async(buf, 0, NULL);
   g_free(buf);
   va_end(args);
 }
 
-static json_object *sway_ipc_request ( gchar *command, gint32 type )
-{
-  gint sock;
-  json_object *json;
-
-  sock = sway_ipc_open(3000);
-  if(sock==-1)
-    return NULL;
-  sway_ipc_send(sock, type, command);
-  json = sway_ipc_poll(sock, NULL);
-  close(sock);
-
-  return json;
-}
-
 static GdkRectangle sway_ipc_parse_rect ( struct json_object *obj )
 {
   struct json_object *rect;
@@ -101,6 +117,73 @@ static GdkRectangle sway_ipc_parse_rect ( struct json_object *obj )
   return eret;
 }
 
+/* local mirror of container and workspace geometry, so window placement
+ * doesn't need to query the compositor */
+static sway_con_t *sway_mirror_con ( struct json_object *obj )
+{
+  sway_con_t *con;
+  gpointer id;
+
+  if( !(id = json_int_ptr_by_name(obj, "id", 0)) )
+    return NULL;
+  if( !(con = g_hash_table_lookup(sway_cons, id)) )
+  {
+    con = g_malloc0(sizeof(sway_con_t));
+    con->id = GPOINTER_TO_INT(id);
+    g_hash_table_insert(sway_cons, id, con);
+  }
+  con->rect = sway_ipc_parse_rect(obj);
+  con->floating = !g_strcmp0(json_string_by_name(obj, "type"),
+      "floating_con");
+
+  return con;
+}
+
+static void sway_mirror_workspace ( struct json_object *obj )
+{
+  GdkRectangle *rect;
+  gpointer id;
+
+  if( !(id = json_int_ptr_by_name(obj, "id", 0)) )
+    return;
+  if( !(rect = g_hash_table_lookup(sway_workspaces, id)) )
+  {
+    rect = g_malloc0(sizeof(GdkRectangle));
+    g_hash_table_insert(sway_workspaces, id, rect);
+  }
+  *rect = sway_ipc_parse_rect(obj);
+}
+
+static void sway_mirror_tree ( struct json_object *obj, gpointer wsid )
+{
+  struct json_object *arr, *iter;
+  sway_con_t *con;
+  gint i;
+
+  if( (arr = json_array_by_name(obj, "floating_nodes")) )
+    for(i=0; i<json_object_array_length(arr); i++)
+      if( (con = sway_mirror_con(json_object_array_get_idx(arr, i))) )
+        con->wsid = wsid;
+
+  if( (arr = json_array_by_name(obj, "nodes")) )
+    for(i=0; i<json_object_array_length(arr); i++)
+    {
+      iter = json_object_array_get_idx(arr, i);
+      if(json_string_by_name(iter, "app_id"))
+      {
+        if( (con = sway_mirror_con(iter)) )
+          con->wsid = wsid;
+      }
+      else if(!g_strcmp0(json_string_by_name(iter, "type"), "workspace"))
+      {
+        sway_mirror_workspace(iter);
+        sway_mirror_tree(iter, json_int_ptr_by_name(iter, "id", 0));
+      }
+      else
+        sway_mirror_tree(iter, wsid);
+    }
+}
+
 static void sway_ipc_window_place ( gint wid, gint64 pid )
 {
   GdkRectangle place;
@@ -207,6 +290,36 @@ static void sway_traverse_tree ( struct json_object *obj, const gchar *parent,
     }
 }
 
+/* rebuild the container mirror before handling windows, so new windows
+ * are placed against the whole tree */
+static void sway_ipc_tree_handle ( struct json_object *obj )
+{
+  g_hash_table_remove_all(sway_cons);
+  sway_mirror_tree(obj, NULL);
+  sway_traverse_tree(obj, NULL, NULL);
+}
+
+static void sway_ipc_tree_refresh ( void );
+
+static void sway_ipc_tree_cb ( struct json_object *obj, gpointer data )
+{
+  sway_tree_pending = FALSE;
+  if(obj)
+    sway_ipc_tree_handle(obj);
+  if(sway_tree_dirty)
+    sway_ipc_tree_refresh();
+}
+
+/* a burst of window events needs only one tree in flight, plus one more if
+ * anything changed after it was requested */
+static void sway_ipc_tree_refresh ( void )
+{
+  sway_tree_dirty = sway_tree_pending;
+  if(sway_tree_pending)
+    return;
+  sway_tree_pending = sway_ipc_request_async("", 4, sway_ipc_tree_cb);
+}
+
 source_t *sway_ipc_client_init ( void )
 {
   return sway_file? sway_file : (sway_file = scanner_source_new(NULL));
@@ -220,6 +333,7 @@ static workspace_t *sway_ipc_workspace_new ( struct json_object *obj )
   if( !(id = GINT_TO_POINTER(json_int_by_name(obj, "id", 0))) )
     return NULL;
 
+  sway_mirror_workspace(obj);
   if( !(ws = workspace_from_id(id)) && 
     !(ws = workspace_from_name(json_string_by_name(obj, "name"))) )
   {
@@ -262,7 +376,10 @@ static void sway_ipc_workspace_event ( struct json_object *obj )
     return;
 
   if(!g_strcmp0(change, "empty"))
+  {
+    g_hash_table_remove(sway_workspaces, id);
     workspace_unref(id);
+  }
   else if(!g_strcmp0(change, "init"))
     sway_ipc_workspace_new(ws_obj);
   else if(!g_strcmp0(change, "focus"))
@@ -278,22 +395,23 @@ static void sway_ipc_workspace_event ( struct json_object *obj )
     workspace_mod_state(id, WS_STATE_VISIBLE,
         json_bool_by_name(ws_obj, "visible", FALSE));
   else if(!g_strcmp0(change, "move"))
+  {
+    sway_mirror_workspace(ws_obj);
     workspace_set_active(workspace_from_id(id),
         json_string_by_name(ws_obj, "output"));
+  }
   else
     return;
 
   workspace_commit(workspace_from_id(id));
 }
 
-static void sway_ipc_workspace_populate ( void )
+static void sway_ipc_workspace_populate ( struct json_object *robj,
+    gpointer data )
 {
-  struct json_object *robj;
   workspace_t *ws;
   gint i;
 
-  robj = sway_ipc_request("", 1);
-
   if(!robj || !json_object_is_type(robj, json_type_array))
     return;
   for(i=0; i<json_object_array_length(robj); i++)
@@ -301,7 +419,6 @@ static void sway_ipc_workspace_populate ( void )
     ws = sway_ipc_workspace_new(json_object_array_get_idx(robj, i));
     workspace_commit(ws);
   }
-  json_object_put(robj);
 }
 
 static void sway_ipc_window_event ( struct json_object *obj )
@@ -321,17 +438,22 @@ static void sway_ipc_window_event ( struct json_object *obj )
     return;
 
   wid = GINT_TO_POINTER(json_int_by_name(container, "id", G_MININT64));
+  if(g_hash_table_contains(sway_cons, wid))
+    sway_mirror_con(container);
 
   if(!g_strcmp0(change, "new"))
-    sway_ipc_send(main_ipc, 4, ""); // get tree to map workspace
+    sway_ipc_tree_refresh(); // get tree to map workspace
   else if(!g_strcmp0(change, "close"))
+  {
+    g_hash_table_remove(sway_cons, wid);
     wintree_window_delete(wid);
+  }
   else if(!g_strcmp0(change, "title"))
     wintree_set_title(wid, json_string_by_name(container, "name"));
   else if(!g_strcmp0(change, "focus"))
   {
     wintree_set_focus(wid);
-    sway_ipc_send(main_ipc, 4, "");
+    sway_ipc_tree_refresh();
   }
   else if(!g_strcmp0(change, "fullscreen_mode"))
   {
@@ -346,7 +468,7 @@ static void sway_ipc_window_event ( struct json_object *obj )
             json_int_by_name(container, "urgent", 0));
   }
   else if(!g_strcmp0(change, "move"))
-    sway_ipc_send(main_ipc, 4, "");
+    sway_ipc_tree_refresh();
   else if(!g_strcmp0(change,"floating"))
     wintree_set_float(wid,!g_strcmp0(
           json_string_by_name(container, "type"), "floating_con"));
@@ -358,6 +480,21 @@ static void sway_ipc_inputs_handle ( struct json_object *obj )
     input_layout_list_set(sway_layouts);
 }
 
+static void sway_ipc_inputs_cb ( struct json_object *obj, gpointer data )
+{
+  gint i;
+
+  if(!obj || !json_object_is_type(obj, json_type_array))
+    return;
+  for(i=0; i<json_object_array_length(obj); i++)
+    if(!g_strcmp0(json_string_by_name(json_object_array_get_idx(obj, i),
+            "type"), "keyboard"))
+    {
+      sway_ipc_inputs_handle(json_object_array_get_idx(obj, i));
+      break;
+    }
+}
+
 static void sway_ipc_input_event ( struct json_object *obj )
 {
   struct json_object *input;
@@ -373,7 +510,6 @@ static void sway_ipc_input_event ( struct json_object *obj )
 
 static void sway_ipc_scan_input ( struct json_object *obj, guint32 etype )
 {
-  struct json_object *scan;
   static gchar *ename[] = {
     "workspace",
     "",
@@ -386,34 +522,31 @@ static void sway_ipc_scan_input ( struct json_object *obj, guint32 etype )
     "","","","","","","","","","","","",
     "bar_state_update",
     "input" };
-  GList *iter;
 
-  if(!sway_file || etype<0x80000000 || etype>0x80000015)
+  if(!sway_file || !sway_file->vars || etype<0x80000000 || etype>0x80000015)
     return;
 
-  scan = json_object_new_object();
-  json_object_object_add_ex(scan, ename[etype-0x80000000], obj, 0);
-  g_rec_mutex_lock(&sway_file->mutex);
-  for(iter=sway_file->vars; iter; iter=g_list_next(iter))
-     scanner_var_invalidate(0, iter->data, NULL);
-  scanner_update_json(scan, sway_file);
-  g_rec_mutex_unlock(&sway_file->mutex);
-  json_object_get(obj);
-  json_object_put(scan);
-  trigger_emit("sway");
+  if(scanner_update_json_root(sway_file, ename[etype-0x80000000], obj))
+    trigger_emit("sway");
 }
 
 static gboolean sway_ipc_event ( GIOChannel *chan, GIOCondition cond,
     gpointer data )
 {
   struct json_object *obj;
+  gchar header[14];
   guint32 etype;
+  gboolean alive;
 
   if(main_ipc==-1)
     return FALSE;
 
-  while ( (obj=sway_ipc_poll(main_ipc, &etype)) )
+  alive = json_stream_fill(sway_stream);
+  while(json_stream_next(sway_stream, header, &obj))
   { 
+    if(!obj)
+      continue;
+    memcpy(&etype, header + 10, sizeof(guint32));
     if(etype==0x80000000)
       sway_ipc_workspace_event(obj);
     else if(etype==0x80000004)
@@ -427,8 +560,6 @@ static gboolean sway_ipc_event ( GIOChannel *chan, GIOCondition cond,
         trigger_emit("switcher_forward");
       }
     }
-    else if(etype==0x00000004)
-      sway_traverse_tree(obj, NULL, NULL);
     else if(etype==0x80000003)
       sway_ipc_window_event(obj);
     else if(etype==0x80000014)
@@ -441,7 +572,15 @@ static gboolean sway_ipc_event ( GIOChannel *chan, GIOCondition cond,
 
     json_object_put(obj);
   }
-  return TRUE;
+
+  if(!alive)
+  {
+    g_debug("sway: event socket closed");
+    g_clear_pointer(&sway_stream, json_stream_free);
+    close(main_ipc);
+    main_ipc = -1;
+  }
+  return alive;
 }
 
 /* Window API */
@@ -529,44 +668,34 @@ static struct wintree_api sway_wintree_api = {
 static guint sway_ipc_get_geom ( gpointer wid, GdkRectangle *place,
     gpointer wsid, GdkRectangle **wins, GdkRectangle *space, gint *focus )
 {
-  struct json_object *obj = NULL;
-  struct json_object *iter, *fiter, *arr;
-  gint i, j, c, n = 0;
-
-  obj = sway_ipc_request("", 1);
+  GHashTableIter iter;
+  GdkRectangle *rect;
+  sway_con_t *con;
+  gint c = 0, j = 0;
 
   *wins = NULL;
   *focus = -1;
-  if(obj && json_object_is_type(obj, json_type_array))
-    for(i=0; i<json_object_array_length(obj); i++)
-    {
-      iter = json_object_array_get_idx(obj, i);
-      if(GPOINTER_TO_INT(wsid) == json_int_by_name(iter, "id", 0) &&
-          (arr = json_array_by_name(iter, "floating_nodes")) )
-      {
-        *space = sway_ipc_parse_rect(iter);
-        n = json_object_array_length(arr);
-        c = 0;
-        *wins = g_malloc0(n * sizeof(GdkRectangle));
-        for(j=0; j<n; j++)
-        {
-          fiter = json_object_array_get_idx(arr, j);
-          if(!wid || json_int_by_name(fiter, "id", 0)!=GPOINTER_TO_INT(wid))
-            (*wins)[c++] = sway_ipc_parse_rect(fiter);
-          else if(place)
-            *place = sway_ipc_parse_rect(fiter);
-          if(json_bool_by_name(fiter, "focused", FALSE))
-            *focus = j;
-        }
-        json_object_put(obj);
-        return c;
-      }
-    }
+  if( !(rect = g_hash_table_lookup(sway_workspaces, wsid)) )
+    return 0;
 
-  json_object_put(obj);
-  return 0;
-}
+  *space = *rect;
+  *wins = g_malloc0(g_hash_table_size(sway_cons) * sizeof(GdkRectangle));
+  g_hash_table_iter_init(&iter, sway_cons);
+  while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&con))
+  {
+    if(con->wsid != wsid || !con->floating)
+      continue;
+    if(!wid || con->id != GPOINTER_TO_INT(wid))
+      (*wins)[c++] = con->rect;
+    else if(place)
+      *place = con->rect;
+    if(wintree_is_focused(GINT_TO_POINTER(con->id)))
+      *focus = j;
+    j++;
+  }
 
+  return c;
+}
 
 static void sway_ipc_set_workspace ( workspace_t *ws )
 {
@@ -623,39 +752,29 @@ static value_t sway_ipc_wincmd_action ( vm_t *vm, value_t p[], gint np )
 
 void sway_ipc_init ( void )
 {
-  struct json_object *obj;
-  gint sock;
-
-  if(wintree_api_check() || ((sock=sway_ipc_open(1000))==-1) )
+  if(wintree_api_check() || !sway_ipc_path())
+    return;
+  sway_conn = json_conn_new(sway_ipc_path(), 3000, 14, sway_ipc_frame);
+  if(!json_conn_connect(sway_conn))
+  {
+    g_clear_pointer(&sway_conn, json_conn_free);
     return;
+  }
+  sway_cons = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+      g_free);
+  sway_workspaces = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+      NULL, g_free);
   workspace_api_register(&sway_workspace_api);
   wintree_api_register(&sway_wintree_api);
   input_api_register(&sway_input_api);
   exec_api_set(sway_ipc_exec);
 
-  sway_ipc_send(sock, 0, "bar hidden_state hide");
-  if( (obj = sway_ipc_poll(sock, NULL)) )
-    json_object_put(obj);
-  sway_ipc_workspace_populate();
-  sway_ipc_send(sock, 4, "");
-  if( (obj = sway_ipc_poll(sock, NULL)) )
-  {
-    sway_traverse_tree(obj, NULL, NULL);
-    json_object_put(obj);
-  }
-  sway_ipc_send(sock, 100, "");
-  if( (obj = sway_ipc_poll(sock, NULL)) )
-  {
-    gint i;
-    for(i=0; i<json_object_array_length(obj); i++)
-      if(!g_strcmp0(json_string_by_name(json_object_array_get_idx(obj, i), "type"), "keyboard"))
-      {
-        sway_ipc_inputs_handle(json_object_array_get_idx(obj, i));
-        break;
-      }
-    json_object_put(obj);
-  }
-  close(sock);
+  /* replies arrive in request order, so the workspaces are in before the
+   * tree places any windows on them */
+  sway_ipc_request_async("bar hidden_state hide", 0, NULL);
+  sway_ipc_request_async("", 1, sway_ipc_workspace_populate);
+  sway_ipc_tree_refresh();
+  sway_ipc_request_async("", 100, sway_ipc_inputs_cb);
 
   if((main_ipc = sway_ipc_open(10))<0)
     return;
@@ -663,6 +782,7 @@ void sway_ipc_init ( void )
   vm_func_add("swaywincmd", sway_ipc_wincmd_action, TRUE, FALSE);
   sway_ipc_send(main_ipc, 2, "['workspace','mode','window','barconfig_update',\
       'binding','shutdown','tick','bar_state_update','input']");
+  sway_stream = json_stream_new(main_ipc, 14, sway_ipc_frame);
   g_io_add_watch(g_io_channel_unix_new(main_ipc), G_IO_IN, sway_ipc_event,
       NULL);
 }
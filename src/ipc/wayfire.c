@@ -38,7 +38,9 @@ typedef struct _wayfire_ipc_view {
 #define WAYFIRE_WORKSPACE_ID(wset,x,y) GINT_TO_POINTER((wset->id<<16)+((y)<<8)+x)
 
 static gint main_ipc;
-static GList *wset_list, *output_list, *view_list;
+static json_stream_t *main_stream;
+static GHashTable *wset_table, *output_table, *view_table;
+static GHashTable *wset_by_output, *wset_by_index;
 static gint focused_output;
 static gint layout_count, layout_current;
 static gchar **layout_list;
@@ -65,12 +67,20 @@ static gint wayfire_ipc_send_req ( gint sock, gchar *method,
   return res;
 }
 
+static gssize wayfire_ipc_frame ( const gchar *header )
+{
+  guint32 len;
+
+  memcpy(&len, header, sizeof(len));
+  return GUINT32_FROM_LE(len);
+}
+
 static struct json_object *wayfire_ipc_recv_msg ( gint sock )
 {
-  gint32 len;
+  gchar header[4];
 
-  if(recv(sock, &len, 4, 0) == 4)
-    return recv_json(sock, GUINT32_FROM_LE(len));
+  if(recv_retry(sock, header, 4))
+    return recv_json(sock, wayfire_ipc_frame(header));
   return NULL;
 }
 
@@ -89,37 +99,23 @@ static void wayfire_ipc_wm_action ( void *wid, gchar *action, gboolean state )
 
 static wayfire_ipc_view_t *wayfire_ipc_view_get ( gint id )
 {
-  GList *iter;
-
-  for(iter=view_list; iter; iter=g_list_next(iter))
-    if(((wayfire_ipc_view_t *)(iter->data))->id == id)
-      return iter->data;
-  return NULL;
-}
-
-static gboolean wayfire_ipc_wset_by_output ( const void *wset, const void *o )
-{
-  return WAYFIRE_WSET(wset)->output != GPOINTER_TO_INT(o);
+  return g_hash_table_lookup(view_table, GINT_TO_POINTER(id));
 }
 
 static wayfire_ipc_wset_t *wayfire_ipc_wset_get ( gint id )
 {
-  GList *iter;
-
-  for(iter=wset_list; iter; iter=g_list_next(iter))
-    if(WAYFIRE_WSET(iter->data)->id == id)
-      return iter->data;
-  return NULL;
+  return g_hash_table_lookup(wset_table, GINT_TO_POINTER(id));
 }
 
 static wayfire_ipc_output_t *wayfire_ipc_output_get ( gint id )
 {
-  GList *iter;
+  return g_hash_table_lookup(output_table, GINT_TO_POINTER(id));
+}
 
-  for(iter=output_list; iter; iter=g_list_next(iter))
-    if(WAYFIRE_OUTPUT(iter->data)->id == id)
-      return iter->data;
-  return NULL;
+static void wayfire_ipc_output_free ( wayfire_ipc_output_t *output )
+{
+  g_free(output->name);
+  g_free(output);
 }
 
 static void wayfire_ipc_minimize ( gpointer wid )
@@ -248,7 +244,8 @@ static guint wayfire_ipc_get_geom ( gpointer wid, GdkRectangle *place,
 {
   wayfire_ipc_wset_t *wset;
   wayfire_ipc_output_t *output;
-  GList *iter;
+  wayfire_ipc_view_t *view;
+  GHashTableIter iter;
   gint n, c, wx, wy;
 
   if( !(wset = wayfire_ipc_wset_get(GPOINTER_TO_INT(wsid)>>16)) )
@@ -256,17 +253,9 @@ static guint wayfire_ipc_get_geom ( gpointer wid, GdkRectangle *place,
   if( !(output = wayfire_ipc_output_get(wset->output)) )
     return 0;
 
-  n=0;
+  n = g_hash_table_size(view_table);
   wx = ((GPOINTER_TO_INT(wsid) & 0xff) - wset->x) * output->geo.width;
   wy = (((GPOINTER_TO_INT(wsid) & 0xff00)>>8) - wset->y) * output->geo.height;
-  for(iter=view_list; iter; iter=g_list_next(iter))
-    if(WAYFIRE_VIEW(iter->data)->wsetid == wset->id &&
-        WAYFIRE_VIEW(iter->data)->rect.x >= wx &&
-        WAYFIRE_VIEW(iter->data)->rect.y >= wy &&
-        WAYFIRE_VIEW(iter->data)->rect.x < wx + output->geo.width &&
-        WAYFIRE_VIEW(iter->data)->rect.y < wy + output->geo.height &&
-        (!wid || WAYFIRE_VIEW(iter->data)->id != GPOINTER_TO_INT(wid)))
-      n++;
 
   space->x = 0;
   space->y = 0;
@@ -275,28 +264,26 @@ static guint wayfire_ipc_get_geom ( gpointer wid, GdkRectangle *place,
 
   *wins = g_malloc0(n * sizeof(GdkRectangle));
   c = 0;
-  for(iter=view_list; iter; iter=g_list_next(iter))
-    if(WAYFIRE_VIEW(iter->data)->wsetid == wset->id &&
-        WAYFIRE_VIEW(iter->data)->rect.x >= wx &&
-        WAYFIRE_VIEW(iter->data)->rect.y >= wy &&
-        WAYFIRE_VIEW(iter->data)->rect.x < wx + output->geo.width &&
-        WAYFIRE_VIEW(iter->data)->rect.y < wy + output->geo.height &&
-        c < n)
+  g_hash_table_iter_init(&iter, view_table);
+  while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&view))
+    if(view->wsetid == wset->id && view->rect.x >= wx && view->rect.y >= wy &&
+        view->rect.x < wx + output->geo.width &&
+        view->rect.y < wy + output->geo.height)
     {
-      if(!wid || WAYFIRE_VIEW(iter->data)->id != GPOINTER_TO_INT(wid))
+      if(!wid || view->id != GPOINTER_TO_INT(wid))
       {
-        (*wins)[c].x = WAYFIRE_VIEW(iter->data)->rect.x - wx;
-        (*wins)[c].y = WAYFIRE_VIEW(iter->data)->rect.y - wy;
-        (*wins)[c].width = WAYFIRE_VIEW(iter->data)->rect.width;
-        (*wins)[c].height = WAYFIRE_VIEW(iter->data)->rect.height;
+        (*wins)[c].x = view->rect.x - wx;
+        (*wins)[c].y = view->rect.y - wy;
+        (*wins)[c].width = view->rect.width;
+        (*wins)[c].height = view->rect.height;
         c++;
       }
       else if(place)
       {
-        place->x = WAYFIRE_VIEW(iter->data)->rect.x - wx;
-        place->y = WAYFIRE_VIEW(iter->data)->rect.y - wy;
-        place->width = WAYFIRE_VIEW(iter->data)->rect.width;
-        place->height = WAYFIRE_VIEW(iter->data)->rect.height;
+        place->x = view->rect.x - wx;
+        place->y = view->rect.y - wy;
+        place->width = view->rect.width;
+        place->height = view->rect.height;
       }
     }
 
@@ -350,7 +337,6 @@ static void wayfire_ipc_window_workspace_track ( struct json_object *json )
   wayfire_ipc_wset_t *wset;
   wayfire_ipc_view_t *view;
   struct json_object *geo;
-  GList *iter;
   gint wid, wsetidx, cx, cy;
 
   if( !(wid = json_int_by_name(json, "id", 0)) )
@@ -360,12 +346,9 @@ static void wayfire_ipc_window_workspace_track ( struct json_object *json )
   if(!json_object_object_get_ex(json, "geometry", &geo))
     return;
 
-  for(iter=wset_list; iter; iter=g_list_next(iter))
-    if(WAYFIRE_WSET(iter->data)->index == wsetidx)
-      break;
-  if(!iter)
+  if( !(wset = g_hash_table_lookup(wset_by_index,
+          GINT_TO_POINTER(wsetidx))) )
     return;
-  wset = iter->data;
   if( !(output = wayfire_ipc_output_get(wset->output)) )
     return;
 
@@ -373,7 +356,7 @@ static void wayfire_ipc_window_workspace_track ( struct json_object *json )
   {
     view = g_malloc0(sizeof(wayfire_ipc_view_t));
     view->id = GPOINTER_TO_INT(wid);
-    view_list = g_list_prepend(view_list, view);
+    g_hash_table_insert(view_table, GINT_TO_POINTER(view->id), view);
   }
 
   view->rect = json_rect_get(geo);
@@ -435,8 +418,7 @@ static void wayfire_ipc_window_new ( struct json_object *view )
 static void wayfire_ipc_window_delete ( gpointer wid )
 {
   wintree_window_delete(wid);
-  view_list = g_list_remove(view_list,
-      wayfire_ipc_view_get(GPOINTER_TO_INT(wid)));
+  g_hash_table_remove(view_table, wid);
 }
 
 static void wayfire_ipc_workspace_set_visible ( gpointer id )
@@ -468,7 +450,7 @@ static wayfire_ipc_output_t *wayfire_ipc_output_new ( struct json_object *json,
     output = g_malloc0(sizeof(wayfire_ipc_output_t));
     output->name = g_strdup(json_string_by_name(json, "name"));
     output->id = id;
-    output_list = g_list_prepend(output_list, output);
+    g_hash_table_insert(output_table, GINT_TO_POINTER(id), output);
     g_debug("wayfire: new output: %s, id: %d", output->name, output->id);
   }
   if(json_object_object_get_ex(json, "geometry", &ptr))
@@ -502,7 +484,9 @@ static wayfire_ipc_wset_t *wayfire_ipc_wset_new ( struct json_object *json )
     wset->output = json_int_by_name(json, "output-id", 0);
     wset->w = json_int_by_name(wspace, "grid_width", 0); 
     wset->h = json_int_by_name(wspace, "grid_height", 0);
-    wset_list = g_list_prepend(wset_list, wset);
+    g_hash_table_insert(wset_table, GINT_TO_POINTER(wsetid), wset);
+    g_hash_table_insert(wset_by_output, GINT_TO_POINTER(wset->output), wset);
+    g_hash_table_insert(wset_by_index, GINT_TO_POINTER(wset->index), wset);
   }
   wset->x = json_int_by_name(wspace, "x", 0);
   wset->y = json_int_by_name(wspace, "y", 0);
@@ -533,7 +517,9 @@ static wayfire_ipc_wset_t *wayfire_ipc_wset_new ( struct json_object *json )
 static void wayfire_ipc_workspace_changed ( struct json_object *json )
 {
   wayfire_ipc_wset_t *wset;
+  wayfire_ipc_view_t *view;
   struct json_object *ptr;
+  GHashTableIter iter;
   gint wsetid, output, x, y;
 
   if(!json_object_object_get_ex(json, "new-workspace", &ptr))
@@ -556,27 +542,25 @@ static void wayfire_ipc_workspace_changed ( struct json_object *json )
     workspace_change_focus(WAYFIRE_WORKSPACE_ID(wset, x, y));
   wayfire_ipc_workspace_set_visible(WAYFIRE_WORKSPACE_ID(wset, x, y));
 
-  GList *iter;
-  for(iter=view_list; iter; iter=g_list_next(iter))
-    if(WAYFIRE_VIEW(iter->data)->wsetid == wset->id)
-      wintree_set_workspace(GINT_TO_POINTER(WAYFIRE_VIEW(iter->data)->id), WAYFIRE_WORKSPACE_ID(wset,
-          (WAYFIRE_VIEW(iter->data)->wx) + wset->x, WAYFIRE_VIEW(iter->data)->wy + wset->y));
+  g_hash_table_iter_init(&iter, view_table);
+  while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&view))
+    if(view->wsetid == wset->id)
+      wintree_set_workspace(GINT_TO_POINTER(view->id),
+          WAYFIRE_WORKSPACE_ID(wset, view->wx + wset->x, view->wy + wset->y));
 }
 
 static void wayfire_ipc_set_focused_output ( struct json_object *json )
 {
   wayfire_ipc_wset_t *wset;
-  GList *link;
   gint focus;
 
   if(!json || !(focus = json_int_by_name(json, "id", 0)) )
     return;
   focused_output = focus;
 
-  if( !(link = g_list_find_custom(wset_list, GINT_TO_POINTER(focused_output),
-          wayfire_ipc_wset_by_output)) )
+  if( !(wset = g_hash_table_lookup(wset_by_output,
+          GINT_TO_POINTER(focused_output))) )
     return;
-  wset = link->data;
   workspace_change_focus(WAYFIRE_WORKSPACE_ID(wset, wset->x, wset->y));
 }
 
@@ -609,18 +593,12 @@ static void wayfire_ipc_keyboard_state ( struct json_object *json )
   layout_current = json_int_by_name(json, "layout-index", -1);
 }
 
-static gboolean wayfire_ipc_event ( GIOChannel *chan, GIOCondition cond,
-    gpointer data )
+static void wayfire_ipc_event_handle ( struct json_object *json )
 {
-  struct json_object *json, *view;
+  struct json_object *view;
   window_t *win;
   const gchar *event;
   gpointer wid;
-  gint sock;
-
-  sock = g_io_channel_unix_get_fd(chan);
-  if( !(json = wayfire_ipc_recv_msg(sock)) )
-    return TRUE;
 
   g_debug("wayfire event: %s",
       json_object_to_json_string_ext(json, JSON_C_TO_STRING_PRETTY));
@@ -667,10 +645,48 @@ static gboolean wayfire_ipc_event ( GIOChannel *chan, GIOCondition cond,
       wayfire_ipc_set_focused_output(json_node_by_name(json, "output"));
     else if(!g_strcmp0(event, "keyboard-modifier-state-changed"))
       wayfire_ipc_keyboard_state(json_node_by_name(json, "state"));
+  }
+}
 
+static gboolean wayfire_ipc_event ( GIOChannel *chan, GIOCondition cond,
+    gpointer data )
+{
+  struct json_object *json;
+  gboolean alive;
+
+  if(main_ipc==-1)
+    return FALSE;
+
+  alive = json_stream_fill(main_stream);
+  while(json_stream_next(main_stream, NULL, &json))
+    if(json)
+    {
+      wayfire_ipc_event_handle(json);
+      json_object_put(json);
+    }
+
+  if(!alive)
+  {
+    g_debug("wayfire: ipc socket closed");
+    g_clear_pointer(&main_stream, json_stream_free);
+    close(main_ipc);
+    main_ipc = -1;
   }
-  json_object_put(json);
+  return alive;
+}
+
+static gboolean wayfire_ipc_wset_remove ( gpointer key, gpointer wset,
+    gpointer output )
+{
+  if(WAYFIRE_WSET(wset)->output != GPOINTER_TO_INT(output))
+    return FALSE;
 
+  if(g_hash_table_lookup(wset_by_output, output) == wset)
+    g_hash_table_remove(wset_by_output, output);
+  if(g_hash_table_lookup(wset_by_index,
+        GINT_TO_POINTER(WAYFIRE_WSET(wset)->index)) == wset)
+    g_hash_table_remove(wset_by_index,
+        GINT_TO_POINTER(WAYFIRE_WSET(wset)->index));
   return TRUE;
 }
 
@@ -678,28 +694,20 @@ static void wayfire_ipc_monitor_removed ( GdkDisplay *disp, GdkMonitor *mon )
 {
   wayfire_ipc_output_t *output;
   const gchar *output_name;
-  GList *iter, *link;
+  GHashTableIter iter;
  
   if( !(output_name = monitor_get_name(mon)) )
     return;
 
-  for(iter=output_list; iter; iter=g_list_next(iter))
-    if(!g_strcmp0(WAYFIRE_OUTPUT(iter->data)->name, output_name))
-      break;
-  if(!iter)
-    return;
-
-  output = iter->data;
-  while( (link = g_list_find_custom(wset_list, GINT_TO_POINTER(output->id),
-          wayfire_ipc_wset_by_output)) )
-  {
-    g_free(link->data);
-    wset_list = g_list_delete_link(wset_list, link);
-  }
-      
-  output_list = g_list_delete_link(output_list, iter);
-  g_free(output->name);
-  g_free(output);
+  g_hash_table_iter_init(&iter, output_table);
+  while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&output))
+    if(!g_strcmp0(output->name, output_name))
+    {
+      g_hash_table_foreach_remove(wset_table, wayfire_ipc_wset_remove,
+          GINT_TO_POINTER(output->id));
+      g_hash_table_iter_remove(&iter);
+      return;
+    }
 }
 
 void wayfire_ipc_init ( void )
@@ -719,6 +727,14 @@ void wayfire_ipc_init ( void )
 
   if( (main_ipc = socket_connect(sock_file, 3000))<=0 )
     return;
+  view_table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+      g_free);
+  wset_table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+      g_free);
+  output_table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify)wayfire_ipc_output_free);
+  wset_by_output = g_hash_table_new(g_direct_hash, g_direct_equal);
+  wset_by_index = g_hash_table_new(g_direct_hash, g_direct_equal);
   wintree_api_register(&wayfire_wintree_api);
   workspace_api_register(&wayfire_workspace_api);
   input_api_register(&wayfire_input_api);
@@ -778,6 +794,8 @@ void wayfire_ipc_init ( void )
   wayfire_ipc_send_req(main_ipc, "window-rules/events/watch", json);
   json_object_put(wayfire_ipc_recv_msg(main_ipc));
 
+  main_stream = json_stream_new(main_ipc, 4, wayfire_ipc_frame);
   chan = g_io_channel_unix_new(main_ipc);
-  g_io_add_watch(chan, G_IO_IN, wayfire_ipc_event, NULL);
+  g_io_add_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR, wayfire_ipc_event,
+      NULL);
 }
@@ -277,3 +277,45 @@ guint module_channel_watch_add ( GIOChannel *chan, gint pri, GIOCondition cond,
   g_source_set_callback(src, (GSourceFunc)func, d, free_func);
   return g_source_attach(src, g_main_context_get_thread_default());
 }
+
+gpointer module_snapshot_alloc ( gsize size )
+{
+  return g_atomic_rc_box_alloc0(size);
+}
+
+/* replace the current snapshot, taking ownership of data. The slot lock
+ * only covers the pointer swap, the old snapshot is freed by whichever of
+ * the publisher or its last reader drops the final reference */
+void module_snapshot_publish ( module_snapshot_t *slot, gpointer data )
+{
+  gpointer old;
+
+  g_mutex_lock(&slot->mutex);
+  old = slot->data;
+  slot->data = data;
+  g_mutex_unlock(&slot->mutex);
+
+  module_snapshot_release(slot, old);
+}
+
+/* get a reference to the current snapshot, the lock is held just long
+ * enough to take the reference */
+gpointer module_snapshot_acquire ( module_snapshot_t *slot )
+{
+  gpointer data;
+
+  g_mutex_lock(&slot->mutex);
+  if( (data = slot->data) )
+    g_atomic_rc_box_acquire(data);
+  g_mutex_unlock(&slot->mutex);
+
+  return data;
+}
+
+void module_snapshot_release ( module_snapshot_t *slot, gpointer data )
+{
+  if(data && slot->clear)
+    g_atomic_rc_box_release_full(data, slot->clear);
+  else if(data)
+    g_atomic_rc_box_release(data);
+}
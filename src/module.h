@@ -4,7 +4,7 @@
 
 #include <glib.h>
 
-#define MODULE_API_VERSION 3
+#define MODULE_API_VERSION 4
 
 typedef enum {
   MODULE_THREAD_MAIN,
@@ -24,6 +24,16 @@ typedef struct {
   void (*deactivate) (void);
 } ModuleInterfaceV1;
 
+/* immutable module state, which expression functions can read from any
+ * thread. Snapshots are allocated with module_snapshot_alloc, owned by
+ * the slot once published and freed using clear once the last reader
+ * releases them */
+typedef struct {
+  gpointer data;
+  GMutex mutex;
+  GDestroyNotify clear;
+} module_snapshot_t;
+
 typedef struct {
   GMutex mutex;
   GCond cond;
@@ -42,5 +52,9 @@ guint module_timeout_add ( guint i, GSourceFunc func, gpointer d );
 guint module_idle_add ( GSourceFunc func, gpointer d );
 guint module_channel_watch_add ( GIOChannel *chan, gint pri, GIOCondition cond,
     GIOFunc func, gpointer d, GDestroyNotify free_func );
+gpointer module_snapshot_alloc ( gsize size );
+void module_snapshot_publish ( module_snapshot_t *slot, gpointer data );
+gpointer module_snapshot_acquire ( module_snapshot_t *slot );
+void module_snapshot_release ( module_snapshot_t *slot, gpointer data );
 
 #endif
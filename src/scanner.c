@@ -112,12 +112,11 @@ static void scanner_handler_json_init ( source_t *src, src_handler_t *hnd )
   hnd->data = json_tokener_new();
 }
 
-void scanner_update_json1 ( scan_var_t *var, struct json_object *obj )
+static void scanner_update_json_values ( scan_var_t *var,
+    struct json_object *ptr )
 {
-  struct json_object *ptr;
   gint i;
 
-  ptr = jpath_parse(var->definition, obj);
   if(ptr && json_object_is_type(ptr, json_type_array))
     for(i=0; i<json_object_array_length(ptr); i++)
       scanner_var_values_update(var,
@@ -126,11 +125,45 @@ void scanner_update_json1 ( scan_var_t *var, struct json_object *obj )
     json_object_put(ptr);
 }
 
+void scanner_update_json1 ( scan_var_t *var, struct json_object *obj )
+{
+  if(!var->parse)
+    scanner_update_json_values(var, jpath_exec(var->definition, obj));
+}
+
 void scanner_update_json( json_object *obj, source_t *src )
 {
   g_list_foreach(src->vars, (GFunc)scanner_update_json1, obj);
 }
 
+/* update json variables as if obj was wrapped into { root: obj }, only if
+ * any of the variables may refer to root. Returns TRUE if the source was
+ * updated */
+gboolean scanner_update_json_root ( source_t *src, const gchar *root,
+    json_object *obj )
+{
+  GList *iter;
+  gboolean match = FALSE;
+
+  g_rec_mutex_lock(&src->mutex);
+  for(iter=src->vars; iter && !match; iter=g_list_next(iter))
+    match = !SCAN_VAR(iter->data)->parse &&
+      jpath_has_root(SCAN_VAR(iter->data)->definition, root);
+
+  if(match)
+  {
+    for(iter=src->vars; iter; iter=g_list_next(iter))
+      scanner_var_invalidate(0, iter->data, NULL);
+    for(iter=src->vars; iter; iter=g_list_next(iter))
+      if(!SCAN_VAR(iter->data)->parse)
+        scanner_update_json_values(iter->data, jpath_exec_root(
+              SCAN_VAR(iter->data)->definition, root, obj));
+  }
+  g_rec_mutex_unlock(&src->mutex);
+
+  return match;
+}
+
 static void scanner_handler_json_handle ( source_t *src, src_handler_t *hnd,
   GString *str )
 {
@@ -442,7 +475,8 @@ scan_var_t *scanner_var_new_json ( gchar *name, source_t *src, void *path )
   if( !(var = scanner_var_new(name, src)) )
     return NULL;
 
-  str_assign((gchar **)&var->definition, g_strdup(path));
+  jpath_free(var->definition);
+  var->definition = jpath_compile(path);
   scanner_source_handler_add(var->src, &src_handler_json);
 
   return scanner_var_attach(var);
@@ -86,6 +86,8 @@ void scanner_invalidate ( void );
 void scanner_var_invalidate ( GQuark key, scan_var_t *var, void *data );
 void scanner_var_reset ( scan_var_t *var, gpointer dummy );
 void scanner_update_json ( struct json_object *, source_t * );
+gboolean scanner_update_json_root ( source_t *src, const gchar *root,
+    struct json_object *obj );
 GIOStatus scanner_source_update ( GIOChannel *, source_t *, gsize * );
 value_t scanner_get_value ( GQuark id, gchar ftype, gboolean update,
     gboolean *vstate );
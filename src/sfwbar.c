@@ -29,6 +29,8 @@ static gchar *monitor;
 static gchar *bar_id;
 static GRegex *rfilter;
 static gboolean debug = FALSE;
+static gchar *record_file, *replay_file;
+static gdouble replay_speed = 1.0;
 
 void parse_command_line ( gint argc, gchar **argv)
 {
@@ -46,6 +48,12 @@ void parse_command_line ( gint argc, gchar **argv)
       "Monitor to display the panel on (use \"-m list\" to list monitors`"},
     {"bar_id",'b',0, G_OPTION_ARG_STRING, &bar_id,
       "default sway bar_id to listen on for sway events"},
+    {"ipc-record", 0, 0, G_OPTION_ARG_FILENAME, &record_file,
+      "Record compositor IPC traffic to a file"},
+    {"ipc-replay", 0, 0, G_OPTION_ARG_FILENAME, &replay_file,
+      "Replay compositor IPC traffic from a file"},
+    {"ipc-replay-speed", 0, 0, G_OPTION_ARG_DOUBLE, &replay_speed,
+      "IPC replay speed multiplier (0 to replay without delays)"},
     {NULL}};
 
   optc = g_option_context_new(" - S* Floating Window Bar");
@@ -111,6 +119,7 @@ static gboolean sfwbar_restart ( gchar **sargv )
   for(i=STDERR_FILENO+1; i<fdlimit; i++)
     if(fcntl(i, F_GETFD, 0)!=-1 && fcntl(i, F_SETFD, FD_CLOEXEC)==-1)
       g_error("Failed to set FD_CLOEXEC. Aborting restart.");
+  ipc_replay_cleanup();
   g_debug("reload: exec: %s", sargv[0]);
   execvp(sargv[0], sargv);
   exit(1);
@@ -136,6 +145,7 @@ static void activate (GtkApplication* app, gpointer data )
   monitor_init(monitor);
   capture_init();
   ext_ftl_init();
+  ipc_replay_init(record_file, replay_file, replay_speed);
   sway_ipc_init();
   hypr_ipc_init();
   wayfire_ipc_init();
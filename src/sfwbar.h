@@ -13,6 +13,9 @@ void action_lib_init ( void );
 void hypr_ipc_init ( void );
 void wayfire_ipc_init ( void );
 void niri_ipc_init ( void );
+void ipc_replay_init ( const gchar *record, const gchar *replay,
+    gdouble speed );
+void ipc_replay_cleanup ( void );
 void scanner_init ( void );
 void expr_init ( void );
 
@@ -51,6 +51,8 @@ typedef struct sni_item {
   gchar *dest;
   gchar *path;
   gchar *string[SNI_MAX_STRING];
+  GVariant *pixmap[3];
+  gint icon_size;
   gchar *menu_path;
   gchar *tooltip;
   gboolean menu;
@@ -79,6 +81,7 @@ void sni_item_free ( sni_item_t *sni );
 GList *sni_item_get_list ( void );
 gchar *sni_item_tooltip ( sni_item_t *item );
 gchar *sni_item_icon ( sni_item_t *item );
+void sni_item_set_icon_size ( sni_item_t *item, gint size );
 void sni_menu_init ( sni_item_t *sni );
 
 #endif
@@ -12,8 +12,9 @@ struct sni_prop_wrapper {
   sni_item_t *sni;
 };
 
+#define SNI_ICON_SIZE 32
+
 static GList *sni_items;
-static guint pix_counter;
 static GList *sni_listeners;
 
 static gchar *sni_properties[] = { "Category", "Id", "Title", "Status",
@@ -90,48 +91,122 @@ gchar *sni_item_tooltip ( sni_item_t *item )
   return NULL;
 }
 
-static gchar *sni_item_get_pixbuf ( GVariant *v )
+/* pick the smallest pixmap covering the target size, or the largest one
+ * if none does */
+static GVariant *sni_item_pixmap_select ( GVariant *v, gint target, gint *w,
+    gint *h )
+{
+  GVariantIter iter;
+  GVariant *img, *best = NULL;
+  gint32 x, y, bx = 0, by = 0, size;
+
+  g_variant_iter_init(&iter, v);
+  while(g_variant_iter_next(&iter, "(ii@ay)", &x, &y, &img))
+  {
+    size = MIN(x, y);
+    if(x<=0 || y<=0 || g_variant_get_size(img) != (gsize)x*y*4 || (best &&
+          (MIN(bx, by) >= target? size < target || size >= MIN(bx, by) :
+           size <= MIN(bx, by))) )
+    {
+      g_variant_unref(img);
+      continue;
+    }
+    if(best)
+      g_variant_unref(best);
+    best = img;
+    bx = x;
+    by = y;
+  }
+
+  *w = bx;
+  *h = by;
+  return best;
+}
+
+/* x*a/255 rounded to nearest, without a division */
+#define SNI_PREMUL(x, a) (((x)*(a) + 128 + (((x)*(a) + 128)>>8))>>8)
+
+/* convert big endian non-premultiplied ARGB to cairo's native endian
+ * premultiplied ARGB32. Each pixel is loaded as a single byte swapped word
+ * and opaque or transparent pixels, the bulk of most icons, skip the
+ * multiplications */
+static void sni_item_pixmap_convert ( guint32 *restrict dst,
+    const guint8 *restrict src, gsize n )
+{
+  guint32 p, a;
+  gsize i;
+
+  for(i=0; i<n; i++)
+  {
+    memcpy(&p, src + i*4, sizeof(p));
+    p = GUINT32_FROM_BE(p);
+    a = p>>24;
+    if(a == 0xff)
+      dst[i] = p;
+    else if(!a)
+      dst[i] = 0;
+    else
+      dst[i] = a<<24 | SNI_PREMUL((p>>16) & 0xff, a)<<16 |
+        SNI_PREMUL((p>>8) & 0xff, a)<<8 | SNI_PREMUL(p & 0xff, a);
+  }
+}
+
+static gchar *sni_item_get_pixbuf ( GVariant *v, gint size )
 {
-  GVariant *img,*child;
+  GVariant *img;
   cairo_surface_t *cs;
-  GdkPixbuf *res;
-  gint32 x,y;
-  guint32 *ptr;
-  gsize len, i;
-  gchar *name;
+  guchar *data;
+  gint x, y, i, stride;
 
   if(!v || !g_variant_check_format_string(v, "a(iiay)", FALSE) ||
-      g_variant_n_children(v) < 1)
+      !(img = sni_item_pixmap_select(v, size, &x, &y)) )
     return NULL;
 
-  child = g_variant_get_child_value(v, 0);
-
-  g_variant_get(child, "(ii@ay)", &x, &y, &img);
-  ptr = (guint32 *)g_variant_get_fixed_array(img, &len, sizeof(guchar));
-
-  if(!len || !ptr || len != x*y*4)
+  cs = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, x, y);
+  if(cairo_surface_status(cs) != CAIRO_STATUS_SUCCESS)
   {
+    cairo_surface_destroy(cs);
     g_variant_unref(img);
-    g_variant_unref(child);
     return NULL;
   }
 
-  ptr = g_memdup2(ptr, len);
+  cairo_surface_flush(cs);
+  data = cairo_image_surface_get_data(cs);
+  stride = cairo_image_surface_get_stride(cs);
+  for(i=0; i<y; i++)
+    sni_item_pixmap_convert((guint32 *)(data + i*stride),
+        (const guint8 *)g_variant_get_data(img) + i*x*4, x);
+  cairo_surface_mark_dirty(cs);
   g_variant_unref(img);
-  g_variant_unref(child);
-  for(i=0; i<x*y; i++)
-    ptr[i] = g_ntohl(ptr[i]);
 
-  cs = cairo_image_surface_create_for_data((guchar *)ptr, CAIRO_FORMAT_ARGB32,
-      x, y, cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, x));
-  res = gdk_pixbuf_get_from_surface(cs, 0, 0, x, y);
-  cairo_surface_destroy(cs);
-  g_free(ptr);
+  return scale_image_cache_insert_surface(cs);
+}
+
+static void sni_item_pixmap_update ( sni_item_t *sni, guint prop )
+{
+  gchar *pixbuf;
+
+  pixbuf = sni_item_get_pixbuf(sni->pixmap[prop-SNI_PROP_ICONPIX],
+      sni->icon_size? sni->icon_size : SNI_ICON_SIZE);
+  scale_image_cache_unref(sni->string[prop]);
+  g_free(sni->string[prop]);
+  sni->string[prop] = pixbuf;
+}
 
-  name = g_strdup_printf("<pixbufcache/>sni-%u", pix_counter++);
-  scale_image_cache_insert(name, res);
+/* the pixmaps are kept, so they can be selected again once a tray icon
+ * turns out to be larger than the pixmaps in use. size is in device pixels */
+void sni_item_set_icon_size ( sni_item_t *sni, gint size )
+{
+  gint i;
 
-  return name;
+  if(size <= sni->icon_size)
+    return;
+
+  sni->icon_size = size;
+  for(i=SNI_PROP_ICONPIX; i<=SNI_PROP_ATTNPIX; i++)
+    if(sni->pixmap[i-SNI_PROP_ICONPIX])
+      sni_item_pixmap_update(sni, i);
+  LISTENER_CALL(sni_invalidate, sni);
 }
 
 gchar *sni_item_get_tooltip ( GVariant *v )
@@ -178,9 +253,10 @@ void sni_item_prop_cb ( GDBusConnection *con, GAsyncResult *res,
   }
   else if(wrap->prop>=SNI_PROP_ICONPIX && wrap->prop<=SNI_PROP_ATTNPIX)
   {
-    scale_image_cache_remove(wrap->sni->string[wrap->prop]);
-    g_clear_pointer(&(wrap->sni->string[wrap->prop]), g_free);
-    wrap->sni->string[wrap->prop] = sni_item_get_pixbuf(inner);
+    g_clear_pointer(&wrap->sni->pixmap[wrap->prop-SNI_PROP_ICONPIX],
+        g_variant_unref);
+    wrap->sni->pixmap[wrap->prop-SNI_PROP_ICONPIX] = g_variant_ref(inner);
+    sni_item_pixmap_update(wrap->sni, wrap->prop);
     g_debug("sni %s: property %s received", wrap->sni->dest,
         sni_properties[wrap->prop]);
   }
@@ -311,7 +387,10 @@ void sni_item_free ( sni_item_t *sni )
   g_cancellable_cancel(sni->cancel);
   g_object_unref(sni->cancel);
   for(i=0; i<3; i++)
-    scale_image_cache_remove(sni->string[SNI_PROP_ICONPIX+i]);
+  {
+    scale_image_cache_unref(sni->string[SNI_PROP_ICONPIX+i]);
+    g_clear_pointer(&sni->pixmap[i], g_variant_unref);
+  }
   for(i=0; i<SNI_MAX_STRING; i++)
     g_free(sni->string[i]);
 
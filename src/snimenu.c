@@ -22,7 +22,6 @@ gchar *sni_menu_get_pixbuf ( GVariant *dict, gchar *key )
   GVariant *ptr;
   GdkPixbufLoader *loader;
   GdkPixbuf *pixbuf;
-  static gint pb_counter;
   guchar *buff;
   gchar *id = NULL;
   gsize len;
@@ -38,10 +37,7 @@ gchar *sni_menu_get_pixbuf ( GVariant *dict, gchar *key )
     gdk_pixbuf_loader_write(loader, buff, len, NULL);
     gdk_pixbuf_loader_close(loader, NULL);
     if( (pixbuf = gdk_pixbuf_loader_get_pixbuf(loader)) )
-    {
-      id = g_strdup_printf("<pixbufcache/>snimenu-%d", pb_counter++);
-      scale_image_cache_insert(id, gdk_pixbuf_copy(pixbuf));
-    }
+      id = scale_image_cache_insert(g_object_ref(pixbuf));
     g_object_unref(G_OBJECT(loader));
   }
 
@@ -112,7 +108,7 @@ static gboolean sni_menu_cancel_ats_suppression ( GtkWidget *menu_obj )
 
 static void sni_menu_pixbuf_free ( gchar *id )
 {
-  scale_image_cache_remove(id);
+  scale_image_cache_unref(id);
   g_free(id);
 }
 
@@ -0,0 +1,131 @@
+/* This entire file is licensed under GNU General Public License v3.0
+ *
+ * Copyright 2025- sfwbar maintainers
+ */
+
+#include "util/clock.h"
+
+#define CLOCK_FORMAT_CACHE_MAX 64
+
+static GHashTable *clock_tz_cache, *clock_format_cache;
+static GTimeZone *clock_tz_local;
+static GMutex clock_mutex;
+
+static void clock_format_free ( clock_format_t *entry )
+{
+  g_free(entry->str);
+  g_free(entry);
+}
+
+static GTimeZone *clock_tz_get_unlocked ( const gchar *id )
+{
+  GTimeZone *tz;
+
+  if(!id)
+  {
+    if(!clock_tz_local)
+      clock_tz_local = g_time_zone_new_local();
+    return clock_tz_local;
+  }
+
+  if(!clock_tz_cache)
+    clock_tz_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify)g_time_zone_unref);
+  if( (tz = g_hash_table_lookup(clock_tz_cache, id)) )
+    return tz;
+
+#if GLIB_MAJOR_VERSION == 2 && GLIB_MINOR_VERSION >= 68
+  if( !(tz = g_time_zone_new_identifier(id)) )
+    tz = g_time_zone_new_utc();
+#else
+  tz = g_time_zone_new(id);
+#endif
+  g_hash_table_insert(clock_tz_cache, g_strdup(id), tz);
+
+  return tz;
+}
+
+/* time zones are looked up once per identifier (NULL for local time) and
+ * live as long as the process */
+GTimeZone *clock_tz_get ( const gchar *id )
+{
+  GTimeZone *tz;
+
+  g_mutex_lock(&clock_mutex);
+  tz = clock_tz_get_unlocked(id);
+  g_mutex_unlock(&clock_mutex);
+
+  return tz;
+}
+
+/* format the current time, each format/time zone pair is rendered once per
+ * second no matter how many widgets ask for it */
+gchar *clock_format ( const gchar *format, const gchar *tzid )
+{
+  clock_format_t *entry;
+  GDateTime *utc, *time;
+  gint64 now, second;
+  gchar *key, *str;
+
+  now = g_get_real_time();
+  second = now / G_USEC_PER_SEC;
+
+  g_mutex_lock(&clock_mutex);
+  if(strstr(format, "%f"))
+  {
+    time = g_date_time_new_now(clock_tz_get_unlocked(tzid));
+    g_mutex_unlock(&clock_mutex);
+    str = g_date_time_format(time, format);
+    g_date_time_unref(time);
+    return str;
+  }
+
+  if(!clock_format_cache ||
+      g_hash_table_size(clock_format_cache) > CLOCK_FORMAT_CACHE_MAX)
+  {
+    g_clear_pointer(&clock_format_cache, g_hash_table_destroy);
+    clock_format_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+        g_free, (GDestroyNotify)clock_format_free);
+  }
+
+  key = g_strconcat(tzid? tzid : "", "\n", format, NULL);
+  if( !(entry = g_hash_table_lookup(clock_format_cache, key)) )
+  {
+    entry = g_malloc0(sizeof(clock_format_t));
+    entry->second = -1;
+    g_hash_table_insert(clock_format_cache, key, entry);
+  }
+  else
+    g_free(key);
+
+  if(entry->second != second)
+  {
+    utc = g_date_time_new_from_unix_utc(second);
+    time = g_date_time_to_timezone(utc, clock_tz_get_unlocked(tzid));
+    g_free(entry->str);
+    entry->str = g_date_time_format(time, format);
+    entry->second = second;
+    g_date_time_unref(time);
+    g_date_time_unref(utc);
+  }
+  str = g_strdup(entry->str);
+  g_mutex_unlock(&clock_mutex);
+
+  return str;
+}
+
+/* microseconds until the local wall clock crosses the next multiple of
+ * interval, i.e. the next second or minute edge */
+gint64 clock_edge_delay ( gint64 interval )
+{
+  GTimeZone *tz;
+  gint64 wall, delay;
+
+  wall = g_get_real_time();
+  tz = clock_tz_get(NULL);
+  wall += (gint64)g_time_zone_get_offset(tz, g_time_zone_find_interval(tz,
+        G_TIME_TYPE_UNIVERSAL, wall / G_USEC_PER_SEC)) * G_USEC_PER_SEC;
+  delay = interval - wall % interval;
+
+  return delay? delay : interval;
+}
@@ -0,0 +1,15 @@
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+
+#include <glib.h>
+
+typedef struct _clock_format {
+  gint64 second;
+  gchar *str;
+} clock_format_t;
+
+GTimeZone *clock_tz_get ( const gchar *id );
+gchar *clock_format ( const gchar *format, const gchar *tzid );
+gint64 clock_edge_delay ( gint64 interval );
+
+#endif
@@ -0,0 +1,144 @@
+/* This entire file is licensed under GNU General Public License v3.0
+ *
+ * Copyright 2025- sfwbar maintainers
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "util/disk.h"
+
+/* how long an evaluation waits for statvfs before using the last result */
+#define DISK_TIMEOUT 250000
+#define DISK_MIN_THREADS 4
+
+static GHashTable *disk_stats;
+static GThreadPool *disk_pool;
+static GMutex disk_mutex;
+static GCond disk_cond;
+static guint disk_cycle;
+
+static void disk_stat_worker ( disk_stat_t *disk, gpointer d )
+{
+  struct statvfs fs;
+  gboolean valid;
+
+  valid = !statvfs(disk->path, &fs);
+
+  g_mutex_lock(&disk_mutex);
+  if(valid)
+    disk->fs = fs;
+  disk->valid = valid;
+  disk->pending = FALSE;
+  g_cond_broadcast(&disk_cond);
+  g_mutex_unlock(&disk_mutex);
+}
+
+static void disk_stat_invalidate ( gchar *path, disk_stat_t *disk,
+    gboolean *drop )
+{
+  disk->invalid = TRUE;
+  if(*drop)
+    disk->valid = FALSE;
+}
+
+void disk_invalidate ( void )
+{
+  gboolean drop = FALSE;
+
+  g_mutex_lock(&disk_mutex);
+  disk_cycle++;
+  if(disk_stats)
+    g_hash_table_foreach(disk_stats, (GHFunc)disk_stat_invalidate, &drop);
+  g_mutex_unlock(&disk_mutex);
+}
+
+#ifdef __linux__
+/* the mount table changed, results for a path may now belong to a different
+ * filesystem */
+static gboolean disk_mounts_cb ( GIOChannel *chan, GIOCondition cond,
+    gpointer d )
+{
+  gchar buf[4096];
+  gboolean drop = TRUE;
+  gint fd;
+
+  fd = g_io_channel_unix_get_fd(chan);
+  lseek(fd, 0, SEEK_SET);
+  while(read(fd, buf, sizeof(buf))>0);
+
+  g_debug("disk: mount table changed");
+  g_mutex_lock(&disk_mutex);
+  g_hash_table_foreach(disk_stats, (GHFunc)disk_stat_invalidate, &drop);
+  g_mutex_unlock(&disk_mutex);
+
+  return TRUE;
+}
+
+static void disk_mounts_watch ( void )
+{
+  GIOChannel *chan;
+  gint fd;
+
+  if( (fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC)) < 0 )
+    return;
+  chan = g_io_channel_unix_new(fd);
+  g_io_channel_set_close_on_unref(chan, TRUE);
+  g_io_add_watch(chan, G_IO_PRI | G_IO_ERR, disk_mounts_cb, NULL);
+  g_io_channel_unref(chan);
+}
+#else
+static void disk_mounts_watch ( void )
+{
+}
+#endif
+
+/* statvfs each path at most once per refresh cycle. The call runs on a
+ * worker thread, so a hung mount only delays the caller by DISK_TIMEOUT in
+ * the cycle the query was issued and reports the last known result until it
+ * returns. A path is never queued twice and the pool has a thread per path,
+ * so a hung mount can't hold up queries for other paths */
+gboolean disk_stat_get ( const gchar *path, struct statvfs *fs )
+{
+  disk_stat_t *disk;
+  gboolean valid;
+  gint64 end;
+
+  g_mutex_lock(&disk_mutex);
+  if(!disk_stats)
+  {
+    disk_stats = g_hash_table_new(g_str_hash, g_str_equal);
+    disk_pool = g_thread_pool_new((GFunc)disk_stat_worker, NULL,
+        DISK_MIN_THREADS, FALSE, NULL);
+    disk_mounts_watch();
+  }
+
+  if( !(disk = g_hash_table_lookup(disk_stats, path)) )
+  {
+    disk = g_malloc0(sizeof(disk_stat_t));
+    disk->path = g_strdup(path);
+    disk->invalid = TRUE;
+    g_hash_table_insert(disk_stats, disk->path, disk);
+    g_thread_pool_set_max_threads(disk_pool,
+        MAX(DISK_MIN_THREADS, g_hash_table_size(disk_stats)), NULL);
+  }
+
+  if(disk->invalid && !disk->pending)
+  {
+    disk->invalid = FALSE;
+    disk->pending = TRUE;
+    disk->cycle = disk_cycle;
+    g_thread_pool_push(disk_pool, disk, NULL);
+  }
+
+  if(disk->cycle == disk_cycle)
+  {
+    end = g_get_monotonic_time() + DISK_TIMEOUT;
+    while(disk->pending && g_cond_wait_until(&disk_cond, &disk_mutex, end));
+  }
+
+  if( (valid = disk->valid) )
+    *fs = disk->fs;
+  g_mutex_unlock(&disk_mutex);
+
+  return valid;
+}
@@ -0,0 +1,19 @@
+#ifndef __DISK_H__
+#define __DISK_H__
+
+#include <glib.h>
+#include <sys/statvfs.h>
+
+typedef struct _disk_stat {
+  gchar *path;
+  struct statvfs fs;
+  gboolean valid;
+  gboolean invalid;
+  gboolean pending;
+  guint cycle;
+} disk_stat_t;
+
+gboolean disk_stat_get ( const gchar *path, struct statvfs *fs );
+void disk_invalidate ( void );
+
+#endif
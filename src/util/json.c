@@ -6,6 +6,18 @@
 #include "util/json.h"
 #include <sys/socket.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+#define JSON_STREAM_CHUNK 65536
+#define JSON_CONN_DEADLINE 5000
+
+typedef struct _json_conn_request {
+  json_reply_cb cb;
+  gpointer data;
+  GString *buf;
+  guint watch, deadline;
+} json_conn_request_t;
 
 gint socket_connect ( const gchar *sockaddr, gint to )
 {
@@ -38,46 +50,427 @@ gboolean recv_retry ( gint sock, gpointer buff, gsize len )
 
 json_object *recv_json ( gint sock, gssize len )
 {
-  static gchar *buf;
-  const gsize bufsize = 1024;
+  gchar buf[4096], *data;
   json_tokener *tok;
   json_object *json = NULL;
   gssize rlen;
 
-  if(!buf)
-    buf = g_malloc(bufsize);
-
   tok = json_tokener_new();
 
-  while(len && (rlen = recv(sock, buf, MIN(len<0?bufsize:len, bufsize), 0))>0 )
+  if(len>0)
   {
-    json = json_tokener_parse_ex(tok, buf, rlen);
-    if(len>0)
-      len-=MIN(rlen, MIN(len, bufsize));
+    data = g_malloc(len);
+    if(recv_retry(sock, data, len))
+      json = json_tokener_parse_ex(tok, data, len);
+    g_free(data);
   }
+  else
+    while(len && (rlen = recv(sock, buf, sizeof(buf), 0))>0 )
+      json = json_tokener_parse_ex(tok, buf, rlen);
   json_tokener_free(tok);
 
   return json;
 }
 
-json_object *json_recv_channel ( GIOChannel *chan )
+/* A json_stream_t buffers a non-blocking json message stream. If hlen is
+ * non-zero, each message is a header of hlen bytes followed by a payload,
+ * with the payload length extracted from the header by frame. Otherwise,
+ * messages are newline delimited */
+
+json_stream_t *json_stream_new ( gint sock, gsize hlen, json_frame_cb frame )
+{
+  json_stream_t *stream;
+
+  g_return_val_if_fail(!hlen || frame, NULL);
+
+  stream = g_malloc0(sizeof(json_stream_t));
+  stream->sock = sock;
+  stream->hlen = hlen;
+  stream->frame = frame;
+  stream->buf = g_byte_array_sized_new(JSON_STREAM_CHUNK);
+  stream->tok = json_tokener_new();
+
+  return stream;
+}
+
+void json_stream_free ( json_stream_t *stream )
+{
+  if(!stream)
+    return;
+  g_byte_array_unref(stream->buf);
+  json_tokener_free(stream->tok);
+  g_free(stream);
+}
+
+/* read all available data without blocking, FALSE on EOF or error */
+gboolean json_stream_fill ( json_stream_t *stream )
 {
-  gchar *buf;
+  gssize rlen;
   gsize len;
-  json_tokener *tok;
-  json_object *obj;
 
-  if(g_io_channel_read_line(chan, &buf, &len, NULL, NULL)==G_IO_STATUS_NORMAL)
+  g_return_val_if_fail(stream, FALSE);
+
+  if(stream->pos)
   {
-    tok = json_tokener_new();
-    obj = json_tokener_parse_ex(tok, buf, len);
-    json_tokener_free(tok);
+    g_byte_array_remove_range(stream->buf, 0, stream->pos);
+    stream->pos = 0;
+  }
+
+  do
+  {
+    len = stream->buf->len;
+    g_byte_array_set_size(stream->buf, len + JSON_STREAM_CHUNK);
+    rlen = recv(stream->sock, stream->buf->data + len, JSON_STREAM_CHUNK,
+        MSG_DONTWAIT);
+    g_byte_array_set_size(stream->buf, len + MAX(rlen, 0));
+  } while(rlen == JSON_STREAM_CHUNK);
+
+  if(!rlen)
+    return FALSE;
+  return (rlen>0 || errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR);
+}
+
+/* pop the next complete message from the buffer, if any. json is NULL if
+ * the message payload is empty or isn't valid json */
+gboolean json_stream_next ( json_stream_t *stream, gchar *header,
+    json_object **json )
+{
+  gchar *data, *end;
+  gsize avail;
+  gssize len;
+
+  g_return_val_if_fail(stream && json, FALSE);
+
+  data = (gchar *)stream->buf->data + stream->pos;
+  avail = stream->buf->len - stream->pos;
+
+  if(stream->hlen)
+  {
+    if(avail < stream->hlen)
+      return FALSE;
+    /* a bad header means we lost sync, drop everything we have */
+    if( (len = stream->frame(data))<0 )
+    {
+      g_byte_array_set_size(stream->buf, 0);
+      stream->pos = 0;
+      return FALSE;
+    }
+    if(avail - stream->hlen < (gsize)len)
+      return FALSE;
+    if(header)
+      memcpy(header, data, stream->hlen);
+    data += stream->hlen;
+    stream->pos += stream->hlen + len;
   }
   else
-    obj = NULL;
-  g_free(buf);
+  {
+    if( !(end = memchr(data, '\n', avail)) )
+      return FALSE;
+    len = end - data;
+    stream->pos += len + 1;
+  }
+
+  json_tokener_reset(stream->tok);
+  *json = len? json_tokener_parse_ex(stream->tok, data, len) : NULL;
+
+  return TRUE;
+}
+
+/* wait up to to milliseconds for data until a complete message arrives */
+gboolean json_stream_read ( json_stream_t *stream, gchar *header,
+    json_object **json, gint to )
+{
+  struct pollfd pfd;
+  gboolean alive = TRUE;
+
+  g_return_val_if_fail(stream, FALSE);
+
+  pfd.fd = stream->sock;
+  pfd.events = POLLIN;
+  while(!json_stream_next(stream, header, json))
+  {
+    if(!alive || poll(&pfd, 1, to)<=0)
+      return FALSE;
+    alive = json_stream_fill(stream);
+  }
+
+  return TRUE;
+}
+
+/* A json_conn_t is a request connection to a compositor IPC socket. If hlen
+ * is non-zero, the socket is kept open and each reply is a header of hlen
+ * bytes (payload length is extracted by frame) followed by a json payload.
+ * Replies arrive in request order, so requests can be pipelined and are
+ * completed from a main loop watch. If hlen is zero, the server closes the
+ * socket after each reply (i.e. hyprland), so every request gets its own
+ * socket and the reply is read until EOF */
+
+json_conn_t *json_conn_new ( const gchar *addr, gint to, gsize hlen,
+    json_frame_cb frame )
+{
+  json_conn_t *conn;
+
+  g_return_val_if_fail(addr, NULL);
+  g_return_val_if_fail(!hlen || frame, NULL);
+
+  conn = g_malloc0(sizeof(json_conn_t));
+  conn->addr = g_strdup(addr);
+  conn->timeout = to;
+  conn->hlen = hlen;
+  conn->frame = frame;
+  conn->sock = -1;
+  g_queue_init(&conn->pending);
+
+  return conn;
+}
+
+static void json_conn_reset ( json_conn_t *conn )
+{
+  json_conn_request_t *req;
+
+  if(conn->watch)
+    g_source_remove(conn->watch);
+  conn->watch = 0;
+  g_clear_handle_id(&conn->deadline, g_source_remove);
+  g_clear_pointer(&conn->chan, g_io_channel_unref);
+  g_clear_pointer(&conn->stream, json_stream_free);
+  if(conn->sock>=0)
+    close(conn->sock);
+  conn->sock = -1;
+
+  while( (req = g_queue_pop_head(&conn->pending)) )
+  {
+    if(req->cb)
+      req->cb(NULL, req->data);
+    g_free(req);
+  }
+}
+
+void json_conn_free ( json_conn_t *conn )
+{
+  if(!conn)
+    return;
+  json_conn_reset(conn);
+  g_free(conn->addr);
+  g_free(conn);
+}
+
+static gboolean json_conn_write ( gint sock, gconstpointer header, gsize hlen,
+    const gchar *body, gsize len )
+{
+  const gchar *ptr;
+  gssize wlen;
+  gsize rem;
+  gint i;
+
+  for(i=0; i<2; i++)
+  {
+    ptr = i? body : header;
+    rem = i? len : hlen;
+    while(rem>0)
+    {
+      if( (wlen = write(sock, ptr, rem))<0 && errno==EINTR )
+        continue;
+      if(wlen<=0)
+        return FALSE;
+      ptr += wlen;
+      rem -= wlen;
+    }
+  }
+
+  return TRUE;
+}
+
+
+/* replies can't be skipped on a pipelined connection, so if the oldest
+ * request goes unanswered, the connection is dropped and every pending
+ * callback fails */
+static gboolean json_conn_deadline_cb ( json_conn_t *conn )
+{
+  g_debug("ipc: no reply from %s", conn->addr);
+  conn->deadline = 0;
+  json_conn_reset(conn);
+  return G_SOURCE_REMOVE;
+}
+
+static void json_conn_deadline_arm ( json_conn_t *conn )
+{
+  g_clear_handle_id(&conn->deadline, g_source_remove);
+  if(!g_queue_is_empty(&conn->pending))
+    conn->deadline = g_timeout_add(JSON_CONN_DEADLINE,
+        (GSourceFunc)json_conn_deadline_cb, conn);
+}
+
+static void json_conn_dispatch ( json_conn_t *conn, json_object *json )
+{
+  json_conn_request_t *req;
+
+  if( (req = g_queue_pop_head(&conn->pending)) )
+  {
+    json_conn_deadline_arm(conn);
+    if(req->cb)
+      req->cb(json, req->data);
+    g_free(req);
+  }
+  json_object_put(json);
+}
+
+static gboolean json_conn_event ( GIOChannel *chan, GIOCondition cond,
+    gpointer data )
+{
+  json_conn_t *conn = data;
+  json_object *json;
+  gboolean alive;
+  guint watch = conn->watch;
+
+  alive = (cond & G_IO_IN) && json_stream_fill(conn->stream);
+  while(conn->watch == watch && json_stream_next(conn->stream, NULL, &json))
+    json_conn_dispatch(conn, json);
+
+  /* a callback has reset the connection and removed this watch */
+  if(conn->watch != watch)
+    return FALSE;
+
+  if(!alive)
+  {
+    g_debug("ipc: connection to %s lost", conn->addr);
+    conn->watch = 0;
+    json_conn_reset(conn);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+gboolean json_conn_connect ( json_conn_t *conn )
+{
+  g_return_val_if_fail(conn, FALSE);
+
+  if(!conn->hlen || conn->sock>=0)
+    return TRUE;
+  if( (conn->sock = socket_connect(conn->addr, conn->timeout))<0 )
+    return FALSE;
+  conn->stream = json_stream_new(conn->sock, conn->hlen, conn->frame);
+  conn->chan = g_io_channel_unix_new(conn->sock);
+  conn->watch = g_io_add_watch(conn->chan, G_IO_IN | G_IO_HUP | G_IO_ERR,
+      json_conn_event, conn);
+
+  return TRUE;
+}
+
+static void json_conn_oneshot_finish ( json_conn_request_t *req,
+    gboolean complete )
+{
+  json_object *json;
+
+  g_clear_handle_id(&req->deadline, g_source_remove);
+  if(req->cb)
+  {
+    json = complete && req->buf->len? json_tokener_parse(req->buf->str) :
+      NULL;
+    req->cb(json, req->data);
+    json_object_put(json);
+  }
+  g_string_free(req->buf, TRUE);
+  g_free(req);
+}
+
+static gboolean json_conn_oneshot_event ( GIOChannel *chan,
+    GIOCondition cond, gpointer data )
+{
+  json_conn_request_t *req = data;
+  gchar buf[4096];
+  gssize rlen;
+
+  if(cond & G_IO_IN)
+  {
+    rlen = recv(g_io_channel_unix_get_fd(chan), buf, sizeof(buf),
+        MSG_DONTWAIT);
+    if(rlen>0)
+    {
+      g_string_append_len(req->buf, buf, rlen);
+      return TRUE;
+    }
+    if(rlen<0 && (errno==EAGAIN || errno==EINTR))
+      return TRUE;
+  }
+
+  req->watch = 0;
+  json_conn_oneshot_finish(req, TRUE);
+
+  return FALSE;
+}
+
+/* removing the watch closes the socket */
+static gboolean json_conn_oneshot_deadline ( json_conn_request_t *req )
+{
+  req->deadline = 0;
+  g_clear_handle_id(&req->watch, g_source_remove);
+  json_conn_oneshot_finish(req, FALSE);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean json_conn_oneshot ( json_conn_t *conn, const gchar *body,
+    gsize len, json_reply_cb cb, gpointer data )
+{
+  json_conn_request_t *req;
+  GIOChannel *chan;
+  gint sock;
+
+  if( (sock = socket_connect(conn->addr, conn->timeout))<0 )
+    return FALSE;
+  if(!json_conn_write(sock, NULL, 0, body, len))
+  {
+    close(sock);
+    return FALSE;
+  }
+
+  req = g_malloc0(sizeof(json_conn_request_t));
+  req->cb = cb;
+  req->data = data;
+  req->buf = g_string_new(NULL);
+  chan = g_io_channel_unix_new(sock);
+  g_io_channel_set_close_on_unref(chan, TRUE);
+  req->watch = g_io_add_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR,
+      json_conn_oneshot_event, req);
+  req->deadline = g_timeout_add(JSON_CONN_DEADLINE,
+      (GSourceFunc)json_conn_oneshot_deadline, req);
+  g_io_channel_unref(chan);
+
+  return TRUE;
+}
+
+/* queue a request, cb (if any) is called with the reply from the main loop */
+gboolean json_conn_send ( json_conn_t *conn, gconstpointer header,
+    const gchar *body, gsize len, json_reply_cb cb, gpointer data )
+{
+  json_conn_request_t *req;
+  gint i;
+
+  g_return_val_if_fail(conn, FALSE);
+
+  if(!conn->hlen)
+    return json_conn_oneshot(conn, body, len, cb, data);
+
+  /* if the compositor dropped the connection, reconnect and retry once */
+  for(i=0; i<2; i++)
+  {
+    if(json_conn_connect(conn) &&
+        json_conn_write(conn->sock, header, conn->hlen, body, len))
+    {
+      req = g_malloc0(sizeof(json_conn_request_t));
+      req->cb = cb;
+      req->data = data;
+      g_queue_push_tail(&conn->pending, req);
+      if(!conn->deadline)
+        json_conn_deadline_arm(conn);
+      return TRUE;
+    }
+    json_conn_reset(conn);
+  }
 
-  return obj;
+  return FALSE;
 }
 
 /* get string value from an object within current object */
@@ -204,78 +597,154 @@ GdkRectangle json_rect_get ( struct json_object *json )
   return ret;
 }
 
-gboolean jpath_filter_test ( GScanner *scanner, gint idx, gchar *key,
-    gboolean eq, struct json_object *obj, GTokenType type, GTokenValue val )
+static void jpath_step_free ( jpath_step_t *step )
 {
-  struct json_object *tmp;
-
-  switch(type)
-  {
-    case ']':
-      return TRUE;
-      break;
-    case G_TOKEN_INT:
-      if(idx==val.v_int)
-        return TRUE;
-      break;
-    case G_TOKEN_STRING:
-      if(json_object_object_get_ex(obj, key, &tmp) && tmp)
-      {
-        if(!eq)
-          return TRUE;
-        if(scanner->token == G_TOKEN_STRING &&
-            !g_ascii_strcasecmp(val.v_string, json_object_get_string(tmp)))
-          return TRUE;
-        if(scanner->token == G_TOKEN_INT &&
-            val.v_int == json_object_get_int64(tmp))
-          return TRUE;
-        if(scanner->token == G_TOKEN_FLOAT &&
-            val.v_float == json_object_get_double(tmp))
-          return TRUE;
-      }
-      break;
-    default:
-      break;
-  }
-  return FALSE;
+  g_free(step->key);
+  g_free(step->str);
+  g_free(step);
 }
 
-struct json_object *jpath_filter (GScanner *scanner, struct json_object *obj )
+static void jpath_compile_filter ( GScanner *scanner, jpath_step_t *step )
 {
-  struct json_object *next, *iter, *jiter;
-  gint i,j;
-  gchar *key=NULL;
-  GTokenType type;
-  GTokenValue val;
-  gboolean eq = FALSE;
-
-  next = json_object_new_array();
-  type = g_scanner_get_next_token(scanner);
-  switch(type)
+  step->ftype = g_scanner_get_next_token(scanner);
+  switch(step->ftype)
   {
     case G_TOKEN_STRING:
-      key = g_strdup(scanner->value.v_string);
+      step->key = g_strdup(scanner->value.v_string);
       if(g_scanner_peek_next_token(scanner)=='=')
       {
-        eq = TRUE;
+        step->eq = TRUE;
         g_scanner_get_next_token(scanner);
         scanner->config->scan_float = 1;
-        g_scanner_get_next_token(scanner);
-        val = scanner->value;
+        step->vtype = g_scanner_get_next_token(scanner);
+        if(step->vtype == G_TOKEN_STRING)
+          step->str = g_strdup(scanner->value.v_string);
+        else if(step->vtype == G_TOKEN_INT)
+          step->ival = scanner->value.v_int;
+        else if(step->vtype == G_TOKEN_FLOAT)
+          step->fval = scanner->value.v_float;
         scanner->config->scan_float = 0;
       }
-      else
-        eq = FALSE;
       break;
     case ']':
-      break;
+      return;
     case G_TOKEN_INT:
-      val = scanner->value;
+      step->ival = scanner->value.v_int;
       break;
     default:
-      return next;
+      step->ftype = G_TOKEN_NONE;
+      return;
+  }
+
+  if(g_scanner_get_next_token(scanner)!=']')
+    g_scanner_error(scanner,"missing ']'");
+}
+
+/* compile a json path, so it can be applied repeatedly without reparsing */
+jpath_t *jpath_compile ( const gchar *path )
+{
+  GScanner *scanner;
+  jpath_t *jpath;
+  jpath_step_t *step;
+  gint sep;
+
+  if(!path)
+    return NULL;
+  scanner = g_scanner_new(NULL);
+  scanner->config->scan_octal = 0;
+  scanner->config->symbol_2_token = 1;
+  scanner->config->char_2_token = 0;
+  scanner->config->scan_float = 0;
+  scanner->config->case_sensitive = 0;
+  scanner->config->numbers_2_int = 1;
+  scanner->config->identifier_2_string = 1;
+  scanner->input_name = path;
+  g_scanner_input_text(scanner, path, strlen(path));
+
+  if(g_scanner_get_next_token(scanner)!=G_TOKEN_CHAR)
+  {
+    g_scanner_destroy(scanner);
+    return NULL;
+  }
+
+  sep = scanner->value.v_char;
+  scanner->config->char_2_token = 1;
+  jpath = g_ptr_array_new_with_free_func((GDestroyNotify)jpath_step_free);
+
+  do
+  {
+    step = g_malloc0(sizeof(jpath_step_t));
+    step->op = g_scanner_get_next_token(scanner);
+    switch(step->op)
+    {
+      case '[':
+        jpath_compile_filter(scanner, step);
+        break;
+      case G_TOKEN_STRING:
+        step->key = g_strdup(scanner->value.v_string);
+        break;
+      case G_TOKEN_INT:
+        step->ival = scanner->value.v_int;
+        break;
+      default:
+        g_scanner_error(scanner,"invalid token in json path %d %d",
+            scanner->token, G_TOKEN_ERROR);
+        g_clear_pointer(&step, jpath_step_free);
+        break;
+    }
+    if(step)
+      g_ptr_array_add(jpath, step);
+    /* an invalid filter matches nothing, so there is no point going on */
+    if(step && step->op=='[' && step->ftype==G_TOKEN_NONE)
       break;
+  } while ( g_scanner_get_next_token(scanner) == sep );
+
+  g_scanner_destroy( scanner );
+
+  return jpath;
+}
+
+void jpath_free ( jpath_t *jpath )
+{
+  if(jpath)
+    g_ptr_array_unref(jpath);
+}
+
+static gboolean jpath_filter_test ( jpath_step_t *step, gint idx,
+    struct json_object *obj )
+{
+  struct json_object *tmp;
+
+  switch(step->ftype)
+  {
+    case ']':
+      return TRUE;
+    case G_TOKEN_INT:
+      return idx>=0 && (gulong)idx==step->ival;
+    case G_TOKEN_STRING:
+      if(!json_object_object_get_ex(obj, step->key, &tmp) || !tmp)
+        return FALSE;
+      if(!step->eq)
+        return TRUE;
+      if(step->vtype == G_TOKEN_STRING)
+        return !g_ascii_strcasecmp(step->str, json_object_get_string(tmp));
+      if(step->vtype == G_TOKEN_INT)
+        return (gint64)step->ival == json_object_get_int64(tmp);
+      if(step->vtype == G_TOKEN_FLOAT)
+        return step->fval == json_object_get_double(tmp);
+      return FALSE;
+    default:
+      return FALSE;
   }
+}
+
+static struct json_object *jpath_filter ( jpath_step_t *step,
+    struct json_object *obj )
+{
+  struct json_object *next, *iter, *jiter;
+  gint i,j;
+
+  next = json_object_new_array();
 
   for(i=0; i<json_object_array_length(obj); i++)
   {
@@ -284,24 +753,19 @@ struct json_object *jpath_filter (GScanner *scanner, struct json_object *obj )
       for(j=0; j<json_object_array_length(iter); j++)
       {
         jiter = json_object_array_get_idx(iter, j);
-        if(jpath_filter_test(scanner, j, key, eq, jiter, type, val))
+        if(jpath_filter_test(step, j, jiter))
           json_object_array_add(next, jiter);
       }
     else
-      if(jpath_filter_test(scanner, -1, key, eq, iter, type, val))
+      if(jpath_filter_test(step, -1, iter))
         json_object_array_add(next, iter);
   }
 
-  if(type == G_TOKEN_STRING || type == G_TOKEN_INT)
-    if(g_scanner_get_next_token(scanner)!=']')
-      g_scanner_error(scanner,"missing ']'");
-  g_free(key);
-
   return next;
 }
 
-struct json_object *jpath_key ( GScanner *scanner, struct json_object *obj,
-   json_object *existing )
+static struct json_object *jpath_key ( const gchar *key,
+    struct json_object *obj, json_object *existing )
 {
   struct json_object *next, *iter, *tmp;
   gint i;
@@ -312,15 +776,14 @@ struct json_object *jpath_key ( GScanner *scanner, struct json_object *obj,
   {
     iter = json_object_array_get_idx(obj, i);
     if(json_object_is_type(iter, json_type_array))
-      jpath_key(scanner, iter, next);
-    else if(json_object_object_get_ex(json_object_array_get_idx(obj, i),
-        scanner->value.v_string, &tmp) && tmp)
+      jpath_key(key, iter, next);
+    else if(json_object_object_get_ex(iter, key, &tmp) && tmp)
       json_object_array_add(next, tmp);
   }
   return next;
 }
 
-struct json_object *jpath_index ( GScanner *scanner, struct json_object *obj )
+static struct json_object *jpath_index ( gint idx, struct json_object *obj )
 {
   struct json_object *next, *iter;
   gint i;
@@ -331,36 +794,45 @@ struct json_object *jpath_index ( GScanner *scanner, struct json_object *obj )
   {
     iter = json_object_array_get_idx(obj, i);
     if(json_object_is_type(iter, json_type_array))
-      json_object_array_add(next,
-           json_object_array_get_idx(iter, (gint)scanner->value.v_int));
+      json_object_array_add(next, json_object_array_get_idx(iter, idx));
   }
   return next;
 }
 
-struct json_object *jpath_parse ( gchar *path, struct json_object *obj )
+/* apply steps from start onwards to cur, consuming the reference to cur */
+static struct json_object *jpath_exec_from ( jpath_t *jpath, guint start,
+    struct json_object *cur )
 {
-  GScanner *scanner;
-  struct json_object *cur,*next;
-  gint i, sep;
+  struct json_object *next;
+  jpath_step_t *step;
+  guint i;
+  gint j;
 
-  if(!path || !obj)
-    return NULL;
-  scanner = g_scanner_new(NULL);
-  scanner->config->scan_octal = 0;
-  scanner->config->symbol_2_token = 1;
-  scanner->config->char_2_token = 0;
-  scanner->config->scan_float = 0;
-  scanner->config->case_sensitive = 0;
-  scanner->config->numbers_2_int = 1;
-  scanner->config->identifier_2_string = 1;
-  scanner->input_name = path;
-  g_scanner_input_text(scanner, path, strlen(path));
+  for(i=start; i<jpath->len; i++)
+  {
+    step = g_ptr_array_index(jpath, i);
+    if(step->op=='[')
+      next = jpath_filter(step, cur);
+    else if(step->op==G_TOKEN_STRING)
+      next = jpath_key(step->key, cur, NULL);
+    else
+      next = jpath_index(step->ival, cur);
 
-  if(g_scanner_get_next_token(scanner)!=G_TOKEN_CHAR)
-    return NULL;
+    for(j=0; j<json_object_array_length(next); j++)
+      json_object_get(json_object_array_get_idx(next, j));
+    json_object_put(cur);
+    cur = next;
+  }
 
-  sep = scanner->value.v_char;
-  scanner->config->char_2_token = 1;
+  return cur;
+}
+
+struct json_object *jpath_exec ( jpath_t *jpath, struct json_object *obj )
+{
+  struct json_object *cur;
+
+  if(!jpath || !obj)
+    return NULL;
 
   json_object_get(obj);
   if(json_object_is_type(obj, json_type_array))
@@ -371,34 +843,58 @@ struct json_object *jpath_parse ( gchar *path, struct json_object *obj )
     json_object_array_add(cur, obj);
   }
 
-  do 
+  return jpath_exec_from(jpath, 0, cur);
+}
+
+/* check if a path may match anything in an object { root: ... } */
+gboolean jpath_has_root ( jpath_t *jpath, const gchar *root )
+{
+  jpath_step_t *step;
+
+  if(!jpath)
+    return FALSE;
+  if(!jpath->len)
+    return TRUE;
+
+  step = g_ptr_array_index(jpath, 0);
+  return step->op!=G_TOKEN_STRING || !g_strcmp0(step->key, root);
+}
+
+/* apply a path to an object { root: obj } without constructing it */
+struct json_object *jpath_exec_root ( jpath_t *jpath, const gchar *root,
+    struct json_object *obj )
+{
+  struct json_object *wrap, *cur;
+  jpath_step_t *step;
+
+  if(!jpath || !obj || !jpath_has_root(jpath, root))
+    return NULL;
+
+  step = jpath->len? g_ptr_array_index(jpath, 0) : NULL;
+  if(!step || step->op!=G_TOKEN_STRING)
   {
-    switch((gint)g_scanner_get_next_token(scanner))
-    {
-      case '[':
-        next = jpath_filter(scanner, cur);
-        break;
-      case G_TOKEN_STRING:
-        next = jpath_key(scanner, cur, NULL);
-        break;
-      case G_TOKEN_INT:
-        next = jpath_index(scanner, cur);
-        break;
-      default:
-        g_scanner_error(scanner,"invalid token in json path %d %d",scanner->token,G_TOKEN_ERROR);
-        next = NULL;
-        break;
-    }
-    if(next)
-    {
-      for(i=0; i<json_object_array_length(next); i++)
-        json_object_get(json_object_array_get_idx(next, i));
-      json_object_put(cur);
-      cur = next;
-    }
-  } while ( g_scanner_get_next_token(scanner) == sep );
+    wrap = json_object_new_object();
+    json_object_object_add(wrap, root, json_object_get(obj));
+    cur = jpath_exec(jpath, wrap);
+    json_object_put(wrap);
+    return cur;
+  }
 
-  g_scanner_destroy( scanner );
+  cur = json_object_new_array();
+  json_object_array_add(cur, json_object_get(obj));
+  return jpath_exec_from(jpath, 1, cur);
+}
 
-  return cur;
+struct json_object *jpath_parse ( gchar *path, struct json_object *obj )
+{
+  struct json_object *result;
+  jpath_t *jpath;
+
+  if(!path || !obj)
+    return NULL;
+  jpath = jpath_compile(path);
+  result = jpath_exec(jpath, obj);
+  jpath_free(jpath);
+
+  return result;
 }
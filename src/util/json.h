@@ -8,10 +8,62 @@
 #define json_int_ptr_by_name(json, key, dflt) \
   GINT_TO_POINTER(json_int_by_name(json, key, dflt))
 
+typedef void (*json_reply_cb) ( json_object *json, gpointer data );
+typedef gssize (*json_frame_cb) ( const gchar *header );
+
+typedef struct _json_stream {
+  gint sock;
+  gsize hlen;
+  json_frame_cb frame;
+  GByteArray *buf;
+  gsize pos;
+  json_tokener *tok;
+} json_stream_t;
+
+typedef struct _json_conn {
+  gchar *addr;
+  gint sock;
+  json_stream_t *stream;
+  gint timeout;
+  gsize hlen;
+  json_frame_cb frame;
+  GIOChannel *chan;
+  guint watch;
+  guint deadline;
+  GQueue pending;
+} json_conn_t;
+
+typedef struct _jpath_step {
+  GTokenType op;
+  GTokenType ftype;
+  GTokenType vtype;
+  gboolean eq;
+  gchar *key;
+  gchar *str;
+  gulong ival;
+  gdouble fval;
+} jpath_step_t;
+
+typedef GPtrArray jpath_t;
+
 gint socket_connect ( const gchar *sockaddr, gint to );
 gboolean recv_retry ( gint sock, gpointer buff, gsize len );
 json_object *recv_json ( gint sock, gssize len );
-json_object *json_recv_channel ( GIOChannel *chan );
+
+json_stream_t *json_stream_new ( gint sock, gsize hlen, json_frame_cb frame );
+void json_stream_free ( json_stream_t *stream );
+gboolean json_stream_fill ( json_stream_t *stream );
+gboolean json_stream_next ( json_stream_t *stream, gchar *header,
+    json_object **json );
+gboolean json_stream_read ( json_stream_t *stream, gchar *header,
+    json_object **json, gint to );
+
+json_conn_t *json_conn_new ( const gchar *addr, gint to, gsize hlen,
+    json_frame_cb frame );
+void json_conn_free ( json_conn_t *conn );
+gboolean json_conn_connect ( json_conn_t *conn );
+gboolean json_conn_send ( json_conn_t *conn, gconstpointer header,
+    const gchar *body, gsize len, json_reply_cb cb, gpointer data );
 
 const gchar *json_string_by_name ( struct json_object *obj, gchar *name );
 gint64 json_int_by_name ( struct json_object *obj, gchar *name, gint64 defval);
@@ -24,6 +76,12 @@ gboolean json_array_to_strv ( struct json_object *json, gchar ***strv );
 void json_foreach ( struct json_object *json,
     void (*func)(struct json_object *, gpointer data), gpointer data );
 
+jpath_t *jpath_compile ( const gchar *path );
+void jpath_free ( jpath_t *jpath );
+struct json_object *jpath_exec ( jpath_t *jpath, struct json_object *obj );
+gboolean jpath_has_root ( jpath_t *jpath, const gchar *root );
+struct json_object *jpath_exec_root ( jpath_t *jpath, const gchar *root,
+    struct json_object *obj );
 struct json_object *jpath_parse ( gchar *path, struct json_object *obj );
 
 #endif
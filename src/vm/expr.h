@@ -10,6 +10,7 @@ typedef struct _expr_cache {
   gchar *cache;
   GBytes *code;
   gboolean always_update;
+  gboolean clock;
   GtkWidget *widget;
   GdkEvent *event;
   gint stack_depth;
@@ -73,12 +73,54 @@ void vm_func_add_user ( gchar *name, GBytes *code, guint8 arity )
   func->ptr.code = code;
   func->flags = VM_FUNC_USERDEFINED;
   func->arity = arity;
+  func->selectors = NULL;
   g_atomic_int_inc(&func->seq);
   g_mutex_unlock(&func_mutex);
   expr_dep_trigger(g_quark_from_string(name));
   g_debug("function: registered '%s'", name);
 }
 
+/* keys is a NULL terminated table of literals the parser can pre-resolve
+ * for parameter param. The table must never be freed, it may be registered
+ * before the function itself */
+void vm_func_selectors_add ( gchar *name, guint8 param, const gchar **keys )
+{
+  vm_function_t *func;
+
+  func = vm_func_lookup(name);
+  g_mutex_lock(&func_mutex);
+  g_atomic_int_inc(&func->seq);
+  func->sel_param = param;
+  func->selectors = keys;
+  g_atomic_int_inc(&func->seq);
+  g_mutex_unlock(&func_mutex);
+}
+
+/* resolve a parameter against a selector table, returns -1 if no match */
+gint vm_param_selector ( value_t v, const gchar **keys )
+{
+  const gchar *str;
+  gint i;
+
+  if(value_is_selector(v))
+  {
+    for(i=0; keys[i]; i++)
+      if(v.value.selector == &keys[i])
+        return i;
+    str = *v.value.selector;
+  }
+  else if(value_is_string(v))
+    str = v.value.string;
+  else
+    return -1;
+
+  for(i=0; keys[i]; i++)
+    if(!g_ascii_strcasecmp(str, keys[i]))
+      return i;
+
+  return -1;
+}
+
 void vm_func_remove ( gchar *name, vm_func_t ofunc )
 {
   vm_function_t *func;
@@ -126,6 +126,35 @@ static void parser_emit_function ( GByteArray *code, const void *f, guint8 np )
   g_byte_array_append(code, data, sizeof(gpointer)+2);
 }
 
+/* replace a literal string parameter with a pre-resolved selector */
+static void parser_emit_selector ( GByteArray *code, gint start,
+    const gchar **keys )
+{
+  guchar data[sizeof(value_t)+1];
+  value_t value;
+  gchar *str;
+  gint i;
+
+  if(code->len < start+3 || code->data[start] != EXPR_OP_IMMEDIATE ||
+      code->data[start+1] != EXPR_TYPE_STRING)
+    return;
+  str = (gchar *)code->data + start + 2;
+  if(start + 3 + strlen(str) != code->len)
+    return;
+
+  for(i=0; keys[i]; i++)
+    if(!g_ascii_strcasecmp(str, keys[i]))
+      break;
+  if(!keys[i])
+    return;
+
+  g_byte_array_set_size(code, start);
+  data[0] = EXPR_OP_IMMEDIATE;
+  value = (value_t){ .type = EXPR_TYPE_SELECTOR, .value.selector = &keys[i] };
+  memcpy(data+1, &value, sizeof(value_t));
+  g_byte_array_append(code, data, sizeof(value_t)+1);
+}
+
 static void parser_jump_backpatch ( GByteArray *code, gint olen, gint clen )
 {
   gint data = clen - olen - sizeof(gint);
@@ -219,21 +248,26 @@ static gboolean parser_if ( GScanner *scanner, GByteArray *code )
 
 static gboolean parser_function ( GScanner *scanner, GByteArray *code )
 {
-  vm_function_t *ptr;
+  vm_function_t *ptr, func;
   guint8 np;
+  gint start;
 
   if(!g_ascii_strcasecmp(scanner->value.v_identifier, "ident"))
     scanner->config->identifier_2_string = TRUE;
 
   ptr = vm_func_lookup(scanner->value.v_identifier);
+  vm_func_copy(&func, ptr);
   g_scanner_get_next_token(scanner); // consume '('
 
   np = 0;
   if(!config_check_and_consume(scanner, ')'))
     do
     {
+      start = code->len;
       if(!parser_expr_parse(scanner, code))
         return FALSE;
+      if(func.selectors && np == func.sel_param)
+        parser_emit_selector(code, start, func.selectors);
       np++;
     } while(g_scanner_get_next_token(scanner)==',' && np<255);
 
@@ -8,7 +8,8 @@ enum expr_type_t {
   EXPR_TYPE_NUMERIC,
   EXPR_TYPE_STRING,
   EXPR_TYPE_ARRAY,
-  EXPR_TYPE_BOOLEAN // Not in use
+  EXPR_TYPE_BOOLEAN, // Not in use
+  EXPR_TYPE_SELECTOR
 };
 
 typedef struct {
@@ -18,6 +19,7 @@ typedef struct {
     gdouble numeric;
     gchar *string;
     GArray *array;
+    const gchar **selector;
   } value;
 } value_t;
 
@@ -35,6 +37,7 @@ extern const value_t value_na;
 #define value_is_numeric(v) ((v).type == EXPR_TYPE_NUMERIC)
 #define value_is_na(v) ((v).type == EXPR_TYPE_NA)
 #define value_is_array(v) ((v).type == EXPR_TYPE_ARRAY)
+#define value_is_selector(v) ((v).type == EXPR_TYPE_SELECTOR)
 
 #define value_like_string(v) (value_is_string(v) || value_is_na(v))
 #define value_like_numeric(v) (value_is_numeric(v) || value_is_na(v))
@@ -75,6 +75,8 @@ typedef struct {
   gchar *name;
   guint8 flags;
   guint8 arity;
+  guint8 sel_param;
+  const gchar **selectors;
   GMainContext *context;
   union {
     vm_func_t function;
@@ -144,6 +146,8 @@ void vm_func_add_full ( gchar *name, vm_func_t func, gboolean det,
     gboolean safe, GMainContext *ctx );
 void vm_func_add ( gchar *name, vm_func_t func, gboolean det, gboolean safe);
 void vm_func_add_user ( gchar *name, GBytes *code, guint8 arity );
+void vm_func_selectors_add ( gchar *name, guint8 param, const gchar **keys );
+gint vm_param_selector ( value_t v, const gchar **keys );
 vm_function_t *vm_func_lookup ( gchar *name );
 void vm_func_remove ( gchar *name, vm_func_t func );
 vm_function_t *vm_func_copy ( vm_function_t *dest, vm_function_t *src );
@@ -3,8 +3,10 @@
  * Copyright 2023- sfwbar maintainers
  */
 
+#define _GNU_SOURCE
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <gdk/gdkwayland.h>
 #include "wayland.h"
 #include "gui/monitor.h"
@@ -15,18 +17,27 @@
 static GList *wayland_ifaces;
 static struct wl_registry *wayland_registry;
 static gboolean wayland_init_complete;
+static GList *wayland_shm_idle;
+static gsize wayland_shm_bytes, wayland_shm_peak, wayland_shm_idle_bytes;
 struct wl_shm *shm;
 
-wayland_buffer_t *wayland_buffer_new ( guint32 w, guint32 h, guint32 f )
+#define WAYLAND_SHM_MIN_SLAB (64*1024)
+#define WAYLAND_SHM_IDLE_MAX (32*1024*1024)
+
+static gint wayland_shm_fd ( gsize size )
 {
-  wayland_buffer_t *buff;
-  struct wl_shm_pool *pool;
-  void *shm_data = NULL;
   gchar *name;
-  gint fd, retries = 100, stride, size;
+  gint fd, retries = 100;
 
-  if(!shm || f != WL_SHM_FORMAT_ARGB8888 || w==0 || h==0)
-    return NULL;
+#ifdef MFD_CLOEXEC
+  if( (fd = memfd_create("sfwbar", MFD_CLOEXEC))>=0 )
+  {
+    if(ftruncate(fd, size) >= 0)
+      return fd;
+    close(fd);
+    return -1;
+  }
+#endif
 
   do
   {
@@ -36,35 +47,120 @@ wayland_buffer_t *wayland_buffer_new ( guint32 w, guint32 h, guint32 f )
     g_free(name);
   } while (--retries > 0 && errno == EEXIST && fd < 0 );
 
-  if(fd<0)
-    return NULL;
+  if(fd>=0 && ftruncate(fd, size) < 0)
+  {
+    close(fd);
+    fd = -1;
+  }
 
-  stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, w);
-  size = stride * h;
+  return fd;
+}
 
-  if( (ftruncate(fd, size) >= 0) &&
-      (shm_data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))
-      != MAP_FAILED)
+static wayland_shm_slab_t *wayland_shm_slab_new ( gsize size )
+{
+  wayland_shm_slab_t *slab;
+  gpointer data;
+  gint fd;
+
+  if( (fd = wayland_shm_fd(size))<0 )
+    return NULL;
+
+  if( (data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))
+      == MAP_FAILED)
   {
-    buff = g_malloc0(sizeof(wayland_buffer_t));
-    pool = wl_shm_create_pool(shm, fd, size);
-    buff->buffer = wl_shm_pool_create_buffer(pool, 0, w, h, stride, f);
-    buff->data = shm_data;
-    buff->size = size;
-    wl_shm_pool_destroy(pool);
+    close(fd);
+    return NULL;
   }
-  else
-    buff = NULL;
 
+  slab = g_malloc0(sizeof(wayland_shm_slab_t));
+  slab->pool = wl_shm_create_pool(shm, fd, size);
+  slab->data = data;
+  slab->size = size;
   close(fd);
 
+  wayland_shm_bytes += size;
+  wayland_shm_peak = MAX(wayland_shm_peak, wayland_shm_bytes);
+  g_debug("wayland: shm slab %" G_GSIZE_FORMAT " bytes, %" G_GSIZE_FORMAT
+      " allocated, %" G_GSIZE_FORMAT " peak", size, wayland_shm_bytes,
+      wayland_shm_peak);
+
+  return slab;
+}
+
+static void wayland_shm_slab_free ( wayland_shm_slab_t *slab )
+{
+  wayland_shm_bytes -= slab->size;
+  wl_shm_pool_destroy(slab->pool);
+  munmap(slab->data, slab->size);
+  g_free(slab);
+}
+
+/* buffers are carved from pooled shm slabs, sized in powers of two so
+ * captures of similar size reuse the same memory */
+static wayland_shm_slab_t *wayland_shm_slab_get ( gsize size )
+{
+  wayland_shm_slab_t *slab;
+  GList *iter, *best = NULL;
+  gsize bucket;
+
+  bucket = MAX(WAYLAND_SHM_MIN_SLAB, (gsize)1 << g_bit_storage(size - 1));
+
+  for(iter=wayland_shm_idle; iter; iter=g_list_next(iter))
+    if(((wayland_shm_slab_t *)iter->data)->size >= bucket && (!best ||
+          ((wayland_shm_slab_t *)iter->data)->size <
+          ((wayland_shm_slab_t *)best->data)->size))
+      best = iter;
+
+  if(best && ((wayland_shm_slab_t *)best->data)->size <= 2*bucket)
+  {
+    slab = best->data;
+    wayland_shm_idle_bytes -= slab->size;
+    wayland_shm_idle = g_list_delete_link(wayland_shm_idle, best);
+    return slab;
+  }
+
+  return wayland_shm_slab_new(bucket);
+}
+
+static void wayland_shm_slab_put ( wayland_shm_slab_t *slab )
+{
+  if(wayland_shm_idle_bytes + slab->size > WAYLAND_SHM_IDLE_MAX)
+  {
+    wayland_shm_slab_free(slab);
+    return;
+  }
+  wayland_shm_idle_bytes += slab->size;
+  wayland_shm_idle = g_list_prepend(wayland_shm_idle, slab);
+}
+
+wayland_buffer_t *wayland_buffer_new ( guint32 w, guint32 h, guint32 f )
+{
+  wayland_buffer_t *buff;
+  wayland_shm_slab_t *slab;
+  gint stride;
+
+  if(!shm || f != WL_SHM_FORMAT_ARGB8888 || w==0 || h==0)
+    return NULL;
+
+  stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, w);
+  if( !(slab = wayland_shm_slab_get((gsize)stride * h)) )
+    return NULL;
+
+  buff = g_malloc0(sizeof(wayland_buffer_t));
+  buff->slab = slab;
+  buff->buffer = wl_shm_pool_create_buffer(slab->pool, 0, w, h, stride, f);
+  buff->data = slab->data;
+  buff->size = stride * h;
+
   return buff;
 }
 
+/* the slab is returned to the pool, the caller must not reference the
+ * buffer data afterwards */
 void wayland_buffer_free ( wayland_buffer_t *buff )
 {
   wl_buffer_destroy(buff->buffer);
-  munmap(buff->data, buff->size);
+  wayland_shm_slab_put(buff->slab);
   g_free(buff);
 }
 
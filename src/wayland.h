@@ -9,10 +9,17 @@ typedef struct _wayland_iface {
   guint32 version;
 } wayland_iface_t;
 
+typedef struct _wayland_shm_slab {
+  struct wl_shm_pool *pool;
+  gpointer data;
+  gsize size;
+} wayland_shm_slab_t;
+
 typedef struct _wayland_buffer {
   struct wl_buffer *buffer;
   gpointer data;
   guint32 size;
+  wayland_shm_slab_t *slab;
 } wayland_buffer_t;
 
 void wayland_init ( void );
@@ -5,10 +5,17 @@
 
 #include "appinfo.h"
 #include "trigger.h"
+#include "gui/scaleimage.h"
 #include "util/string.h"
 
 static struct wintree_api *api;
 static GList *wt_list;
+static GHashTable *wt_links, *wt_uid_map, *wt_pid_map, *wt_pid_keys;
+static GHashTable *wt_appid_map, *wt_pending;
+static GQueue wt_pending_queue = G_QUEUE_INIT;
+static guint wt_flush_id, wt_commits, wt_delivered;
+static gint64 wt_stats_since;
+static guint wt_filter_serial = 1;
 static GList *appid_map;
 static GList *appid_filter_list;
 static GList *title_filter_list;
@@ -79,17 +86,15 @@ void wintree_listener_remove ( void *data )
     wintree_listeners = g_list_remove(wintree_listeners, iter->data);
 }
 
-static gboolean wintree_pin_cmp ( window_t *win, gchar *pin )
-{
-  return !(win->pin && !g_strcmp0(pin, win->appid));
-}
-
 window_t *wintree_pin_get ( gchar *pin )
 {
-  GList *l;
+  GList *iter;
 
-  return (l = g_list_find_custom(wt_list, pin, (GCompareFunc)wintree_pin_cmp))?
-    l->data : NULL;
+  for(iter=wintree_from_appid(pin); iter; iter=g_list_next(iter))
+    if(((window_t *)iter->data)->pin)
+      return iter->data;
+
+  return NULL;
 }
 
 void wintree_pin_add ( gchar *pin )
@@ -115,10 +120,13 @@ void wintree_pin_add ( gchar *pin )
   wintree_window_append(win);
 }
 
-static void wintree_pin_invalidate ( window_t *win, gchar *pin )
+static void wintree_pin_invalidate ( const gchar *pin )
 {
-  if(win->pin && !g_strcmp0(win->appid, pin))
-    wintree_commit(win);
+  GList *iter;
+
+  for(iter=wintree_from_appid(pin); iter; iter=g_list_next(iter))
+    if(((window_t *)iter->data)->pin)
+      wintree_commit(iter->data);
 }
 
 void wintree_move_to ( gpointer id, gpointer wsid )
@@ -145,6 +153,116 @@ gchar *wintree_get_active ( void )
   return win? win->title : "";
 }
 
+static void wintree_index_init ( void )
+{
+  if(wt_links)
+    return;
+
+  wt_links = g_hash_table_new(g_direct_hash, g_direct_equal);
+  wt_uid_map = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify)g_queue_free);
+  wt_pid_map = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free,
+      (GDestroyNotify)g_queue_free);
+  wt_pid_keys = g_hash_table_new(g_direct_hash, g_direct_equal);
+  wt_appid_map = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify)g_queue_free);
+  wt_pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+static void wintree_appid_index_remove ( window_t *win )
+{
+  GQueue *bucket;
+
+  if(!win->appid || !(bucket = g_hash_table_lookup(wt_appid_map, win->appid)))
+    return;
+
+  g_queue_remove(bucket, win);
+  if(g_queue_is_empty(bucket))
+    g_hash_table_remove(wt_appid_map, win->appid);
+}
+
+static void wintree_appid_index_add ( window_t *win )
+{
+  GQueue *bucket;
+
+  if(!win->appid)
+    return;
+
+  if( !(bucket = g_hash_table_lookup(wt_appid_map, win->appid)) )
+  {
+    bucket = g_queue_new();
+    g_hash_table_insert(wt_appid_map, g_strdup(win->appid), bucket);
+  }
+  g_queue_push_tail(bucket, win);
+}
+
+static void wintree_uid_index_remove ( window_t *win )
+{
+  GQueue *bucket;
+
+  if(win->pin || !(bucket = g_hash_table_lookup(wt_uid_map, win->uid)) )
+    return;
+
+  g_queue_remove(bucket, win);
+  if(g_queue_is_empty(bucket))
+    g_hash_table_remove(wt_uid_map, win->uid);
+}
+
+/* windows sharing a uid are kept in wt_list order, so wintree_from_id
+ * still finds a surviving duplicate once the first one is deleted */
+static void wintree_uid_index_add ( window_t *win )
+{
+  GQueue *bucket;
+
+  if(win->pin)
+    return;
+
+  if( !(bucket = g_hash_table_lookup(wt_uid_map, win->uid)) )
+  {
+    bucket = g_queue_new();
+    g_hash_table_insert(wt_uid_map, win->uid, bucket);
+  }
+  g_queue_push_tail(bucket, win);
+}
+
+static void wintree_pid_index_remove ( window_t *win )
+{
+  GQueue *bucket;
+  gint64 *key;
+
+  if( !(key = g_hash_table_lookup(wt_pid_keys, win)) )
+    return;
+
+  g_hash_table_remove(wt_pid_keys, win);
+  bucket = g_hash_table_lookup(wt_pid_map, key);
+  g_queue_remove(bucket, win);
+  if(g_queue_is_empty(bucket))
+    g_hash_table_remove(wt_pid_map, key);
+}
+
+/* windows sharing a pid are kept in wt_list order, so wintree_from_pid
+ * returns the same window a linear scan would */
+static void wintree_pid_index_add ( window_t *win, gboolean head )
+{
+  GQueue *bucket;
+  gint64 *key;
+
+  if(!g_hash_table_lookup_extended(wt_pid_map, &win->pid, (gpointer *)&key,
+        (gpointer *)&bucket))
+  {
+    key = g_malloc(sizeof(gint64));
+    *key = win->pid;
+    bucket = g_queue_new();
+    g_hash_table_insert(wt_pid_map, key, bucket);
+  }
+
+  if(head)
+    g_queue_push_head(bucket, win);
+  else
+    g_queue_push_tail(bucket, win);
+  g_hash_table_insert(wt_pid_keys, win, key);
+}
+
 window_t *wintree_window_init ( void )
 {
   window_t *w;
@@ -175,22 +293,22 @@ gint wintree_compare ( window_t *a, window_t *b)
 
 void wintree_set_focus ( gpointer id )
 {
-  GList *iter;
+  window_t *win;
+  GList *link;
 
   if(wt_focus == id)
     return;
   wintree_commit(wintree_from_id(wt_focus));
   wt_focus = id;
-  for(iter=wt_list; iter; iter=g_list_next(iter) )
-    if(((window_t *)(iter->data))->uid==id && !((window_t *)(iter->data))->pin)
-      break;
-  if(!iter)
+  if( !(win = wintree_from_id(id)) )
     return;
-  if(g_list_previous(iter))
+  link = g_hash_table_lookup(wt_links, win);
+  if(link != wt_list)
   {
-    g_list_previous(iter)->next = NULL;
-    iter->prev = NULL;
-    wt_list = g_list_concat(iter, wt_list);
+    wt_list = g_list_remove_link(wt_list, link);
+    wt_list = g_list_concat(link, wt_list);
+    wintree_pid_index_remove(win);
+    wintree_pid_index_add(win, TRUE);
   }
   wintree_commit(wt_list->data);
   trigger_emit("window_focus");
@@ -208,29 +326,81 @@ gboolean wintree_is_focused ( gpointer id )
 
 window_t *wintree_from_id ( gpointer id )
 {
-  GList *iter;
+  GQueue *bucket;
 
-  for(iter = wt_list; iter; iter=g_list_next(iter) )
-    if ( ((window_t *)(iter->data))->uid == id &&
-        !((window_t *)(iter->data))->pin )
-      break;
-  return iter? iter->data : NULL;
+  if(!wt_uid_map || !(bucket = g_hash_table_lookup(wt_uid_map, id)) )
+    return NULL;
+
+  return g_queue_peek_head(bucket);
+}
+
+GList *wintree_from_appid ( const gchar *appid )
+{
+  GQueue *bucket;
+
+  if(!appid || !wt_appid_map ||
+      !(bucket = g_hash_table_lookup(wt_appid_map, appid)) )
+    return NULL;
+
+  return bucket->head;
 }
 
 window_t *wintree_from_pid ( gint64 pid )
 {
-  GList *iter;
+  GQueue *bucket;
 
-  for(iter = wt_list; iter; iter=g_list_next(iter) )
-    if ( ((window_t *)(iter->data))->pid == pid )
-      break;
-  return iter? iter->data : NULL;
+  if(!wt_pid_map || !(bucket = g_hash_table_lookup(wt_pid_map, &pid)) )
+    return NULL;
+
+  return g_queue_peek_head(bucket);
+}
+
+/* deliver invalidations queued since the last main loop iteration, once per
+ * window, in the order they were first committed */
+static gboolean wintree_flush ( gpointer d )
+{
+  window_t *win;
+  gint64 now;
+  guint n;
+
+  wt_flush_id = 0;
+  for(n=wt_pending_queue.length; n>0; n--)
+  {
+    win = g_queue_pop_head(&wt_pending_queue);
+    if(g_hash_table_remove(wt_pending, win))
+    {
+      wt_delivered++;
+      LISTENER_CALL(window_invalidate, win);
+    }
+  }
+
+  now = g_get_monotonic_time();
+  if(now - wt_stats_since >= G_USEC_PER_SEC)
+  {
+    if(wt_stats_since)
+      g_debug("wintree: %u window updates/s, %u delivered", wt_commits,
+          wt_delivered);
+    wt_commits = 0;
+    wt_delivered = 0;
+    wt_stats_since = now;
+  }
+
+  return G_SOURCE_REMOVE;
 }
 
 void wintree_commit ( window_t *win )
 {
-  if(win)
-    LISTENER_CALL(window_invalidate, win);
+  if(!win)
+    return;
+
+  wintree_index_init();
+  wt_commits++;
+  if(!g_hash_table_add(wt_pending, win))
+    return;
+  g_queue_push_tail(&wt_pending_queue, win);
+  if(!wt_flush_id)
+    wt_flush_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE, wintree_flush, NULL,
+        NULL);
 }
 
 void wintree_set_title ( gpointer wid, const gchar *title )
@@ -247,6 +417,7 @@ void wintree_set_title ( gpointer wid, const gchar *title )
     return;
 
   str_assign(&win->title, g_strdup(title));
+  win->filter_serial = 0;
   wintree_commit(win);
 }
 
@@ -258,13 +429,16 @@ void wintree_set_app_id ( gpointer wid, const gchar *app_id)
     return;
 
   LISTENER_CALL(window_destroy, win);
+  wintree_appid_index_remove(win);
   str_assign(&win->appid, g_strdup(app_id));
+  wintree_appid_index_add(win);
   if(!win->title)
     str_assign(&win->title, g_strdup(app_id));
+  win->filter_serial = 0;
   LISTENER_CALL(window_new, win);
 
   wintree_commit(win);
-  g_list_foreach(wt_list, (GFunc)wintree_pin_invalidate, (void*)app_id);
+  wintree_pin_invalidate(app_id);
 }
 
 void wintree_set_stable_id ( gpointer wid, const gchar *stable_id )
@@ -312,10 +486,22 @@ void wintree_window_append ( window_t *win )
   if(!win)
     return;
 
+  wintree_index_init();
   if(win->title || win->appid)
     LISTENER_CALL(window_new, win);
-  if(!g_list_find(wt_list, win))
+  if(!g_hash_table_contains(wt_links, win))
+  {
     wt_list = g_list_append (wt_list, win);
+    g_hash_table_insert(wt_links, win, g_list_last(wt_list));
+    wintree_uid_index_add(win);
+    wintree_pid_index_add(win, FALSE);
+    wintree_appid_index_add(win);
+  }
+  else if(*(gint64 *)g_hash_table_lookup(wt_pid_keys, win) != win->pid)
+  {
+    wintree_pid_index_remove(win);
+    wintree_pid_index_add(win, FALSE);
+  }
   wintree_commit(win);
 }
 
@@ -326,14 +512,21 @@ void wintree_window_delete ( gpointer id )
   if( !(win = wintree_from_id(id)) )
     return;
 
-  wt_list = g_list_remove(wt_list, win);
+  wt_list = g_list_delete_link(wt_list, g_hash_table_lookup(wt_links, win));
+  g_hash_table_remove(wt_links, win);
+  wintree_uid_index_remove(win);
+  wintree_pid_index_remove(win);
+  wintree_appid_index_remove(win);
+  g_hash_table_remove(wt_pending, win);
 
   LISTENER_CALL(window_destroy, win);
   if(win->workspace)
     workspace_unref(win->workspace->id);
-  g_list_foreach(wt_list, (GFunc)wintree_pin_invalidate, win->appid);
+  wintree_pin_invalidate(win->appid);
   g_free(win->appid);
   g_free(win->title);
+  scale_image_cache_unref(win->image);
+  g_free(win->image);
   g_list_free_full(win->outputs, g_free);
   g_free(win);
 }
@@ -383,17 +576,27 @@ gchar *wintree_appid_map_lookup ( gchar *title )
 void wintree_filter_appid ( gchar *pattern )
 {
   regex_list_add(&appid_filter_list, pattern);
+  wt_filter_serial++;
 }
 
 void wintree_filter_title ( gchar *pattern )
 {
   regex_list_add(&title_filter_list, pattern);
+  wt_filter_serial++;
 }
 
+/* the verdict is cached per window until its title or appid changes or
+ * a filter is added */
 gboolean wintree_is_filtered ( window_t *win )
 {
-  return (regex_match_list(appid_filter_list, win->appid) ||
-    regex_match_list(title_filter_list, win->title));
+  if(win->filter_serial != wt_filter_serial)
+  {
+    win->filtered = regex_match_list(appid_filter_list, win->appid) ||
+      regex_match_list(title_filter_list, win->title);
+    win->filter_serial = wt_filter_serial;
+  }
+
+  return win->filtered;
 }
 
 static gint x_step, y_step, x_origin, y_origin;
@@ -417,8 +620,9 @@ static int comp_int ( const void *x1, const void *x2)
 
 gboolean wintree_placer_calc ( gpointer wid, GdkRectangle *place )
 {
-  window_t *win;
+  window_t *win, *peer;
   GdkRectangle *obs, output;
+  GQueue *bucket;
   GList *iter;
   gint *x, *y;
   gint i, j, c, nobs, focus;
@@ -428,12 +632,13 @@ gboolean wintree_placer_calc ( gpointer wid, GdkRectangle *place )
   if( !(win = wintree_from_id(GINT_TO_POINTER(wid))) || !win->workspace )
     return FALSE;
 
-  if(check_pid)
-    for(iter=wt_list; iter; iter=g_list_next(iter))
-      if( ((window_t *)(iter->data))->pid == win->pid &&
-          ((window_t *)(iter->data))->uid != wid &&
-          !((window_t *)(iter->data))->pin )
+  if(check_pid && (bucket = g_hash_table_lookup(wt_pid_map, &win->pid)) )
+    for(iter=bucket->head; iter; iter=g_list_next(iter))
+    {
+      peer = iter->data;
+      if(peer->uid != wid && !peer->pin)
         return FALSE;
+    }
 
   place->width = place->height = 0;
   nobs = workspace_get_geometry(wid, place, win->workspace->id, &obs, &output,
@@ -22,6 +22,8 @@ typedef struct wt_window {
   guint16 state;
   gboolean floating;
   gboolean valid;
+  gboolean filtered;
+  guint filter_serial;
 } window_t;
 
 struct wintree_api {
@@ -54,6 +56,7 @@ window_t *wintree_pin_get ( gchar *pin );
 window_t *wintree_window_init ( void );
 window_t *wintree_from_id ( gpointer id );
 window_t *wintree_from_pid ( gint64 pid );
+GList *wintree_from_appid ( const gchar *appid );
 void wintree_window_append ( window_t *win );
 void wintree_window_delete ( gpointer id );
 void wintree_commit ( window_t *win );
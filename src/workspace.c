@@ -12,7 +12,10 @@ static workspace_t *focus;
 static GList *global_pins;
 static GList *workspaces;
 static GList *workspace_listeners;
-static GHashTable *actives;
+static GHashTable *actives, *ws_pending;
+static GQueue ws_pending_queue = G_QUEUE_INIT;
+static guint ws_flush_id, ws_commits, ws_delivered;
+static gint64 ws_stats_since;
 
 #define LISTENER_CALL(method, ws) { \
   for(GList *li=workspace_listeners; li; li=li->next) \
@@ -85,6 +88,8 @@ void workspace_unref ( gpointer id )
 
   if(ws == focus)
     focus = NULL;
+  if(ws_pending)
+    g_hash_table_remove(ws_pending, ws);
 
   if(ws->data && api->free_data)
     g_clear_pointer(&ws->data, api->free_data);
@@ -176,6 +181,8 @@ static void workspace_pin_remove ( const gchar *pin )
 
   ws = iter->data;
   str_assign(&ws->name, "");
+  if(ws_pending)
+    g_hash_table_remove(ws_pending, ws);
   LISTENER_CALL(workspace_destroy, ws);
   workspaces = g_list_remove(workspaces, ws);
   g_free(ws);
@@ -239,6 +246,39 @@ gpointer workspace_get_focused ( void )
   return focus? focus->id : NULL;
 }
 
+static gboolean workspace_flush ( gpointer d )
+{
+  workspace_t *ws;
+  gint64 now;
+  guint n;
+
+  ws_flush_id = 0;
+  for(n=ws_pending_queue.length; n>0; n--)
+  {
+    ws = g_queue_pop_head(&ws_pending_queue);
+    if(g_hash_table_remove(ws_pending, ws))
+    {
+      ws_delivered++;
+      LISTENER_CALL(workspace_invalidate, ws);
+    }
+  }
+
+  now = g_get_monotonic_time();
+  if(now - ws_stats_since >= G_USEC_PER_SEC)
+  {
+    if(ws_stats_since)
+      g_debug("Workspace: %u updates/s, %u delivered", ws_commits,
+          ws_delivered);
+    ws_commits = 0;
+    ws_delivered = 0;
+    ws_stats_since = now;
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* listeners are notified once per main loop iteration, however many times
+ * the workspace was committed since */
 void workspace_commit ( workspace_t *ws )
 {
   if(!ws || !(ws->state & WS_STATE_INVALID))
@@ -248,7 +288,24 @@ void workspace_commit ( workspace_t *ws )
   if(ws->state & WS_STATE_FOCUSED)
     focus = ws;
 
-  LISTENER_CALL(workspace_invalidate, ws);
+  if(!ws_pending)
+    ws_pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+  ws_commits++;
+  if(!g_hash_table_add(ws_pending, ws))
+    return;
+  g_queue_push_tail(&ws_pending_queue, ws);
+  if(!ws_flush_id)
+    ws_flush_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE, workspace_flush,
+        NULL, NULL);
+}
+
+/* for backends whose workspace contents changed without a state change */
+void workspace_invalidate ( workspace_t *ws )
+{
+  if(!ws)
+    return;
+  ws->state |= WS_STATE_INVALID;
+  workspace_commit(ws);
 }
 
 void workspace_mod_state ( gpointer id, gint32 mask, gboolean state )
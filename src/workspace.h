@@ -48,6 +48,7 @@ void workspace_listener_register ( workspace_listener_t *, gpointer );
 void workspace_listener_remove ( void *data );
 workspace_t *workspace_new ( gpointer id );
 void workspace_commit ( workspace_t *ws );
+void workspace_invalidate ( workspace_t *ws );
 void workspace_change_focus ( gpointer id );
 //void workspace_set_state ( workspace_t *ws, guint32 state );
 void workspace_mod_state ( gpointer id, gint32 mask, gboolean state );